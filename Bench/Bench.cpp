@@ -0,0 +1,312 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Controller.h"
+#include "ExpressionAllocator.h"
+#include "HeapCounter.h"
+
+using namespace std;
+
+//=============================================================================
+
+struct BenchArgs {
+  bool        Quick;
+  int         Repeat;
+  string      Filter;
+  string      OutPath;
+  string      Engine;
+  bool        Error;
+
+  explicit BenchArgs(int argc, const char * const *argv);
+
+private:
+  bool ParseValueArg(const string &arg, const string &prefix, string &value);
+};
+
+BenchArgs::BenchArgs(int argc, const char * const *argv):
+  Quick(false),
+  Repeat(5),
+  Filter(),
+  OutPath(),
+  Engine("tree"),
+  Error(false)
+{
+  for (int argIdx = 1; argIdx < argc; ++argIdx) {
+    string arg = argv[argIdx], repeat;
+    if (arg == "--quick")
+      Quick = true;
+    else if (ParseValueArg(arg, "--repeat=", repeat))
+      Repeat = max(1, atoi(repeat.c_str()));
+    else if (!ParseValueArg(arg, "--filter=", Filter) &&
+             !ParseValueArg(arg, "--out=", OutPath) &&
+             !ParseValueArg(arg, "--engine=", Engine))
+      Error = true;
+  }
+  if (Quick)
+    Repeat = 1;
+}
+
+bool BenchArgs::ParseValueArg(const string &arg, const string &prefix, string &value) {
+  if (arg.compare(0, prefix.length(), prefix) != 0)
+    return false;
+  value = arg.substr(prefix.length());
+  return true;
+}
+
+//=============================================================================
+
+struct Measurement {
+  uint64_t Ns;
+  uint64_t ExpressionAllocations;
+  uint64_t HeapAllocations;
+};
+
+// Counts what happens between Start and Stop, set up work outside of them
+// doesn't show up in the results
+class Stopwatch {
+  public:
+    void Start() {
+      StartExpressions = ExpressionAllocator::GetStats().Objects;
+      StartHeap = HeapCounter::GetAllocations();
+      StartTime = chrono::steady_clock::now();
+    }
+
+    void Stop() {
+      auto elapsed = chrono::steady_clock::now() - StartTime;
+      Result.Ns = chrono::duration_cast<chrono::nanoseconds>(elapsed).count();
+      Result.ExpressionAllocations = ExpressionAllocator::GetStats().Objects - StartExpressions;
+      Result.HeapAllocations = HeapCounter::GetAllocations() - StartHeap;
+    }
+
+    Measurement Result;
+
+  private:
+    chrono::steady_clock::time_point StartTime;
+    uint64_t StartExpressions;
+    uint64_t StartHeap;
+};
+
+// A benchmark runs ops operations between Start and Stop, and returns false
+// if the work it timed failed
+struct Benchmark {
+  string  Name;
+  int64_t Ops;
+  function<bool(const BenchArgs &args, int64_t ops, Stopwatch &watch)> Run;
+};
+
+// setup and code see the number of operations as n. A line of forms is read
+// as a single list, so forms go on lines of their own.
+static Benchmark ScriptBenchmark(const string &name, int64_t ops, const string &setup, const string &code) {
+  return Benchmark { name, ops, [setup, code](const BenchArgs &args, int64_t ops, Stopwatch &watch) {
+    string engineArg = "--engine=" + args.Engine;
+    vector<const char*> cmdArgs { "slisp", engineArg.c_str() };
+    Controller controller(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    stringstream out;
+    controller.SetOutput(out);
+    controller.Run("(set n " + to_string(ops) + ")");
+    controller.Run(setup);
+    watch.Start();
+    controller.Run(code);
+    watch.Stop();
+    if (out.str().find("Error") != string::npos) {
+      cerr << out.str();
+      return false;
+    }
+    return true;
+  }};
+}
+
+static string GenerateSource(int64_t nLines) {
+  stringstream source;
+  for (int64_t i = 0; i < nLines; ++i) {
+    source << "(def f" << i << " (x y) (if (< x y) (+ x (* y " << i << ")) (format \"{} {}\" \"line " << i << "\" 3.5)))\n";
+  }
+  return source.str();
+}
+
+static vector<Benchmark> GetBenchmarks() {
+  vector<Benchmark> benchmarks;
+
+  benchmarks.push_back(ScriptBenchmark("symbol-lookup", 200000,
+    "(set a 1)\n(set b 2)\n(set c 3)\n(set d 4)\n(set i 0)",
+    "(while (< i n) (begin a b c d a b c d) (++ i))"));
+
+  benchmarks.push_back(ScriptBenchmark("function-call", 100000,
+    "(def add3 (x y z) (+ x y z))\n(set i 0)",
+    "(while (< i n) (add3 i 1 2) (++ i))"));
+
+  benchmarks.push_back(ScriptBenchmark("recursive-call", 21891,
+    "(def fib (x) (if (< x 2) x (+ (fib (- x 1)) (fib (- x 2)))))",
+    "(fib 20)"));
+
+  benchmarks.push_back(ScriptBenchmark("counter-loop", 10000000,
+    "(set i 0)",
+    "(while (< i n) (++ i))"));
+
+  benchmarks.push_back(ScriptBenchmark("foreach-sum", 1000000,
+    "(set total 0)",
+    "(foreach x (range 1 n) (+= total x))"));
+
+  // A function whose locals hold a large list, making closures over one small value
+  benchmarks.push_back(ScriptBenchmark("closure-create", 100000,
+    "(def make-closures (xs n) (let ((i 0) (f nil)) (while (< i n) (set f (fn (y) (+ y i))) (++ i))))",
+    "(make-closures (range 1 10000) n)"));
+
+  benchmarks.push_back(ScriptBenchmark("arith-while", 200000,
+    "(set i 0)\n(set total 0)",
+    "(while (< i n) (+= total (* i 3)) (-= total i) (++ i))"));
+
+  benchmarks.push_back(ScriptBenchmark("map-filter-reduce", 200000,
+    "",
+    "(reduce + (filter even? (map (fn (x) (* x 3)) (range 1 n))))"));
+
+  benchmarks.push_back(ScriptBenchmark("split-join-format", 50000,
+    "(set line \"alpha,beta,gamma,delta,epsilon\")\n(set i 0)",
+    "(while (< i n) (join (split line \",\") \";\") (format \"{} is {} of {n}\" \"item\" i) (++ i))"));
+
+  benchmarks.push_back(ScriptBenchmark("dict-count", 100000,
+    "(set counts (dict))\n(set i 0)",
+    "(while (< i n) (dict-put! counts (% i 100) (+ 1 (dict-get counts (% i 100) 0))) (++ i))"));
+
+  benchmarks.push_back(ScriptBenchmark("sort", 1000000,
+    "(set xs (map (fn (i) (% (* i 7919) 1000003)) (range 1 n)))",
+    "(set ys (sort xs))"));
+
+  benchmarks.push_back(ScriptBenchmark("sort-less", 100000,
+    "(set xs (map (fn (i) (% (* i 7919) 1000003)) (range 1 n)))",
+    "(set ys (sort (fn (a b) (< a b)) xs))"));
+
+  benchmarks.push_back(ScriptBenchmark("sort-builtin-less", 100000,
+    "(set xs (map (fn (i) (% (* i 7919) 1000003)) (range 1 n)))",
+    "(set ys (sort > xs))"));
+
+  // Parses without evaluating, one op is one line of source
+  benchmarks.push_back(Benchmark { "parse", 20000, [](const BenchArgs&, int64_t ops, Stopwatch &watch) {
+    ConsoleInterface console;
+    stringstream discarded;
+    console.SetOutput(discarded);
+    Interpreter interpreter(console);
+    StdLib lib;
+    if (!lib.Load(interpreter))
+      return false;
+    Tokenizer tokenizer;
+    Parser parser(console, tokenizer, interpreter.GetSettings());
+    string source = GenerateSource(ops);
+    console.SetInput(source.data(), source.size());
+    bool parsed = true;
+    watch.Start();
+    while (parsed && console.HasMore())
+      parsed = parser.Parse();
+    watch.Stop();
+    return parsed;
+  }});
+
+  benchmarks.push_back(Benchmark { "startup", 200, [](const BenchArgs&, int64_t ops, Stopwatch &watch) {
+    watch.Start();
+    for (int64_t i = 0; i < ops; ++i)
+      Controller controller;
+    watch.Stop();
+    return true;
+  }});
+
+  // A fresh controller importing a module of 200 functions
+  benchmarks.push_back(Benchmark { "import", 100, [](const BenchArgs&, int64_t ops, Stopwatch &watch) {
+    const string module = "BenchImport";
+    {
+      ofstream out(module + ".slisp");
+      out << GenerateSource(200);
+    }
+    bool imported = true;
+    watch.Start();
+    for (int64_t i = 0; imported && i < ops; ++i) {
+      Controller controller;
+      imported = controller.RunFile(module + ".slisp");
+    }
+    watch.Stop();
+    remove((module + ".slisp").c_str());
+    return imported;
+  }});
+
+  return benchmarks;
+}
+
+//=============================================================================
+
+static void WriteResult(ostream &out, const Benchmark &benchmark, int64_t ops, vector<Measurement> &runs) {
+  sort(begin(runs), end(runs), [](const Measurement &lhs, const Measurement &rhs) {
+    return lhs.Ns < rhs.Ns;
+  });
+  const Measurement &best = runs.front();
+  const Measurement &median = runs[runs.size() / 2];
+  double perOp = static_cast<double>(ops);
+  out << "    {\"name\": \"" << benchmark.Name << "\""
+      << ", \"ops\": " << ops
+      << ", \"min_ns\": " << best.Ns
+      << ", \"median_ns\": " << median.Ns
+      << ", \"ns_per_op\": " << best.Ns / perOp
+      << ", \"expr_allocs_per_op\": " << best.ExpressionAllocations / perOp
+      << ", \"heap_allocs_per_op\": " << best.HeapAllocations / perOp
+      << "}";
+}
+
+int main(int argc, char **argv) {
+  BenchArgs args(argc, argv);
+  if (args.Error) {
+    cerr << "usage: Bench [--quick] [--repeat=n] [--filter=name] [--engine=tree|immutable|vm] [--out=file]" << endl;
+    return 2;
+  }
+
+  ofstream outFile;
+  if (!args.OutPath.empty()) {
+    outFile.open(args.OutPath);
+    if (!outFile.is_open()) {
+      cerr << "Could not open: " << args.OutPath << endl;
+      return 2;
+    }
+  }
+  ostream &out = args.OutPath.empty() ? cout : outFile;
+
+  out << "{\n"
+      << "  \"version\": \"" << Environment().Version.ToString() << "\",\n"
+      << "  \"engine\": \"" << args.Engine << "\",\n"
+      << "  \"repeat\": " << args.Repeat << ",\n"
+      << "  \"quick\": " << (args.Quick ? "true" : "false") << ",\n"
+      << "  \"results\": [\n";
+
+  int failures = 0;
+  bool first = true;
+  for (auto &benchmark : GetBenchmarks()) {
+    if (benchmark.Name.find(args.Filter) == string::npos)
+      continue;
+
+    int64_t ops = args.Quick ? max<int64_t>(1, benchmark.Ops / 100) : benchmark.Ops;
+    vector<Measurement> runs;
+    Stopwatch watch;
+    bool ok = args.Quick || benchmark.Run(args, ops, watch);
+    for (int i = 0; ok && i < args.Repeat; ++i) {
+      ok = benchmark.Run(args, ops, watch);
+      runs.push_back(watch.Result);
+    }
+    if (!ok) {
+      cerr << "Failed: " << benchmark.Name << endl;
+      ++failures;
+      continue;
+    }
+
+    if (!first)
+      out << ",\n";
+    WriteResult(out, benchmark, ops, runs);
+    first = false;
+  }
+
+  out << "\n  ]\n}" << endl;
+  return failures == 0 ? 0 : 1;
+}
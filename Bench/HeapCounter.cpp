@@ -0,0 +1,25 @@
+#include <cstdlib>
+#include <new>
+
+#include "HeapCounter.h"
+
+using namespace std;
+
+//=============================================================================
+
+static uint64_t Allocations = 0;
+
+void* operator new(size_t size) {
+  ++Allocations;
+  if (void *ptr = malloc(size ? size : 1))
+    return ptr;
+  throw bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+uint64_t HeapCounter::GetAllocations() {
+  return Allocations;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cinttypes>
+
+// Counts calls to the global operator new. Linking HeapCounter.cpp replaces
+// operator new for the whole program, so only the benchmark executables do.
+class HeapCounter {
+  public:
+    static uint64_t GetAllocations();
+};
@@ -0,0 +1,154 @@
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "gtest/gtest.h"
+
+#include "Controller.h"
+#include "ExpressionAllocator.h"
+#include "HeapCounter.h"
+
+using namespace std;
+
+//=============================================================================
+
+class BenchmarkTest: public ::testing::Test {
+  protected:
+    static const int N_CALLS = 200;
+
+    // The calls run from one loop, so reading and compiling them is not
+    // counted against every call
+    static string CallLoop(const string &call) {
+      return "(begin (set i 0) (while (< i " + to_string(N_CALLS) + ") " + call + " (++ i)))";
+    }
+
+    size_t AllocationsPerCall(const char *engineArg, const string &def, const string &call) {
+      vector<const char*> cmdArgs { "slisp.exe", engineArg };
+      Controller controller(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+      stringstream out;
+      controller.SetOutput(out);
+      controller.Run(def);
+      controller.Run(call);
+
+      uint64_t before = HeapCounter::GetAllocations();
+      controller.Run(CallLoop(call));
+      EXPECT_EQ(string::npos, out.str().find("Error")) << out.str();
+      return static_cast<size_t>((HeapCounter::GetAllocations() - before) / N_CALLS);
+    }
+
+    uint64_t ExpressionsPerCall(const char *engineArg, const string &def, const string &call) {
+      vector<const char*> cmdArgs { "slisp.exe", engineArg };
+      Controller controller(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+      stringstream out;
+      controller.SetOutput(out);
+      controller.Run(def);
+      controller.Run(call);
+
+      AllocationStats before = ExpressionAllocator::GetStats();
+      controller.Run(CallLoop(call));
+      EXPECT_EQ(string::npos, out.str().find("Error")) << out.str();
+      return (ExpressionAllocator::GetStats() - before).Objects / N_CALLS;
+    }
+
+    void Report(const string &name, size_t tree, size_t immutable, size_t vm) {
+      cout << "[ BENCH    ] " << name << " allocations/call:"
+           << " tree=" << tree
+           << " immutable=" << immutable
+           << " vm=" << vm
+           << endl;
+      RecordProperty("tree", static_cast<int>(tree));
+      RecordProperty("immutable", static_cast<int>(immutable));
+      RecordProperty("vm", static_cast<int>(vm));
+    }
+};
+
+TEST_F(BenchmarkTest, TestFunctionBodyAllocations) {
+  const string def = R"(
+    (def body50 (x)
+      (begin
+        (set a (+ x 1 2 3))
+        (set b (* a 2 (- a 1)))
+        (set c (if (> b 10) (- b 1) (+ b 1)))
+        (set d (+ a b c (* 2 3) (- 9 4)))
+        (if (< d 0) (- 0 d) (+ d (* a 2) (- b 1)))))
+  )";
+  const string call = "(body50 5)";
+
+  size_t tree = AllocationsPerCall("--engine=tree", def, call);
+  size_t immutable = AllocationsPerCall("--engine=immutable", def, call);
+  size_t vm = AllocationsPerCall("--engine=vm", def, call);
+  Report("body50", tree, immutable, vm);
+
+  // Neither engine copies the body, and the VM calls functions without going
+  // through a std::function per argument, so neither allocates more than the
+  // tree walker
+  ASSERT_LE(immutable, tree);
+  ASSERT_LE(vm, tree);
+  ASSERT_LE(vm, immutable);
+}
+
+TEST_F(BenchmarkTest, TestFunctionCallExpressions) {
+  const string def = R"(
+    (def add3 (x y z) (+ x y z))
+    (def calls (n) (if (> n 0) (begin (add3 n 1 2) (abs (- 0 n)) (calls (- n 1))) 0))
+  )";
+  const string call = "(calls 50)";
+
+  uint64_t tree = ExpressionsPerCall("--engine=tree", def, call);
+  uint64_t immutable = ExpressionsPerCall("--engine=immutable", def, call);
+  uint64_t vm = ExpressionsPerCall("--engine=vm", def, call);
+  Report("calls-expressions", tree, immutable, vm);
+
+  // The VM passes arguments straight to the function it calls, it should
+  // never build more than the tree walkers do
+  ASSERT_LT(vm, tree);
+  ASSERT_LE(vm, immutable);
+}
+
+TEST_F(BenchmarkTest, TestArithmeticAllocations) {
+  const string def = R"(
+    (def arith (x)
+      (* (+ x 1 2 3 4 5 6 7) (- x 1 2 3) (incr x) (abs (- 0 x))))
+  )";
+  const string call = "(arith 5)";
+
+  size_t tree = AllocationsPerCall("--engine=tree", def, call);
+  size_t immutable = AllocationsPerCall("--engine=immutable", def, call);
+  size_t vm = AllocationsPerCall("--engine=vm", def, call);
+  Report("arith", tree, immutable, vm);
+
+  ASSERT_LE(immutable, tree);
+  ASSERT_LE(vm, tree);
+  ASSERT_LE(vm, immutable);
+}
+
+TEST_F(BenchmarkTest, TestBuiltinArgumentCopies) {
+  const string def = "(set nums (range 1 1000))";
+  uint64_t reversed = ExpressionsPerCall("--engine=tree", def, "(reverse nums)");
+  uint64_t pushed = ExpressionsPerCall("--engine=tree", def, "(push-back (reverse nums) 0)");
+  cout << "[ BENCH    ] expressions/call: reverse=" << reversed << " push-back=" << pushed << endl;
+
+  // The reversed list is handed to push-back as is, not copied first
+  ASSERT_LT(pushed, reversed + 100);
+}
+
+TEST_F(BenchmarkTest, TestCaughtErrorAllocations) {
+  const string def = R"(
+    (def fail-at (n)
+      (if (== n 0)
+        (error "bad input")
+        (+ 1 (fail-at (- n 1)))))
+  )";
+  const string call = "(try (fail-at 20) false)";
+
+  size_t tree = AllocationsPerCall("--engine=tree", def, call);
+  size_t immutable = AllocationsPerCall("--engine=immutable", def, call);
+  size_t vm = AllocationsPerCall("--engine=vm", def, call);
+  Report("caught-error", tree, immutable, vm);
+
+  // The stack trace of a caught error is never formatted, so its cost does
+  // not grow a string per frame
+  ASSERT_LT(tree, 200u);
+  ASSERT_LT(immutable, 200u);
+  ASSERT_LT(vm, 200u);
+}
@@ -0,0 +1,72 @@
+#include <string>
+#include <unordered_set>
+#include <functional>
+#include <mutex>
+
+#include "Atom.h"
+
+using namespace std;
+
+//=============================================================================
+
+Atom::Atom():
+  Name_ { nullptr }
+{
+  static const string *Empty = Intern("");
+  Name_ = Empty;
+}
+
+Atom::Atom(const string &name):
+  Name_ { Intern(name) }
+{
+}
+
+Atom::Atom(const char *name):
+  Name_ { Intern(name) }
+{
+}
+
+const string& Atom::Name() const {
+  return *Name_;
+}
+
+Atom::operator const string&() const {
+  return *Name_;
+}
+
+size_t Atom::Hash() const {
+  return hash<const string*>()(Name_);
+}
+
+bool Atom::empty() const {
+  return Name_->empty();
+}
+
+bool operator==(const Atom &lhs, const Atom &rhs) {
+  return lhs.Name_ == rhs.Name_;
+}
+
+bool operator!=(const Atom &lhs, const Atom &rhs) {
+  return lhs.Name_ != rhs.Name_;
+}
+
+bool operator<(const Atom &lhs, const Atom &rhs) {
+  return lhs.Name_ != rhs.Name_ && *lhs.Name_ < *rhs.Name_;
+}
+
+ostream& operator<<(ostream &out, const Atom &atom) {
+  return out << *atom.Name_;
+}
+
+// Interpreters on different threads share the table, so it is locked. Their
+// expressions aren't shared, they come from per-thread pools (see
+// ExpressionAllocator). Names are kept for the life of the process; atoms
+// are compared by address and may be held by static tables that outlive any
+// interpreter.
+const string* Atom::Intern(const string &name) {
+  // nodes of an unordered_set are never moved, so the addresses stay valid across rehashes
+  static unordered_set<string> Names;
+  static mutex NamesLock;
+  lock_guard<mutex> lock(NamesLock);
+  return &*Names.insert(name).first;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <functional>
+
+// Interned symbol name. Every distinct name is stored once in a global table,
+// so atoms compare and hash by pointer instead of by string contents.
+// Creating an atom looks its name up in the table, so names used on hot
+// paths are made into static atoms once.
+class Atom {
+  public:
+    Atom();
+    Atom(const std::string &name);
+    Atom(const char *name);
+    const std::string& Name() const;
+    operator const std::string&() const;
+    size_t Hash() const;
+    bool empty() const;
+
+    friend bool operator==(const Atom &lhs, const Atom &rhs);
+    friend bool operator!=(const Atom &lhs, const Atom &rhs);
+    friend bool operator<(const Atom &lhs, const Atom &rhs);
+    friend std::ostream& operator<<(std::ostream &out, const Atom &atom);
+
+  private:
+    const std::string *Name_;
+
+    static const std::string* Intern(const std::string &name);
+};
+
+namespace std {
+  template<>
+  struct hash<Atom> {
+    size_t operator()(const Atom &atom) const {
+      return atom.Hash();
+    }
+  };
+}
@@ -13,6 +13,24 @@ bool CommandInterface::ReadContinuedInputLine(string &input) {
   return ReadLine("... ", input);
 }
 
+// The line stays valid until the next read. By default it is read into a
+// buffer that is reused from one line to the next.
+bool CommandInterface::ReadLineInPlace(const string &prefix, const char *&line, size_t &length) {
+  if (!ReadLine(prefix, LineBuffer))
+    return false;
+  line = LineBuffer.data();
+  length = LineBuffer.size();
+  return true;
+}
+
+bool CommandInterface::ReadInputLine(const char *&line, size_t &length) {
+  return ReadLineInPlace(">>> ", line, length);
+}
+
+bool CommandInterface::ReadContinuedInputLine(const char *&line, size_t &length) {
+  return ReadLineInPlace("... ", line, length);
+}
+
 void CommandInterface::SetInteractiveMode(bool enabled) {
 }
 
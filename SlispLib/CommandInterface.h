@@ -10,8 +10,14 @@ class CommandInterface {
     virtual bool ReadLine(const std::string &prefix, std::string &input) = 0;
     virtual bool ReadInputLine(std::string &input);
     virtual bool ReadContinuedInputLine(std::string &input);
+    virtual bool ReadLineInPlace(const std::string &prefix, const char *&line, size_t &length);
+    bool ReadInputLine(const char *&line, size_t &length);
+    bool ReadContinuedInputLine(const char *&line, size_t &length);
     virtual bool WriteOutputLine(const std::string &output) = 0;
     virtual bool WriteError(const std::string &error) = 0;
     virtual void SetInteractiveMode(bool enabled);
     virtual void GetInteractiveMode(bool &enabled);
+
+  private:
+    std::string LineBuffer;
 };
\ No newline at end of file
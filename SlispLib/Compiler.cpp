@@ -0,0 +1,214 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <iostream>
+
+#include "Compiler.h"
+#include "Expression.h"
+#include "FunctionDef.h"
+
+using namespace std;
+
+//=============================================================================
+
+CallSite::CallSite(const Sexp &form):
+  Form { &form },
+  Head { 0 },
+  Args { },
+  Else { 0 },
+  End { 0 }
+{
+}
+
+//=============================================================================
+
+CodeBlock::CodeBlock(const ConstExpressionPtr &source):
+  Source { source },
+  Code { },
+  Constants { },
+  CallSites { }
+{
+}
+
+static const char* OpCodeName(OpCode op) {
+  switch (op) {
+    case OpCode::PushConst:  return "push";
+    case OpCode::LoadSymbol: return "load";
+    case OpCode::Evaluate:   return "eval";
+    case OpCode::Call:       return "call";
+    case OpCode::Intrinsic:  return "intrinsic";
+    case OpCode::Branch:     return "branch";
+    case OpCode::Jump:       return "jump";
+    case OpCode::Pop:        return "pop";
+    case OpCode::Return:     return "return";
+  }
+  return "?";
+}
+
+void CodeBlock::Disassemble(ostream &out) const {
+  for (size_t addr = 0; addr < Code.size(); ++addr) {
+    auto &instr = Code[addr];
+    out << addr << ": " << OpCodeName(instr.Op);
+    switch (instr.Op) {
+      case OpCode::PushConst:
+      case OpCode::LoadSymbol:
+      case OpCode::Evaluate:
+        out << " " << *Constants[instr.Arg];
+        break;
+      case OpCode::Call:
+      case OpCode::Intrinsic:
+      case OpCode::Branch:
+        out << " " << *CallSites[instr.Arg].Form;
+        break;
+      case OpCode::Jump:
+        out << " " << instr.Arg;
+        break;
+      default:
+        break;
+    }
+    out << endl;
+  }
+}
+
+//=============================================================================
+
+Compiler::Compiler():
+  Block { nullptr },
+  Pending { }
+{
+}
+
+CodeBlockPtr Compiler::Compile(const Expression &expr) {
+  return Compile(ConstExpressionPtr { expr.Clone() });
+}
+
+CodeBlockPtr Compiler::Compile(const ConstExpressionPtr &source) {
+  shared_ptr<CodeBlock> block { new CodeBlock { source } };
+  Block = block.get();
+  Pending.clear();
+
+  CompileBlock(*Block->Source);
+
+  // Call arguments are compiled as separate entry points after the main body,
+  // since the callee decides at runtime which of them get evaluated
+  while (!Pending.empty()) {
+    PendingBlock pending = Pending.back();
+    Pending.pop_back();
+
+    auto entry = static_cast<uint32_t>(Block->Code.size());
+    CompileBlock(*pending.Expr);
+
+    auto &site = Block->CallSites[pending.Site];
+    if (pending.ArgIdx == HEAD_BLOCK)
+      site.Head = entry;
+    else
+      site.Args[pending.ArgIdx] = entry;
+  }
+
+  Block = nullptr;
+  return block;
+}
+
+uint32_t Compiler::Emit(OpCode op, uint32_t arg) {
+  Block->Code.push_back(Instruction { op, arg });
+  return static_cast<uint32_t>(Block->Code.size() - 1);
+}
+
+uint32_t Compiler::AddConstant(ExpressionPtr &&value) {
+  Block->Constants.push_back(move(value));
+  return static_cast<uint32_t>(Block->Constants.size() - 1);
+}
+
+uint32_t Compiler::AddCallSite(const Sexp &form) {
+  auto siteIdx = static_cast<uint32_t>(Block->CallSites.size());
+  Block->CallSites.emplace_back(form);
+  return siteIdx;
+}
+
+void Compiler::CompileBlock(const Expression &expr) {
+  CompileExpr(expr);
+  Emit(OpCode::Return);
+}
+
+void Compiler::CompileExpr(const Expression &expr) {
+  auto &type = expr.Type();
+  if (&type == &Symbol::TypeInstance)
+    Emit(OpCode::LoadSymbol, AddConstant(expr.Clone()));
+  else if (&type == &Sexp::TypeInstance) {
+    auto &sexp = static_cast<const Sexp&>(expr);
+    if (sexp.Args.empty())
+      Emit(OpCode::Evaluate, AddConstant(expr.Clone()));
+    else if (!CompileIntrinsic(sexp))
+      CompileCall(sexp);
+  }
+  else if (TypeHelper::IsA<Literal>(type))
+    Emit(OpCode::PushConst, AddConstant(expr.Clone()));
+  else
+    Emit(OpCode::Evaluate, AddConstant(expr.Clone()));
+}
+
+void Compiler::CompileCall(const Sexp &sexp) {
+  auto siteIdx = AddCallSite(sexp);
+  auto &site = Block->CallSites[siteIdx];
+  auto formArg = begin(sexp.Args);
+  Pending.push_back(PendingBlock { formArg->get(), siteIdx, HEAD_BLOCK });
+  for (++formArg; formArg != end(sexp.Args); ++formArg) {
+    Pending.push_back(PendingBlock { formArg->get(), siteIdx, site.Args.size() });
+    site.Args.push_back(0);
+  }
+  Emit(OpCode::Call, siteIdx);
+}
+
+static const Atom IfSymbol { "if" };
+static const Atom BeginSymbol { "begin" };
+
+bool Compiler::CompileIntrinsic(const Sexp &sexp) {
+  auto *head = sexp.Args.front();
+  if (&head->Type() != &Symbol::TypeInstance)
+    return false;
+
+  auto &name = static_cast<const Symbol&>(*head).Value;
+  size_t nArgs = sexp.Args.size() - 1;
+  if (name == IfSymbol && (nArgs == 2 || nArgs == 3))
+    CompileIf(sexp);
+  else if (name == BeginSymbol && nArgs >= 1)
+    CompileBegin(sexp);
+  else
+    return false;
+  return true;
+}
+
+void Compiler::CompileIf(const Sexp &sexp) {
+  auto siteIdx = AddCallSite(sexp);
+  Emit(OpCode::Intrinsic, siteIdx);
+
+  auto arg = next(begin(sexp.Args));
+  CompileExpr(**arg++);
+  Emit(OpCode::Branch, siteIdx);
+  CompileExpr(**arg++);
+  auto jumpToEnd = Emit(OpCode::Jump);
+
+  Block->CallSites[siteIdx].Else = static_cast<uint32_t>(Block->Code.size());
+  if (arg != end(sexp.Args))
+    CompileExpr(**arg);
+  else
+    Emit(OpCode::PushConst, AddConstant(List::GetNil(sexp.GetSourceContext())));
+
+  auto endAddr = static_cast<uint32_t>(Block->Code.size());
+  Block->Code[jumpToEnd].Arg = endAddr;
+  Block->CallSites[siteIdx].End = endAddr;
+}
+
+void Compiler::CompileBegin(const Sexp &sexp) {
+  auto siteIdx = AddCallSite(sexp);
+  Emit(OpCode::Intrinsic, siteIdx);
+
+  auto last = prev(end(sexp.Args));
+  for (auto arg = next(begin(sexp.Args)); arg != end(sexp.Args); ++arg) {
+    CompileExpr(**arg);
+    if (arg != last)
+      Emit(OpCode::Pop);
+  }
+
+  Block->CallSites[siteIdx].End = static_cast<uint32_t>(Block->Code.size());
+}
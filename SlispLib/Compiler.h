@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cinttypes>
+
+#include "Expression.h"
+
+enum class OpCode: uint8_t {
+  PushConst,   // push a copy of Constants[Arg]
+  LoadSymbol,  // push the value bound to the symbol Constants[Arg]
+  Evaluate,    // push the tree-walked value of Constants[Arg]
+  Call,        // push the result of applying CallSites[Arg]
+  Intrinsic,   // continue inline if CallSites[Arg] still names the builtin, else tree-walk it and jump to End
+  Branch,      // pop a bool, jump to CallSites[Arg].Else if false
+  Jump,        // jump to Arg
+  Pop,         // discard the top of the stack
+  Return       // pop the result of the block
+};
+
+struct Instruction {
+  OpCode   Op;
+  uint32_t Arg;
+};
+
+struct CallSite {
+  const Sexp            *Form;
+  uint32_t              Head;
+  std::vector<uint32_t> Args;
+  uint32_t              Else;
+  uint32_t              End;
+
+  explicit CallSite(const Sexp &form);
+};
+
+class CodeBlock {
+  public:
+    static const uint32_t MAIN_ENTRY = 0;
+
+    ConstExpressionPtr         Source;
+    std::vector<Instruction>   Code;
+    std::vector<ExpressionPtr> Constants;
+    std::vector<CallSite>      CallSites;
+
+    explicit CodeBlock(const ConstExpressionPtr &source);
+    void Disassemble(std::ostream &out) const;
+};
+using CodeBlockPtr = std::shared_ptr<const CodeBlock>;
+
+class Compiler {
+  public:
+    explicit Compiler();
+    CodeBlockPtr Compile(const Expression &expr);
+    CodeBlockPtr Compile(const ConstExpressionPtr &source);
+
+  private:
+    struct PendingBlock {
+      const Expression *Expr;
+      uint32_t         Site;
+      size_t           ArgIdx;
+    };
+    static const size_t HEAD_BLOCK = static_cast<size_t>(-1);
+
+    CodeBlock                 *Block;
+    std::vector<PendingBlock> Pending;
+
+    uint32_t Emit(OpCode op, uint32_t arg = 0);
+    uint32_t AddConstant(ExpressionPtr &&value);
+    uint32_t AddCallSite(const Sexp &form);
+    void CompileBlock(const Expression &expr);
+    void CompileExpr(const Expression &expr);
+    void CompileCall(const Sexp &sexp);
+    bool CompileIntrinsic(const Sexp &sexp);
+    void CompileIf(const Sexp &sexp);
+    void CompileBegin(const Sexp &sexp);
+};
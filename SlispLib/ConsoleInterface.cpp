@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstring>
 
 #include "ConsoleInterface.h"
 
@@ -21,6 +22,9 @@ ConsoleInterface::ConsoleInterface(istream &in, ostream &out)
 void ConsoleInterface::Init() {
   In = nullptr;
   Out = nullptr;
+  Buffer = nullptr;
+  BufferLength = 0;
+  BufferPos = 0;
   HasMore_ = true;
   InteractiveMode_ = true;
 }
@@ -34,6 +38,14 @@ bool ConsoleInterface::HasMore() const {
 }
 
 bool ConsoleInterface::ReadLine(const string &prefix, string &input) {
+  if (Buffer) {
+    const char *line;
+    size_t length;
+    ReadLineInPlace(prefix, line, length);
+    input.assign(line, length);
+    return true;
+  }
+
   if (InteractiveMode_)
     *Out << prefix;
   getline(*In, input);
@@ -43,6 +55,34 @@ bool ConsoleInterface::ReadLine(const string &prefix, string &input) {
   return true;
 }
 
+bool ConsoleInterface::ReadLineInPlace(const string &prefix, const char *&line, size_t &length) {
+  if (!Buffer)
+    return CommandInterface::ReadLineInPlace(prefix, line, length);
+
+  if (InteractiveMode_)
+    *Out << prefix;
+  ReadBufferLine(line, length);
+  return true;
+}
+
+// Splits the buffer into lines like getline splits a stream, so a final
+// newline is followed by an empty last line
+void ConsoleInterface::ReadBufferLine(const char *&line, size_t &length) {
+  line = Buffer + BufferPos;
+  size_t remaining = BufferLength - BufferPos;
+  auto *newline = remaining ? static_cast<const char*>(memchr(line, '\n', remaining)) : nullptr;
+  if (newline) {
+    length = newline - line;
+    BufferPos += length + 1;
+    HasMore_ = true;
+  }
+  else {
+    length = remaining;
+    BufferPos = BufferLength;
+    HasMore_ = false;
+  }
+}
+
 bool ConsoleInterface::WriteOutputLine(const string &output) {
   *Out << output;
   return true;
@@ -67,6 +107,30 @@ void ConsoleInterface::SetInput() {
 
 void ConsoleInterface::SetInput(istream &in) {
   In = &in;
+  Buffer = nullptr;
+  BufferLength = 0;
+  BufferPos = 0;
+  Reset();
+}
+
+// Lines are read in place, so the buffer has to outlive the lines read from
+// it. The stream is kept for when the input is set back to it.
+void ConsoleInterface::SetInput(const char *buffer, size_t length) {
+  Buffer = buffer;
+  BufferLength = length;
+  BufferPos = 0;
+  Reset();
+}
+
+ConsoleInterface::InputSource ConsoleInterface::GetInputSource() const {
+  return InputSource { In, Buffer, BufferLength, BufferPos };
+}
+
+void ConsoleInterface::SetInputSource(const InputSource &source) {
+  In = source.Stream;
+  Buffer = source.Buffer;
+  BufferLength = source.Length;
+  BufferPos = source.Pos;
   Reset();
 }
 
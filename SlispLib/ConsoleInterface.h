@@ -6,6 +6,14 @@
 
 class ConsoleInterface: public CommandInterface {
   public:
+    // Where lines are read from: the stream, or the buffer when there is one
+    struct InputSource {
+      std::istream *Stream;
+      const char   *Buffer;
+      size_t       Length;
+      size_t       Pos;
+    };
+
     explicit ConsoleInterface();
     explicit ConsoleInterface(std::istream &in, std::ostream &out);
     ConsoleInterface(const ConsoleInterface&)             = delete;
@@ -17,6 +25,7 @@ class ConsoleInterface: public CommandInterface {
     virtual void Reset() override;
 
     virtual bool ReadLine(const std::string &prefix, std::string &input) override;
+    virtual bool ReadLineInPlace(const std::string &prefix, const char *&line, size_t &length) override;
     virtual bool WriteOutputLine(const std::string &output) override;
     virtual bool WriteError(const std::string &error) override;
     virtual void SetInteractiveMode(bool enabled) override;
@@ -27,14 +36,21 @@ class ConsoleInterface: public CommandInterface {
 
     void SetInput();
     void SetInput(std::istream &in);
+    void SetInput(const char *buffer, size_t length);
+    InputSource GetInputSource() const;
+    void SetInputSource(const InputSource &source);
     void SetOutput();
     void SetOutput(std::ostream &out);
 
   private:
     std::istream *In;
     std::ostream *Out;
+    const char   *Buffer;
+    size_t       BufferLength;
+    size_t       BufferPos;
     bool HasMore_;
     bool InteractiveMode_;
 
     void Init();
+    void ReadBufferLine(const char *&line, size_t &length);
 };
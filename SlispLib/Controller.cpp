@@ -1,9 +1,11 @@
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <algorithm>
 #include "Controller.h"
 #include "Utils.h"
 #include "Expression.h"
+#include "ExpressionAllocator.h"
 
 using namespace std;
 
@@ -11,7 +13,8 @@ using namespace std;
 
 ControllerArgs::ControllerArgs(int argc, const char * const *argv):
   ScriptArgs(),
-  Flags(0)
+  Flags(0),
+  Engine(EngineTypes::TreeWalker)
 {
   ParseArgs(argc, argv);
 }
@@ -21,7 +24,12 @@ void ControllerArgs::ParseArgs(int argc, const char * const *argv) {
     int argIdx = 0;
     ProgramName.assign(argv[argIdx++]);
 
-    if (argc == 1)
+    while (argIdx < argc && ParseOptionArg(argv[argIdx]))
+      ++argIdx;
+    if (Flags & OptionFlags::Error)
+      return;
+
+    if (argIdx == argc)
       Flags |= OptionFlags::REPL;
     else {
       string currArg = argv[argIdx++];
@@ -34,7 +42,7 @@ void ControllerArgs::ParseArgs(int argc, const char * const *argv) {
       }
       else if (currArg == "-i") {
         Flags |= OptionFlags::REPL;
-        if (argc > 2)
+        if (argIdx < argc)
           currArg = argv[argIdx++];
       }
       else if (currArg[0] == '-') {
@@ -56,6 +64,62 @@ void ControllerArgs::ParseArgs(int argc, const char * const *argv) {
     Flags |= OptionFlags::REPL;
 }
 
+bool ControllerArgs::ParseOptionArg(const string &arg) {
+  if (arg == "--alloc-stats") {
+    Flags |= OptionFlags::AllocStats;
+    return true;
+  }
+  else if (ParseModuleCacheArg(arg) || ParseProfileArg(arg))
+    return true;
+  else
+    return ParseEngineArg(arg);
+}
+
+bool ControllerArgs::ParseModuleCacheArg(const string &arg) {
+  const string prefix = "--module-cache=";
+  if (arg.compare(0, prefix.length(), prefix) != 0)
+    return false;
+
+  ModuleCacheDir = arg.substr(prefix.length());
+  if (ModuleCacheDir.empty()) {
+    Flags |= OptionFlags::Error;
+    return false;
+  }
+  return true;
+}
+
+bool ControllerArgs::ParseProfileArg(const string &arg) {
+  const string prefix = "--profile=";
+  if (arg.compare(0, prefix.length(), prefix) != 0)
+    return false;
+
+  ProfilePath = arg.substr(prefix.length());
+  if (ProfilePath.empty()) {
+    Flags |= OptionFlags::Error;
+    return false;
+  }
+  return true;
+}
+
+bool ControllerArgs::ParseEngineArg(const string &arg) {
+  const string prefix = "--engine=";
+  if (arg.compare(0, prefix.length(), prefix) != 0)
+    return false;
+
+  string engine = arg.substr(prefix.length());
+  if (engine == "tree")
+    Engine = EngineTypes::TreeWalker;
+  else if (engine == "immutable")
+    Engine = EngineTypes::ImmutableTreeWalker;
+  else if (engine == "vm")
+    Engine = EngineTypes::VM;
+  else {
+    Flags |= OptionFlags::Error;
+    return false;
+  }
+  return true;
+}
+
 //=============================================================================
 
 OutputManager::OutputManager(Interpreter &interpreter, Library &lib, ConsoleInterface &cmdInterface):
@@ -106,7 +170,7 @@ struct ImportModuleFunctor {
     ExpressionPtr firstArg = move(ctx.Args.front());
     ctx.Args.pop_front();
     if (auto *sym = ctx.GetRequiredValue<Symbol>(firstArg)) {
-      string fileName = sym->Value + ".slisp";
+      string fileName = sym->Value.Name() + ".slisp";
       bool result = Controller_.RunFile(fileName);
       if (result)
         return ctx.ReturnNil();
@@ -125,6 +189,15 @@ usage: slisp [option] [code | file] [arg] ...
 Options and arguments:
 -h   : help
 -i   : run REPL after running code or file
+--engine=tree|immutable|vm : evaluate with the tree walker (default), the
+                             tree walker without per-call body copies, or
+                             the bytecode VM
+--alloc-stats : print the objects and bytes allocated by each evaluation
+--module-cache=dir : keep parsed scripts and imports in dir, and reuse them
+                     while their source is unchanged
+--profile=file : time every function call, write the call stacks to file in
+                 collapsed stack format (for flame graphs) and print a
+                 summary per function
 file : program read from script file (e.g. script.slisp)
 code : program passed in as string
 )";
@@ -137,10 +210,32 @@ Controller::Controller(int argc, const char * const * argv):
   Parser_(CmdInterface, Tokenizer_, Settings),
   Lib(),
   Args(argc, argv),
-  OutManager(Interpreter_, Lib, CmdInterface)
+  ModuleCache_(Args.ModuleCacheDir),
+  OutManager(Interpreter_, Lib, CmdInterface),
+  OutFile(),
+  Profiler_()
 {
   SetupEnvironment();
-  SetupModules();
+  SetupModules(nullptr);
+}
+
+// Starts from the environment of another controller, with whatever it has
+// imported, instead of loading the libraries again
+Controller::Controller(int argc, const char * const * argv, const InterpreterSnapshot &snapshot):
+  CmdInterface(),
+  Interpreter_(CmdInterface),
+  Settings(Interpreter_.GetSettings()),
+  Tokenizer_(),
+  Parser_(CmdInterface, Tokenizer_, Settings),
+  Lib(),
+  Args(argc, argv),
+  ModuleCache_(Args.ModuleCacheDir),
+  OutManager(Interpreter_, Lib, CmdInterface),
+  OutFile(),
+  Profiler_()
+{
+  SetupEnvironment();
+  SetupModules(&snapshot);
 }
 
 Controller::Controller():
@@ -166,6 +261,9 @@ void Controller::Run() {
 
   if (Args.Flags & ControllerArgs::REPL)
     StartInteractiveREPL();
+
+  if (Profiler_)
+    WriteProfile();
 }
 
 void Controller::Run(istream &in) {
@@ -175,36 +273,112 @@ void Controller::Run(istream &in) {
 
 void Controller::Run(const string &code) {
   OutputSettingsScope scope(OutManager, OutputManager::ShowResults);
-  istream& oldIn = CmdInterface.GetInput();
-  stringstream in;
-  in << code;
-  CmdInterface.SetInput(in);
+  auto oldIn = CmdInterface.GetInputSource();
+  CmdInterface.SetInput(code.data(), code.size());
   REPL();
-  CmdInterface.SetInput(oldIn);
+  CmdInterface.SetInputSource(oldIn);
+}
+
+// Reads the whole file into source, which the parser then tokenizes in place
+static bool ReadSource(const string &path, string &source) {
+  ifstream in(path, ios_base::in | ios_base::binary);
+  if (!in.is_open())
+    return false;
+  in.seekg(0, ios_base::end);
+  auto size = in.tellg();
+  if (size < 0)
+    return false;
+  source.resize(static_cast<size_t>(size));
+  in.seekg(0, ios_base::beg);
+  in.read(&source[0], size);
+  source.resize(static_cast<size_t>(in.gcount()));
+  return true;
 }
 
 bool Controller::RunFile(const string &inPath) {
   if (auto *mod = Interpreter_.CreateModule(inPath, inPath)) {
-    if (mod->LoadCount > 1)
+    if (Interpreter_.GetLoadCount(inPath) > 1)
       return true; // already loaded
 
     OutputSettingsScope scope(OutManager, 0);
-    istream& oldIn = CmdInterface.GetInput();
+    auto oldIn = CmdInterface.GetInputSource();
     SourceContext oldSourceContext(Parser_.GetSourceContext());
     Parser_.SetSourceContext(SourceContext(mod, 0));
-    fstream in;
-    in.open(inPath, ios_base::in);
-    if (in.is_open()) {
-      CmdInterface.SetInput(in);
+    bool result = false;
+    if (ModuleCache_.Enabled())
+      result = RunCached(inPath, mod);
+    else {
+      string source;
+      if (ReadSource(inPath, source)) {
+        CmdInterface.SetInput(source.data(), source.size());
+        REPL();
+        result = true;
+      }
+    }
+    CmdInterface.SetInputSource(oldIn);
+    Parser_.SetSourceContext(oldSourceContext);
+    return result;
+  }
+  return false;
+}
 
-      REPL();
-      CmdInterface.SetInput(oldIn);
+// Runs the forms saved for this source if they were parsed under the same
+// infix settings, otherwise parses it and saves the forms for next time
+bool Controller::RunCached(const string &inPath, ModuleInfo *mod) {
+  string source;
+  if (!ReadSource(inPath, source))
+    return false;
+  string cachePath = ModuleCache_.GetPath(source);
+
+  ModuleCacheReader reader;
+  if (reader.Open(cachePath, source)) {
+    stringstream noInput;
+    CmdInterface.SetInput(noInput);
+    CachedForm form;
+    while (!reader.AtEnd() && !Interpreter_.StopRequested()) {
+      if (!reader.Next(mod, form) || !Parser_.QueriesMatch(form.Queries))
+        return RunSource(source, mod, form.FirstLine);
+      EvaluateSingle(form.Expr);
+    }
+    return true;
+  }
 
-      Parser_.SetSourceContext(oldSourceContext);
-      return true;
+  ModuleCacheWriter writer;
+  vector<InfixQuery> queries;
+  CmdInterface.SetInput(source.data(), source.size());
+  while (!Interpreter_.StopRequested()) {
+    queries.clear();
+    Parser_.SetQueryLog(&queries);
+    size_t firstLine = Parser_.GetSourceContext().LineNum + 1;
+    ExpressionPtr root;
+    bool parsed = ParseSingle(root);
+    Parser_.SetQueryLog(nullptr);
+    if (parsed) {
+      writer.Add(firstLine, queries, *root);
+      EvaluateSingle(root);
     }
+    else
+      writer.Invalidate();
   }
-  return false;
+
+  // Scripts that stop early or read their own source as input are not saved
+  size_t nLines = count(begin(source), end(source), '\n') + 1;
+  if (!CmdInterface.HasMore() && Parser_.GetSourceContext().LineNum == nLines)
+    writer.Save(cachePath, source);
+  return true;
+}
+
+// Parses and runs source from firstLine on
+bool Controller::RunSource(const string &source, ModuleInfo *mod, size_t firstLine) {
+  size_t pos = 0;
+  for (size_t lineNum = 1; lineNum < firstLine && pos < source.size(); ++lineNum) {
+    size_t newline = source.find('\n', pos);
+    pos = newline == string::npos ? source.size() : newline + 1;
+  }
+  CmdInterface.SetInput(source.data() + pos, source.size() - pos);
+  Parser_.SetSourceContext(SourceContext(mod, firstLine - 1));
+  REPL();
+  return true;
 }
 
 void Controller::SetOutput() {
@@ -231,7 +405,17 @@ int Controller::ExitCode() const {
   return Interpreter_.GetExitCode();
 }
 
+InterpreterSnapshot Controller::TakeSnapshot() {
+  return Interpreter_.TakeSnapshot();
+}
+
 void Controller::SetupEnvironment() {
+  Settings.SetEngine(Args.Engine);
+  if (!Args.ProfilePath.empty()) {
+    Profiler_.reset(new Profiler());
+    Interpreter_.SetProfiler(Profiler_.get());
+  }
+
   auto &env = Interpreter_.GetEnvironment();
   env.Program = Args.ProgramName;
   if (Args.Flags & ControllerArgs::RunFile)
@@ -239,8 +423,13 @@ void Controller::SetupEnvironment() {
   env.Args = Args.ScriptArgs;
 }
 
-void Controller::SetupModules() {
-  if (!Lib.Load(Interpreter_))
+void Controller::SetupModules(const InterpreterSnapshot *snapshot) {
+  if (snapshot) {
+    Interpreter_.Restore(*snapshot);
+    if (!Lib.Attach(Interpreter_))
+      throw runtime_error("Failed to attach StdLib module");
+  }
+  else if (!Lib.Load(Interpreter_))
     throw runtime_error("Failed to load StdLib module");
 
   auto *thisMod = Interpreter_.CreateModule("Controller", "Controller");
@@ -261,6 +450,19 @@ void Controller::SetupModules() {
   OutManager.SetFlags(OutputManager::ShowPrompt | OutputManager::ShowResults);
 }
 
+void Controller::WriteProfile() {
+  fstream out;
+  out.open(Args.ProfilePath, ios_base::out);
+  if (out.is_open())
+    Profiler_->WriteCollapsedStacks(out);
+  else
+    CmdInterface.WriteError("Could not write profile: " + Args.ProfilePath);
+
+  stringstream summary;
+  Profiler_->WriteSummary(summary);
+  CmdInterface.WriteOutputLine(summary.str());
+}
+
 void Controller::DisplayHelp() {
   CmdInterface.WriteOutputLine(HelpText);
 }
@@ -279,20 +481,18 @@ void Controller::REPL() {
 }
 
 void Controller::RunSingle() {
+  ExpressionPtr root;
+  if (ParseSingle(root))
+    EvaluateSingle(root);
+}
+
+bool Controller::ParseSingle(ExpressionPtr &root) {
   stringstream ss;
   if (Parser_.Parse()) {
     auto exprTree = Parser_.ExpressionTree();
     if (exprTree) {
-      ExpressionPtr root { exprTree.release() };
-      if (!Interpreter_.Evaluate(root)) {
-        auto errors = Interpreter_.GetErrors();
-        for (auto &error : errors) {
-          ss << error.Where << ": " << error.What << endl;
-          for (auto &errFrame : Interpreter_.GetErrorStackTrace())
-            ss << errFrame << endl;
-          break;
-        }
-      }
+      root.reset(exprTree.release());
+      return true;
     }
     else
       ss << "Parse Error: No Expression Tree" << endl;
@@ -300,7 +500,27 @@ void Controller::RunSingle() {
   else
     ss << "Parse Error: " << Parser_.Error() << endl;
 
-  if (!ss.str().empty()) {
-    CmdInterface.WriteError(ss.str());
+  CmdInterface.WriteError(ss.str());
+  return false;
+}
+
+void Controller::EvaluateSingle(ExpressionPtr &root) {
+  AllocationStats before = ExpressionAllocator::GetStats();
+  bool evaluated = Interpreter_.Evaluate(root);
+  if (Args.Flags & ControllerArgs::AllocStats) {
+    AllocationStats allocated = ExpressionAllocator::GetStats() - before;
+    CmdInterface.WriteOutputLine("Allocated " + to_string(allocated.Objects) + " objects, " + to_string(allocated.Bytes) + " bytes");
+  }
+  if (!evaluated) {
+    stringstream ss;
+    auto &errors = Interpreter_.GetErrors();
+    for (auto &error : errors) {
+      ss << error.Where << ": " << error.What << endl;
+      for (auto &errFrame : Interpreter_.GetErrorStackTrace())
+        ss << errFrame << endl;
+      break;
+    }
+    if (!ss.str().empty())
+      CmdInterface.WriteError(ss.str());
   }
 }
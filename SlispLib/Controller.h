@@ -9,6 +9,7 @@
 #include "Tokenizer.h"
 #include "Parser.h"
 #include "FunctionDef.h"
+#include "ModuleCache.h"
 #include "StdLib/StdLib.h"
 
 class ControllerArgs {
@@ -19,17 +20,25 @@ public:
     RunCode = 1 << 3,
     RunFile = 1 << 4,
     REPL    = 1 << 5,
+    AllocStats = 1 << 6,
   };
 
   std::vector<std::string> ScriptArgs;
   std::string ProgramName;
   std::string Run;
+  std::string ModuleCacheDir;
+  std::string ProfilePath;
   int Flags;
+  EngineTypes Engine;
 
   explicit ControllerArgs(int argc, const char * const *argv);
 
 private:
   void ParseArgs(int argc, const char * const * argv);
+  bool ParseOptionArg(const std::string &arg);
+  bool ParseEngineArg(const std::string &arg);
+  bool ParseModuleCacheArg(const std::string &arg);
+  bool ParseProfileArg(const std::string &arg);
 };
 
 class OutputManager {
@@ -64,6 +73,7 @@ class Controller {
   public:
     explicit Controller();
     explicit Controller(int argc, const char * const *argv);
+    explicit Controller(int argc, const char * const *argv, const InterpreterSnapshot &snapshot);
     void Run();
     void Run(std::istream &in);
     void Run(const std::string &code);
@@ -74,6 +84,7 @@ class Controller {
     bool SetOutputFile(const std::string &outPath);
 
     int ExitCode() const;
+    InterpreterSnapshot TakeSnapshot();
   private:
     static const std::string HelpText;
     ConsoleInterface CmdInterface;
@@ -83,15 +94,22 @@ class Controller {
     Parser Parser_;
     StdLib Lib;
     ControllerArgs Args;
+    ModuleCache ModuleCache_;
     OutputManager OutManager;
     std::unique_ptr<std::fstream> OutFile;
+    std::unique_ptr<Profiler> Profiler_;
 
     void SetupEnvironment();
-    void SetupModules();
+    void SetupModules(const InterpreterSnapshot *snapshot);
     void DisplayHelp();
     void StartInteractiveREPL();
     void REPL();
     void RunSingle();
+    bool ParseSingle(ExpressionPtr &root);
+    void EvaluateSingle(ExpressionPtr &root);
+    bool RunSource(const std::string &source, ModuleInfo *mod, size_t firstLine);
+    bool RunCached(const std::string &inPath, ModuleInfo *mod);
+    void WriteProfile();
 
   friend class ControllerTest;
 };
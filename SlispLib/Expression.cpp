@@ -4,8 +4,11 @@
 #include <sstream>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <new>
 
 #include "Expression.h"
+#include "ExpressionAllocator.h"
 
 using namespace std;
 
@@ -13,8 +16,7 @@ using namespace std;
 
 ModuleInfo::ModuleInfo(const std::string &name, const std::string &filePath):
   Name(name),
-  FilePath(filePath),
-  LoadCount(0)
+  FilePath(filePath)
 {
 }
 
@@ -38,9 +40,10 @@ bool SourceContext::empty() const {
 
 //=============================================================================
 
-TypeInfo::TypeInfo(const string &typeName, const ExpressionNewFn newFn):
+TypeInfo::TypeInfo(const string &typeName, const ExpressionNewFn newFn, TypeTag tag):
   TypeName { typeName },
-  NewFn { newFn }
+  NewFn { newFn },
+  Tag_ { tag }
 {
 }
 
@@ -67,8 +70,12 @@ Expression::Expression(const SourceContext &sourceContext, const TypeInfo& typeI
 Expression::~Expression() {
 }
 
-const TypeInfo& Expression::Type() const {
-  return Type_;
+void* Expression::operator new(size_t size) {
+  return ExpressionAllocator::Allocate(size);
+}
+
+void Expression::operator delete(void *ptr, size_t size) {
+  ExpressionAllocator::Free(ptr, size);
 }
 
 ExpressionPtr Expression::New(const SourceContext &sourceContext) const {
@@ -118,6 +125,10 @@ const SourceContext& Expression::GetSourceContext() const {
 IIterator::~IIterator() {
 }
 
+bool IIterator::Failed() const {
+  return false;
+}
+
 //=============================================================================
 
 const TypeInfo Void::TypeInstance { "void", TypeInfo::NewUndefined };
@@ -133,7 +144,7 @@ Literal::Literal(const SourceContext &sourceContext, const TypeInfo& typeInfo):
 
 //=============================================================================
 
-const TypeInfo Bool::TypeInstance("bool", Bool::NewInstance);
+const TypeInfo Bool::TypeInstance("bool", Bool::NewInstance, TypeTag::Bool);
 const Bool Bool::Null(NullSourceContext, false);
 
 Bool::Bool(const SourceContext &sourceContext):
@@ -194,7 +205,7 @@ ExpressionPtr Bool::NewInstance(const SourceContext &sourceContext) {
 
 //=============================================================================
 
-const TypeInfo Int::TypeInstance("int", Int::NewInstance);
+const TypeInfo Int::TypeInstance("int", Int::NewInstance, TypeTag::Int);
 const Int Int::Null(NullSourceContext, 0);
 
 Int::Int(const SourceContext &sourceContext):
@@ -252,7 +263,7 @@ ExpressionPtr Int::NewInstance(const SourceContext &sourceContext) {
 
 //=============================================================================
 
-const TypeInfo Float::TypeInstance("float", Float::NewInstance);
+const TypeInfo Float::TypeInstance("float", Float::NewInstance, TypeTag::Float);
 
 Float::Float(const SourceContext &sourceContext):
   Float { sourceContext, 0 }
@@ -310,7 +321,7 @@ ExpressionPtr Float::NewInstance(const SourceContext &sourceContext) {
 
 //=============================================================================
 
-const TypeInfo Str::TypeInstance("str", Str::NewInstance);
+const TypeInfo Str::TypeInstance("str", Str::NewInstance, TypeTag::Str);
 const Str Str::Null(NullSourceContext, "");
 
 Str::Str(const SourceContext &sourceContext):
@@ -398,7 +409,7 @@ int64_t StrIterator::GetLength() {
 
 //=============================================================================
 
-const TypeInfo Quote::TypeInstance("quote", Quote::NewInstance);
+const TypeInfo Quote::TypeInstance("quote", Quote::NewInstance, TypeTag::Quote);
 const Quote Quote::Null(NullSourceContext, ExpressionPtr {});
 
 Quote::Quote(const SourceContext &sourceContext, ExpressionPtr &&expr):
@@ -446,12 +457,14 @@ ExpressionPtr Quote::NewInstance(const SourceContext &sourceContext) {
 
 //=============================================================================
 
-const TypeInfo Symbol::TypeInstance("symbol", TypeInfo::NewUndefined);
+const TypeInfo Symbol::TypeInstance("symbol", TypeInfo::NewUndefined, TypeTag::Symbol);
 const Symbol Symbol::Null(NullSourceContext, "");
+const size_t Symbol::NO_SLOT;
 
-Symbol::Symbol(const SourceContext &sourceContext, const string &value):
+Symbol::Symbol(const SourceContext &sourceContext, const Atom &value):
   Expression { sourceContext, TypeInstance },
-  Value { value }
+  Value { value },
+  Slot { NO_SLOT }
 {
 }
 
@@ -487,6 +500,7 @@ Symbol& Symbol::operator=(Symbol rhs) {
 
 void Symbol::Swap(Symbol &rhs) {
   Value = rhs.Value;
+  Slot = rhs.Slot;
 }
 
 void Symbol::Display(ostream &out) const {
@@ -495,6 +509,224 @@ void Symbol::Display(ostream &out) const {
 
 //=============================================================================
 
+ArgList::ArgList():
+  Inline { },
+  Heap { },
+  Storage { Inline },
+  Capacity { INLINE_CAPACITY },
+  Head { 0 },
+  Count { 0 },
+  Pins { 0 }
+{
+}
+
+ArgList::ArgList(ArgList &&rhs):
+  ArgList()
+{
+  *this = move(rhs);
+}
+
+ArgList::~ArgList() {
+  Release();
+}
+
+ArgList& ArgList::operator=(ArgList &&rhs) {
+  if (this != &rhs) {
+    clear();
+    if (rhs.Heap) {
+      Release();
+      Heap = rhs.Heap;
+      Storage = rhs.Storage;
+      Capacity = rhs.Capacity;
+      Head = rhs.Head;
+      rhs.Heap = nullptr;
+    }
+    else {
+      Release();
+      Storage = Inline;
+      Capacity = INLINE_CAPACITY;
+      Head = 0;
+      for (size_t i = 0; i < rhs.Count; ++i)
+        Inline[i] = move(rhs.Storage[rhs.Head + i]);
+    }
+    Count = rhs.Count;
+    Pins = rhs.Pins;
+
+    rhs.Storage = rhs.Inline;
+    rhs.Capacity = INLINE_CAPACITY;
+    rhs.Head = 0;
+    rhs.Count = 0;
+    rhs.Pins = 0;
+  }
+  return *this;
+}
+
+void ArgList::push_back(ExpressionPtr &&value) {
+  Unshare();
+  if (Head + Count == Capacity)
+    Reserve(0, 1);
+  Storage[Head + Count] = move(value);
+  ++Count;
+}
+
+void ArgList::push_front(ExpressionPtr &&value) {
+  Unshare();
+  if (Head == 0)
+    Reserve(1, 0);
+  --Head;
+  Storage[Head] = move(value);
+  ++Count;
+}
+
+// A shared list only narrows its view, the element stays with the other owners
+void ArgList::pop_back() {
+  if (!IsShared())
+    Storage[Head + Count - 1].reset();
+  --Count;
+  if (Count == 0)
+    Head = 0;
+}
+
+void ArgList::pop_front() {
+  if (!IsShared())
+    Storage[Head].reset();
+  ++Head;
+  --Count;
+  if (Count == 0)
+    Head = 0;
+}
+
+ArgList::iterator ArgList::insert(const_iterator pos, ExpressionPtr &&value) {
+  size_t idx = pos - begin();
+  push_back(move(value));
+  rotate(begin() + idx, end() - 1, end());
+  return begin() + idx;
+}
+
+ArgList::iterator ArgList::erase(const_iterator pos) {
+  return erase(pos, pos + 1);
+}
+
+ArgList::iterator ArgList::erase(const_iterator first, const_iterator last) {
+  size_t idx = first - begin();
+  size_t nErased = last - first;
+  move(begin() + idx + nErased, end(), begin() + idx);
+  for (size_t i = 0; i < nErased; ++i)
+    pop_back();
+  return begin() + idx;
+}
+
+void ArgList::clear() {
+  if (IsShared()) {
+    Release();
+    Storage = Inline;
+    Capacity = INLINE_CAPACITY;
+  }
+  else {
+    for (auto &arg : *this)
+      arg.reset();
+  }
+  Head = 0;
+  Count = 0;
+}
+
+// Appends a copy of each element of src. An empty list takes a share of
+// src's heap storage instead, unless src has handed out references into it.
+void ArgList::CopyFrom(const ArgList &src) {
+  if (empty() && src.Heap && !src.Pins) {
+    Release();
+    Heap = src.Heap;
+    ++Heap->Refs;
+    Storage = src.Storage;
+    Capacity = src.Capacity;
+    Head = src.Head;
+    Count = src.Count;
+  }
+  else {
+    for (auto &arg : src) {
+      if (auto ref = dynamic_cast<Ref*>(arg.get()))
+        push_back(ref->NewRef());
+      else
+        push_back(arg->Clone());
+    }
+  }
+}
+
+// Used by iterators that hand out references to the elements, for as long as
+// they are alive
+void ArgList::Pin() {
+  Unshare();
+  ++Pins;
+}
+
+void ArgList::Unpin() {
+  if (Pins)
+    --Pins;
+}
+
+ArgList::Buffer* ArgList::NewBuffer(size_t capacity) {
+  void *mem = ExpressionAllocator::Allocate(sizeof(Buffer) + capacity * sizeof(ExpressionPtr));
+  Buffer *buffer = new (mem) Buffer { 1, capacity, reinterpret_cast<ExpressionPtr*>(static_cast<Buffer*>(mem) + 1) };
+  for (size_t i = 0; i < capacity; ++i)
+    new (buffer->Items + i) ExpressionPtr { };
+  return buffer;
+}
+
+void ArgList::Release() {
+  if (Heap && --Heap->Refs == 0) {
+    for (size_t i = 0; i < Heap->Capacity; ++i)
+      Heap->Items[i].~ExpressionPtr();
+    size_t capacity = Heap->Capacity;
+    Heap->~Buffer();
+    ExpressionAllocator::Free(Heap, sizeof(Buffer) + capacity * sizeof(ExpressionPtr));
+  }
+  Heap = nullptr;
+}
+
+// Gives this list its own storage, copying the elements it can see
+void ArgList::Detach() {
+  Buffer *buffer = NewBuffer(Capacity);
+  for (size_t i = Head; i < Head + Count; ++i) {
+    auto &arg = Storage[i];
+    if (auto ref = dynamic_cast<Ref*>(arg.get()))
+      buffer->Items[i] = ref->NewRef();
+    else if (arg)
+      buffer->Items[i] = arg->Clone();
+  }
+  Release();
+  Heap = buffer;
+  Storage = buffer->Items;
+}
+
+// Moves the elements so there are at least frontRoom free slots before the
+// first one and backRoom after the last one. The heap storage doubles rather
+// than shifting once it is half full, so a run of pushes at one end costs
+// amortized O(1) each.
+void ArgList::Reserve(size_t frontRoom, size_t backRoom) {
+  size_t needed = Count + frontRoom + backRoom;
+  size_t newCapacity = Capacity;
+  if (needed > Capacity || (Heap && needed * 2 > Capacity))
+    newCapacity = max(needed * 2, Capacity);
+
+  size_t spare = newCapacity - needed;
+  size_t newHead = frontRoom + (frontRoom ? spare / 2 : 0);
+  if (newCapacity != Capacity) {
+    Buffer *buffer = NewBuffer(newCapacity);
+    move(begin(), end(), buffer->Items + newHead);
+    Release();
+    Heap = buffer;
+    Storage = buffer->Items;
+    Capacity = newCapacity;
+  }
+  else if (newHead < Head)
+    move(begin(), end(), Storage + newHead);
+  else
+    move_backward(begin(), end(), Storage + newHead + Count);
+  Head = newHead;
+}
+
+//=============================================================================
+
 bool ArgListHelper::AreEqual(const ArgList &lhs, const ArgList &rhs) {
   if (lhs.size() == rhs.size()) {
     auto lCurr = lhs.begin();
@@ -511,17 +743,12 @@ bool ArgListHelper::AreEqual(const ArgList &lhs, const ArgList &rhs) {
 }
 
 void ArgListHelper::CopyTo(const ArgList &src, ArgList &dst) {
-  for (auto &arg : src) {
-    if (auto ref = dynamic_cast<Ref*>(arg.get()))
-      dst.push_back(ref->NewRef());
-    else
-      dst.push_back(arg->Clone());
-  }
+  dst.CopyFrom(src);
 }
 
 //=============================================================================
 
-const TypeInfo Sexp::TypeInstance("sexp", Sexp::NewInstance);
+const TypeInfo Sexp::TypeInstance("sexp", Sexp::NewInstance, TypeTag::Sexp);
 const Sexp Sexp::Null(NullSourceContext);
 
 Sexp::Sexp(const SourceContext &sourceContext):
@@ -548,9 +775,7 @@ Sexp::Sexp(const SourceContext &sourceContext, initializer_list<ExpressionPtr> &
 
 ExpressionPtr Sexp::Clone() const {
   ExpressionPtr copy { new Sexp(GetSourceContext()) };
-  Sexp *sexpCopy = static_cast<Sexp*>(copy.get());
-  for (auto &arg : Args)
-    sexpCopy->Args.push_back(arg->Clone());
+  static_cast<Sexp*>(copy.get())->Args.CopyFrom(Args);
   return copy;
 }
 
@@ -592,15 +817,20 @@ ExpressionPtr Sexp::NewInstance(const SourceContext &sourceContext) {
 //=============================================================================
 
 SexpIterator::SexpIterator(Sexp &sexp):
-  Curr(sexp.Args.begin()),
-  End(sexp.Args.end()),
+  Args(sexp.Args),
+  Idx(0),
   Length(sexp.Args.size())
 {
+  Args.Pin();
+}
+
+SexpIterator::~SexpIterator() {
+  Args.Unpin();
 }
 
 ExpressionPtr& SexpIterator::Next() {
-  if (Curr != End)
-    return *(Curr++); 
+  if (Idx < Args.size())
+    return Args[Idx++];
   else
     return Null; 
 }
@@ -611,7 +841,7 @@ int64_t SexpIterator::GetLength() {
 
 //=============================================================================
 
-const TypeInfo Ref::TypeInstance { "ref", TypeInfo::NewUndefined };
+const TypeInfo Ref::TypeInstance { "ref", TypeInfo::NewUndefined, TypeTag::Ref };
 const Ref Ref::Null(NullSourceContext, const_cast<ExpressionPtr&>(NullExprPtr));
 
 Ref::Ref(const SourceContext &sourceContext, ExpressionPtr &value):
@@ -658,6 +888,239 @@ bool Ref::operator!=(const Ref &rhs) const {
 
 //=============================================================================
 
+const TypeInfo Sequence::TypeInstance { "sequence", TypeInfo::NewUndefined, TypeTag::Sequence };
+const Sequence Sequence::Null(NullSourceContext, IteratorPtr {});
+
+Sequence::Sequence(const SourceContext &sourceContext, IteratorPtr &&iterator):
+  Literal { sourceContext, TypeInstance },
+  Iterator { move(iterator) }
+{
+}
+
+// Values read from a sequence that was copied, along with whether reading
+// them failed
+class SequenceBufferIterator: public IIterator {
+  public:
+    explicit SequenceBufferIterator(ExpressionPtr &&values, bool failed):
+      Values(move(values)),
+      Idx(0),
+      Failed_(failed)
+    {
+    }
+
+    virtual ExpressionPtr& Next() override {
+      auto &args = static_cast<Sexp&>(*Values).Args;
+      if (Idx < args.size())
+        return args[Idx++];
+      else
+        return Null;
+    }
+
+    virtual int64_t GetLength() override {
+      return static_cast<Sexp&>(*Values).Args.size() - Idx;
+    }
+
+    virtual bool Failed() const override {
+      return Failed_ && Idx == static_cast<Sexp&>(*Values).Args.size();
+    }
+
+  private:
+    ExpressionPtr Values;
+    size_t        Idx;
+    bool          Failed_;
+};
+
+ExpressionPtr Sequence::Clone() const {
+  auto *values = new Sexp(GetSourceContext());
+  ExpressionPtr valuesExpr { values };
+  bool failed = false;
+  if (Iterator) {
+    while (ExpressionPtr &value = Iterator->Next())
+      values->Args.push_back(move(value));
+    failed = Iterator->Failed();
+  }
+  ExpressionPtr copy = valuesExpr->Clone();
+  Iterator.reset(new SequenceBufferIterator(move(valuesExpr), failed));
+  return ExpressionPtr { new Sequence(GetSourceContext(), IteratorPtr { new SequenceBufferIterator(move(copy), failed) }) };
+}
+
+void Sequence::Display(ostream &out) const {
+  out << "<sequence>";
+}
+
+IteratorPtr Sequence::GetIterator() {
+  return move(Iterator);
+}
+
+bool Sequence::operator==(const Expression &rhs) const {
+  return &rhs == this;
+}
+
+//=============================================================================
+
+const TypeInfo Dict::TypeInstance("dict", Dict::NewInstance, TypeTag::Dict);
+const Dict Dict::Null(NullSourceContext);
+
+Dict::Dict(const SourceContext &sourceContext):
+  Literal { sourceContext, TypeInstance },
+  Entries_ { make_shared<Entries>() }
+{
+}
+
+ExpressionPtr Dict::Clone() const {
+  Dict *copy = new Dict(GetSourceContext());
+  copy->Entries_ = Entries_;
+  return ExpressionPtr { copy };
+}
+
+IteratorPtr Dict::GetIterator() {
+  return IteratorPtr { new DictIterator(*this) };
+}
+
+bool Dict::operator==(const Expression &rhs) const {
+  return &rhs.Type() == &Dict::TypeInstance
+      && dynamic_cast<const Dict&>(rhs) == *this;
+}
+
+bool Dict::operator==(const Dict &rhs) const {
+  if (size() != rhs.size())
+    return false;
+  for (auto &item : Entries_->Items) {
+    const Expression *value = rhs.Find(*item.first);
+    if (!value || *value != *item.second)
+      return false;
+  }
+  return true;
+}
+
+bool Dict::operator!=(const Dict &rhs) const {
+  return !(rhs == *this);
+}
+
+void Dict::Display(ostream &out) const {
+  out << "{";
+  for (auto &item : Entries_->Items) {
+    if (&item != &Entries_->Items.front())
+      out << " ";
+    out << *item.first << " " << *item.second;
+  }
+  out << "}";
+}
+
+const Expression* Dict::Find(const Expression &key) const {
+  auto it = Entries_->Index.find(&key);
+  return it != Entries_->Index.end() ? Entries_->Items[it->second].second.get() : nullptr;
+}
+
+void Dict::Put(ExpressionPtr &&key, ExpressionPtr &&value) {
+  Unshare();
+  auto &items = Entries_->Items;
+  auto it = Entries_->Index.find(key.get());
+  if (it != Entries_->Index.end())
+    items[it->second].second = move(value);
+  else {
+    Entries_->Index.emplace(key.get(), items.size());
+    items.emplace_back(move(key), move(value));
+  }
+}
+
+bool Dict::Remove(const Expression &key) {
+  auto it = Entries_->Index.find(&key);
+  if (it == Entries_->Index.end())
+    return false;
+
+  size_t idx = it->second;
+  Unshare();
+  auto &items = Entries_->Items;
+  Entries_->Index.erase(items[idx].first.get());
+  if (idx != items.size() - 1) {
+    items[idx] = move(items.back());
+    Entries_->Index[items[idx].first.get()] = idx;
+  }
+  items.pop_back();
+  return true;
+}
+
+bool Dict::IsKey(const Expression &expr) {
+  switch (expr.Type().Tag()) {
+    case TypeTag::Bool:
+    case TypeTag::Int:
+    case TypeTag::Float:
+    case TypeTag::Str:
+      return true;
+    default:
+      return false;
+  }
+}
+
+ExpressionPtr Dict::NewInstance(const SourceContext &sourceContext) {
+  return ExpressionPtr { new Dict(sourceContext) };
+}
+
+// Gives this dict entries of its own. The index points at the keys, so it is
+// rebuilt for the copies.
+void Dict::Unshare() {
+  if (Entries_.use_count() == 1)
+    return;
+
+  auto entries = make_shared<Entries>();
+  entries->Items.reserve(size());
+  entries->Index.reserve(size());
+  for (auto &item : Entries_->Items) {
+    entries->Items.emplace_back(item.first->Clone(), item.second->Clone());
+    entries->Index.emplace(entries->Items.back().first.get(), entries->Items.size() - 1);
+  }
+  Entries_ = entries;
+}
+
+size_t Dict::KeyHash::operator()(const Expression *key) const {
+  switch (key->Type().Tag()) {
+    case TypeTag::Bool:
+      return hash<bool>()(static_cast<const Bool*>(key)->Value);
+    case TypeTag::Int:
+      return hash<int64_t>()(static_cast<const Int*>(key)->Value);
+    case TypeTag::Float:
+      return hash<double>()(static_cast<const Float*>(key)->Value);
+    case TypeTag::Str:
+      return hash<string>()(static_cast<const Str*>(key)->Value);
+    default:
+      return 0;
+  }
+}
+
+bool Dict::KeyEqual::operator()(const Expression *lhs, const Expression *rhs) const {
+  return *lhs == *rhs;
+}
+
+//=============================================================================
+
+DictIterator::DictIterator(Dict &dict):
+  Curr(),
+  SourceContext_(dict.GetSourceContext()),
+  Entries_(dict.Entries_),
+  Idx(0)
+{
+}
+
+ExpressionPtr& DictIterator::Next() {
+  if (Idx < Entries_->Items.size()) {
+    auto &item = Entries_->Items[Idx++];
+    Sexp *entry = new Sexp(SourceContext_);
+    Curr = ExpressionPtr { new Quote(SourceContext_, ExpressionPtr { entry }) };
+    entry->Args.push_back(item.first->Clone());
+    entry->Args.push_back(item.second->Clone());
+    return Curr;
+  }
+  else
+    return Null;
+}
+
+int64_t DictIterator::GetLength() {
+  return Entries_->Items.size();
+}
+
+//=============================================================================
+
 const TypeInfo List::TypeInstance("list", TypeInfo::NewUndefined);
 
 ExpressionPtr List::GetNil(const SourceContext &sourceContext) {
@@ -5,13 +5,16 @@
 #include <cinttypes>
 #include <memory>
 #include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "Atom.h"
 
 //TODO: need global type list
 
 struct ModuleInfo {
   std::string Name;
   std::string FilePath;
-  uint32_t LoadCount;
 
   explicit ModuleInfo(const std::string &name, const std::string &filePath);
 };
@@ -30,24 +33,44 @@ static const SourceContext NullSourceContext;
 struct Expression;
 
 using ExpressionPtr = std::unique_ptr<Expression>;
-using SymbolTableType = std::map<std::string, ExpressionPtr>;
+using ConstExpressionPtr = std::shared_ptr<const Expression>;
+using SymbolTableType = std::unordered_map<Atom, ExpressionPtr>;
 typedef ExpressionPtr (*ExpressionNewFn)(const SourceContext &);
 
 static ExpressionPtr NullExprPtr {};
 
+// Concrete type of an expression, so the evaluator can dispatch on it without
+// a lookup. Abstract types are Other.
+enum class TypeTag: uint8_t {
+  Other,
+  Bool,
+  Int,
+  Float,
+  Str,
+  Quote,
+  Symbol,
+  Sexp,
+  Ref,
+  Sequence,
+  Function,
+  Dict
+};
+
 class TypeInfo {
 public:
-  explicit TypeInfo(const std::string &typeName, const ExpressionNewFn newFn);
+  explicit TypeInfo(const std::string &typeName, const ExpressionNewFn newFn, TypeTag tag = TypeTag::Other);
   TypeInfo() = delete;
   TypeInfo(const TypeInfo&) = delete;
   TypeInfo(TypeInfo&&) = delete;
   TypeInfo& operator=(TypeInfo) = delete;
   const std::string& Name() const;
+  TypeTag Tag() const { return Tag_; }
   ExpressionPtr New(const SourceContext &sourceContext) const;
   static ExpressionPtr NewUndefined(const SourceContext &sourceContext);
 private:
   const std::string TypeName;
   const ExpressionNewFn NewFn;
+  const TypeTag Tag_;
 };
 
 struct Expression {
@@ -55,6 +78,8 @@ struct Expression {
 
   explicit Expression(const SourceContext &sourceContext, const TypeInfo& typeInfo);
   virtual ~Expression();
+  static void* operator new(size_t size);
+  static void operator delete(void *ptr, size_t size);
   virtual ExpressionPtr Clone() const = 0;
   virtual ExpressionPtr New(const SourceContext &sourceContext) const;
   virtual void Display(std::ostream &out) const = 0;
@@ -62,7 +87,7 @@ struct Expression {
   const std::string ToString() const;
   virtual bool operator==(const Expression &rhs) const = 0;
   bool operator!=(const Expression &rhs) const;
-  const TypeInfo& Type() const;
+  const TypeInfo& Type() const { return Type_; }
   void SetSourceContext(const SourceContext &newSourceContext);
   void SetSourceContext(const Expression &fromExpr);
   const SourceContext& GetSourceContext() const;
@@ -79,6 +104,7 @@ public:
   virtual ~IIterator();
   virtual ExpressionPtr& Next() = 0;
   virtual int64_t GetLength() = 0;
+  virtual bool Failed() const;
 protected:
   ExpressionPtr Null;
 };
@@ -212,10 +238,12 @@ struct Quote: public Literal, IIterable {
 struct Symbol: public Expression {
   static const TypeInfo TypeInstance;
   static const Symbol Null;
+  static const size_t NO_SLOT = static_cast<size_t>(-1);
 
-  std::string Value;
+  Atom Value;
+  size_t Slot; // frame slot of the enclosing function, a hint checked against the frame on lookup
 
-  explicit Symbol(const SourceContext &sourceContext, const std::string& value);
+  explicit Symbol(const SourceContext &sourceContext, const Atom &value);
   virtual ExpressionPtr Clone() const override;
   virtual void Display(std::ostream &out) const override;
   virtual bool operator==(const Expression &rhs) const override;
@@ -228,7 +256,78 @@ struct Symbol: public Expression {
   static ExpressionPtr NewInstance(const SourceContext &sourceContext);
 };
 
-using ArgList = std::list<ExpressionPtr>;
+// Contiguous list of expressions. Short lists are stored inline, longer ones
+// on the heap with spare room kept at whichever end is growing, so
+// push_front/pop_front are amortized O(1) like push_back/pop_back.
+// Copies of a heap list share its storage until one of them is modified,
+// so any non-const access first gives the list storage of its own.
+class ArgList {
+  public:
+    using value_type = ExpressionPtr;
+    using iterator = ExpressionPtr*;
+    using const_iterator = const ExpressionPtr*;
+
+    explicit ArgList();
+    ArgList(ArgList &&rhs);
+    ArgList(const ArgList&) = delete;
+    ~ArgList();
+    ArgList& operator=(ArgList &&rhs);
+    ArgList& operator=(const ArgList&) = delete;
+
+    iterator begin() { Unshare(); return Storage + Head; }
+    iterator end() { Unshare(); return Storage + Head + Count; }
+    const_iterator begin() const { return Storage + Head; }
+    const_iterator end() const { return Storage + Head + Count; }
+    size_t size() const { return Count; }
+    bool empty() const { return Count == 0; }
+    ExpressionPtr& front() { Unshare(); return Storage[Head]; }
+    ExpressionPtr& back() { Unshare(); return Storage[Head + Count - 1]; }
+    const Expression* front() const { return Storage[Head].get(); }
+    const Expression* back() const { return Storage[Head + Count - 1].get(); }
+    ExpressionPtr& operator[](size_t idx) { Unshare(); return Storage[Head + idx]; }
+    const Expression* operator[](size_t idx) const { return Storage[Head + idx].get(); }
+
+    void push_back(ExpressionPtr &&value);
+    void push_front(ExpressionPtr &&value);
+    void pop_back();
+    void pop_front();
+    iterator insert(const_iterator pos, ExpressionPtr &&value);
+    iterator erase(const_iterator pos);
+    iterator erase(const_iterator first, const_iterator last);
+    void clear();
+    void CopyFrom(const ArgList &src);
+    void Pin();
+    void Unpin();
+    bool IsShared() const { return Heap && Heap->Refs > 1; }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args) {
+      push_back(ExpressionPtr { std::forward<Args>(args)... });
+    }
+
+  private:
+    static const size_t INLINE_CAPACITY = 4;
+
+    struct Buffer {
+      size_t        Refs;
+      size_t        Capacity;
+      ExpressionPtr *Items;
+    };
+
+    ExpressionPtr Inline[INLINE_CAPACITY];
+    Buffer        *Heap;
+    ExpressionPtr *Storage;
+    size_t        Capacity;
+    size_t        Head;
+    size_t        Count;
+    size_t        Pins; // while nonzero, elements are referenced from outside, so copies must not share them
+
+    static Buffer* NewBuffer(size_t capacity);
+    void Release();
+    void Unshare() { if (IsShared()) Detach(); }
+    void Detach();
+    void Reserve(size_t frontRoom, size_t backRoom);
+};
 
 class ArgListHelper {
   public:
@@ -257,12 +356,13 @@ struct Sexp: public Expression, IIterable {
 class SexpIterator: public IIterator {
 public:
   explicit SexpIterator(Sexp &sexp);
+  virtual ~SexpIterator();
   virtual ExpressionPtr& Next() override;
   virtual int64_t GetLength() override;
 private:
-  ArgList::iterator Curr;
-  ArgList::iterator End;
-  int64_t           Length;
+  ArgList &Args;
+  size_t  Idx;
+  int64_t Length;
 };
 
 struct Ref: public Expression, IIterable {
@@ -282,6 +382,84 @@ struct Ref: public Expression, IIterable {
   bool operator!=(const Ref &rhs) const;
 };
 
+// Values produced on demand by an iterator. Sequences are handed from the
+// builtin producing them straight to the one consuming them, so they are
+// iterated once. Copying one reads the rest of its values, which the
+// sequence and the copy then each iterate.
+struct Sequence: public Literal, IIterable {
+  static const TypeInfo TypeInstance;
+  static const Sequence Null;
+
+  mutable IteratorPtr Iterator;
+
+  explicit Sequence(const SourceContext &sourceContext, IteratorPtr &&iterator);
+  virtual ExpressionPtr Clone() const override;
+  virtual void Display(std::ostream &out) const override;
+  virtual IteratorPtr GetIterator();
+  virtual bool operator==(const Expression &rhs) const override;
+};
+
+// Hash map from bool, int, float or str keys to values. Entries are kept in
+// the order they were added, removing one moves the last entry into its place.
+// Copies share their entries until one of them is modified.
+struct Dict: public Literal, IIterable {
+  static const TypeInfo TypeInstance;
+  static const Dict Null;
+
+  explicit Dict(const SourceContext &sourceContext);
+  virtual ExpressionPtr Clone() const override;
+  virtual void Display(std::ostream &out) const override;
+  virtual IteratorPtr GetIterator();
+  virtual bool operator==(const Expression &rhs) const override;
+  bool operator==(const Dict &rhs) const;
+  bool operator!=(const Dict &rhs) const;
+
+  size_t size() const { return Entries_->Items.size(); }
+  bool empty() const { return Entries_->Items.empty(); }
+  const ExpressionPtr& KeyAt(size_t idx) const { return Entries_->Items[idx].first; }
+  const ExpressionPtr& ValueAt(size_t idx) const { return Entries_->Items[idx].second; }
+  const Expression* Find(const Expression &key) const;
+  void Put(ExpressionPtr &&key, ExpressionPtr &&value);
+  bool Remove(const Expression &key);
+  static bool IsKey(const Expression &expr);
+  static ExpressionPtr NewInstance(const SourceContext &sourceContext);
+
+private:
+  struct KeyHash {
+    size_t operator()(const Expression *key) const;
+  };
+
+  struct KeyEqual {
+    bool operator()(const Expression *lhs, const Expression *rhs) const;
+  };
+
+  struct Entries {
+    std::vector<std::pair<ExpressionPtr, ExpressionPtr>>                Items;
+    std::unordered_map<const Expression*, size_t, KeyHash, KeyEqual>  Index;
+  };
+
+  std::shared_ptr<Entries> Entries_;
+
+  void Unshare();
+
+  friend class DictIterator;
+};
+
+// Each entry as a (key value) list. The iterator keeps a share of the
+// entries, so changing or rebinding the dict while iterating it leaves the
+// entries being iterated as they were.
+class DictIterator: public IIterator {
+public:
+  explicit DictIterator(Dict &dict);
+  virtual ExpressionPtr& Next() override;
+  virtual int64_t GetLength() override;
+private:
+  ExpressionPtr                         Curr;
+  SourceContext                         SourceContext_;
+  std::shared_ptr<const Dict::Entries>  Entries_;
+  size_t                                Idx;
+};
+
 struct List {
   static const TypeInfo TypeInstance;
   static ExpressionPtr GetNil(const SourceContext &sourceContext);
@@ -0,0 +1,98 @@
+#include <new>
+
+#include "ExpressionAllocator.h"
+
+using namespace std;
+
+//=============================================================================
+
+AllocationStats AllocationStats::operator-(const AllocationStats &rhs) const {
+  return AllocationStats { Objects - rhs.Objects, Bytes - rhs.Bytes };
+}
+
+//=============================================================================
+
+thread_local ExpressionAllocator::FreeBlock *ExpressionAllocator::FreeLists[SIZE_CLASSES];
+thread_local ExpressionAllocator::SlabHeader *ExpressionAllocator::Slabs;
+thread_local size_t ExpressionAllocator::LiveBlocks;
+thread_local AllocationStats ExpressionAllocator::Stats;
+
+// Gives the slabs of a thread back when it exits, if nothing still uses them.
+// Blocks freed after this by static objects keep theirs alive.
+struct SlabReleaser {
+  ~SlabReleaser() {
+    ExpressionAllocator::ReleaseSlabs();
+  }
+};
+
+void* ExpressionAllocator::Allocate(size_t size) {
+  ++Stats.Objects;
+  Stats.Bytes += size;
+
+  size_t sizeClass = (size + GRANULARITY - 1) / GRANULARITY;
+  if (sizeClass == 0 || sizeClass > SIZE_CLASSES)
+    return ::operator new(size);
+
+  FreeBlock *&freeList = FreeLists[sizeClass - 1];
+  if (!freeList)
+    Refill(sizeClass);
+  FreeBlock *block = freeList;
+  freeList = block->Next;
+  ++LiveBlocks;
+  return block;
+}
+
+void ExpressionAllocator::Free(void *ptr, size_t size) {
+  if (!ptr)
+    return;
+
+  size_t sizeClass = (size + GRANULARITY - 1) / GRANULARITY;
+  if (sizeClass == 0 || sizeClass > SIZE_CLASSES)
+    ::operator delete(ptr);
+  else {
+    FreeBlock *&freeList = FreeLists[sizeClass - 1];
+    FreeBlock *block = static_cast<FreeBlock*>(ptr);
+    block->Next = freeList;
+    freeList = block;
+    --LiveBlocks;
+  }
+}
+
+const AllocationStats& ExpressionAllocator::GetStats() {
+  return Stats;
+}
+
+// Returns every slab to the global operator new, which is only done while no
+// block is in use. The pools keep their peak size until then.
+bool ExpressionAllocator::ReleaseSlabs() {
+  if (LiveBlocks != 0)
+    return false;
+
+  while (Slabs) {
+    SlabHeader *next = Slabs->Next;
+    ::operator delete(Slabs);
+    Slabs = next;
+  }
+  for (auto &freeList : FreeLists)
+    freeList = nullptr;
+  return true;
+}
+
+void ExpressionAllocator::Refill(size_t sizeClass) {
+  static thread_local SlabReleaser releaser;
+  (void)releaser;
+
+  size_t blockSize = sizeClass * GRANULARITY;
+  size_t nBlocks = SLAB_BYTES / blockSize;
+  auto *header = static_cast<SlabHeader*>(::operator new(sizeof(SlabHeader) + nBlocks * blockSize));
+  header->Next = Slabs;
+  Slabs = header;
+
+  char *slab = reinterpret_cast<char*>(header + 1);
+  FreeBlock *&freeList = FreeLists[sizeClass - 1];
+  for (size_t i = nBlocks; i > 0; --i) {
+    FreeBlock *block = reinterpret_cast<FreeBlock*>(slab + (i - 1) * blockSize);
+    block->Next = freeList;
+    freeList = block;
+  }
+}
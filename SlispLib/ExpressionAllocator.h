@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cinttypes>
+
+struct AllocationStats {
+  uint64_t Objects;
+  uint64_t Bytes;
+
+  AllocationStats operator-(const AllocationStats &rhs) const;
+};
+
+// Size-class pools for expression nodes. Freed blocks go on a free list for
+// their size class and are reused by the next allocation of that class, so
+// short-lived temporaries don't reach malloc. Blocks larger than the biggest
+// class go straight to the global operator new.
+//
+// Each thread has pools of its own, so they aren't locked. Interpreters on
+// different threads don't share expressions, and a block is freed on the
+// thread that allocated it. Slabs are kept while any block of the thread is
+// in use and released once none is, at the latest when the thread exits.
+// GetStats counts the allocations of the calling thread.
+class ExpressionAllocator {
+  public:
+    static void* Allocate(size_t size);
+    static void Free(void *ptr, size_t size);
+    static const AllocationStats& GetStats();
+    static bool ReleaseSlabs();
+
+  private:
+    static const size_t GRANULARITY = 16;
+    static const size_t SIZE_CLASSES = 16;
+    static const size_t SLAB_BYTES = 16 * 1024;
+
+    struct FreeBlock {
+      FreeBlock *Next;
+    };
+
+    // Starts every slab, padded so the blocks after it stay aligned
+    union SlabHeader {
+      SlabHeader *Next;
+      char       Padding[GRANULARITY];
+    };
+
+    static thread_local FreeBlock       *FreeLists[SIZE_CLASSES];
+    static thread_local SlabHeader      *Slabs;
+    static thread_local size_t          LiveBlocks;
+    static thread_local AllocationStats Stats;
+
+    static void Refill(size_t sizeClass);
+};
@@ -4,6 +4,7 @@
 #include <vector>
 #include <memory>
 #include <functional>
+#include <algorithm>
 
 #include "Expression.h"
 #include "FunctionDef.h"
@@ -12,77 +13,48 @@ using namespace std;
 
 //=============================================================================
 
-ArgDef::~ArgDef() {
-}
-
-bool ArgDef::Validate(ExpressionEvaluator evaluator, ExpressionPtr &expr, string &error) const {
-  if (expr) {
-    if (auto sexp = TypeHelper::GetValue<Sexp>(expr)) {
-      auto &args = sexp->Args;
-      if (!args.empty()) {
-        ExpressionPtr fnExpr = move(args.front());
-        args.pop_front();
-        if (auto fn = TypeHelper::GetValue<Function>(fnExpr)) {
-          bool result = ValidateArgs(evaluator, args, error);
-          args.push_front(move(fnExpr));
-          return result;
-        }
-        else
-          throw invalid_argument("first argument in sexp must be a function");
-      }
-      else
-        throw invalid_argument("sexp requires at least one argument");
-    }
-    else
-      error = "Expected: Sexp. Actual: " + expr->Type().Name();
-  }
-  else
-    throw invalid_argument("ExpressionPtr is empty");
-
-  return error.empty();
+bool ArgSignature::IsArgCountValid(size_t nArgs) const {
+  return nArgs >= MinArgs && nArgs <= MaxArgs;
 }
 
-bool ArgDef::CheckArgCount(size_t expected, ArgList &args, string &error) const {
-  return CheckArgCount(expected, expected, args, error);
+const TypeInfo* ArgSignature::GetType(size_t argIdx) const {
+  if (Types.empty())
+    return nullptr;
+  return Types[min(argIdx, Types.size() - 1)];
 }
 
-bool ArgDef::CheckArgCount(size_t expectedMin, size_t expectedMax, ArgList &args, string &error) const {
-  auto actualArgCount = args.size();
-  if ((expectedMin == ANY_ARGS || actualArgCount >= expectedMin) &&
-      (expectedMax == ANY_ARGS || actualArgCount <= expectedMax))
-    return true;
-  else {
-    stringstream ss;
-    ss << "Expected ";
-    if (expectedMin == expectedMax)
-      ss << to_string(expectedMin);
-    else if (expectedMax == ANY_ARGS)
-      ss << "at least " << to_string(expectedMin);
-    else
-      ss << "between " << to_string(expectedMin) << " and " << to_string(expectedMax);
-    ss << " args, got " + to_string(actualArgCount);
-    error = ss.str();
+// Whether values already evaluated into args pass the checks of a call
+bool ArgSignature::Matches(const ArgList &args) const {
+  if (!IsArgCountValid(args.size()))
     return false;
+  size_t argIdx = 0;
+  for (auto arg = begin(args); arg != end(args); ++arg, ++argIdx) {
+    auto *type = GetType(argIdx);
+    if (type && !TypeHelper::TypeMatches(*type, *arg))
+      return false;
   }
+  return true;
 }
 
-bool ArgDef::CheckArg(ExpressionEvaluator evaluator, ExpressionPtr &arg, const TypeInfo &expectedType, size_t argNum, string &error) const {
-  if (arg && TypeHelper::TypeMatches(expectedType, arg->Type()) || evaluator(arg)) {
-    if (&expectedType == &Literal::TypeInstance && &arg->Type() == &Quote::TypeInstance) {
-      return true;
-    }
+string ArgSignature::ArgCountError(size_t nArgs) const {
+  string error = "Expected ";
+  if (MinArgs == MaxArgs)
+    error += to_string(MinArgs);
+  else if (MaxArgs == ArgDef::ANY_ARGS)
+    error += "at least " + to_string(MinArgs);
+  else
+    error += "between " + to_string(MinArgs) + " and " + to_string(MaxArgs);
+  return error + " args, got " + to_string(nArgs);
+}
 
-    if (!TypeHelper::TypeMatches(expectedType, arg)) {
-      error = "Argument " + to_string(argNum) + ": Expected " + expectedType.Name() + ", got " + arg->Type().Name();
-      return false;
-    }
-    else
-      return true;
-  }
-  else {
-    error = "Argument " + to_string(argNum) + ": Failed to evaluate";
-    return false;
-  }
+//=============================================================================
+
+ArgDef::~ArgDef() {
+}
+
+bool ArgDef::IsArgCountValid(size_t expectedMin, size_t expectedMax, size_t actualArgCount) {
+  return (expectedMin == ANY_ARGS || actualArgCount >= expectedMin) &&
+         (expectedMax == ANY_ARGS || actualArgCount <= expectedMax);
 }
 
 //=============================================================================
@@ -126,6 +98,12 @@ const string FuncDef::VarArgDef::ToString() const {
   }
 }
 
+const TypeInfo* FuncDef::VarArgDef::GetArgType(size_t argIdx, size_t nArgs) const {
+  if (IsArgCountValid(MinArgs, MaxArgs, nArgs) && argIdx < nArgs)
+    return &Type;
+  return nullptr;
+}
+
 bool FuncDef::VarArgDef::operator==(const ArgDef &rhs) const {
   auto *varRhs = dynamic_cast<const VarArgDef*>(&rhs);
   return varRhs && *varRhs == *this;
@@ -137,32 +115,18 @@ bool FuncDef::VarArgDef::operator==(const VarArgDef &rhs) const {
       && MaxArgs == rhs.MaxArgs;
 }
 
-bool FuncDef::VarArgDef::ValidateArgs(ExpressionEvaluator evaluator, ArgList &args, string &error) const {
-  if (ValidateArgCount(args, error)) {
-    ValidateArgTypes(evaluator, args, error);
-  }
-
-  return error.empty();
+ArgSignature FuncDef::VarArgDef::GetSignature() const {
+  return ArgSignature {
+    MinArgs == ANY_ARGS ? 0 : MinArgs,
+    MaxArgs,
+    { &Type }
+  };
 }
 
 bool FuncDef::VarArgDef::IsAnyArgs() const {
   return MinArgs == ANY_ARGS && MaxArgs == ANY_ARGS;
 }
 
-bool FuncDef::VarArgDef::ValidateArgCount(ArgList &args, string &error) const {
-  return CheckArgCount(MinArgs, MaxArgs, args, error);
-}
-
-bool FuncDef::VarArgDef::ValidateArgTypes(ExpressionEvaluator evaluator, ArgList &args, string &error) const {
-  int argNum = 0;
-  for (auto &arg : args) {
-    ++argNum;
-    if (!CheckArg(evaluator, arg, Type, argNum, error))
-        return false;
-  }
-  return true;
-}
-
 //=============================================================================
 
 FuncDef::ListArgDef::ListArgDef(initializer_list<const TypeInfo*> &&types):
@@ -183,6 +147,12 @@ const string FuncDef::ListArgDef::ToString() const {
   return ss.str();
 }
 
+const TypeInfo* FuncDef::ListArgDef::GetArgType(size_t argIdx, size_t nArgs) const {
+  if (nArgs == Types.size() && argIdx < nArgs)
+    return Types[argIdx];
+  return nullptr;
+}
+
 bool FuncDef::ListArgDef::operator==(const ArgDef &rhs) const {
   auto *lstRhs = dynamic_cast<const ListArgDef*>(&rhs);
   return lstRhs && *lstRhs == *this;
@@ -192,26 +162,10 @@ bool FuncDef::ListArgDef::operator==(const ListArgDef &rhs) const {
   return Types == rhs.Types;
 }
 
-bool FuncDef::ListArgDef::ValidateArgs(ExpressionEvaluator evaluator, ArgList &args, string &error) const {
-  if (CheckArgCount(Types.size(), args, error)) {
-    int argNum = 0;
-    auto currExpectedArg = Types.begin();
-    auto currActualArg = args.begin();
-
-    while (currExpectedArg != Types.end() && currActualArg != args.end()) {
-      ++argNum;
-      if (!CheckArg(evaluator, *currActualArg, **currExpectedArg, argNum, error))
-        return false;
-
-      ++currExpectedArg;
-      ++currActualArg;
-    }
-
-    return true;
-  }
-  return false;
+ArgSignature FuncDef::ListArgDef::GetSignature() const {
+  return ArgSignature { Types.size(), Types.size(), Types };
 }
-  
+
 //=============================================================================
 
 ArgDefPtr FuncDef::NoArgs() {
@@ -250,37 +204,38 @@ ArgDefPtr FuncDef::Args(initializer_list<const TypeInfo*> &&args) {
   return ArgDefPtr { new ListArgDef { move(args) } };
 }
 
-FuncDef::FuncDef(ArgDefPtr in, ArgDefPtr out):
+FuncDef::FuncDef(ArgDefPtr in, ArgDefPtr out, int flags):
   In { move(in) },
-  Out { move(out) }
+  Out { move(out) },
+  Signature(new ArgSignature(BuildSignature(In.get()))),
+  Flags_(flags)
 {
 }
 
 FuncDef::FuncDef(const FuncDef &val):
-  In { val.In ? val.In->Clone().release() : nullptr },
-  Out { val.Out ? val.Out->Clone().release() : nullptr }
+  In { val.In },
+  Out { val.Out },
+  Signature { val.Signature },
+  Flags_(val.Flags_)
 {
 }
 
 FuncDef::FuncDef(FuncDef &&rval):
   In { move(rval.In) },
-  Out { move(rval.Out) }
+  Out { move(rval.Out) },
+  Signature(move(rval.Signature)),
+  Flags_(rval.Flags_)
 {
 }
 
 FuncDef FuncDef::Clone() const {
-  ArgDefPtr in;
-  ArgDefPtr out;
-  if (In)
-    in = In->Clone();
-  if (Out)
-    out = Out->Clone();
-  return FuncDef { move(in), move(out) };
+  return FuncDef { *this };
 }
 
 bool FuncDef::operator==(const FuncDef &rhs) const {
   return *In == *rhs.In
-      && *Out == *rhs.Out;
+      && *Out == *rhs.Out
+      && Flags_ == rhs.Flags_;
 }
 
 bool FuncDef::operator!=(const FuncDef &rhs) const {
@@ -295,21 +250,85 @@ FuncDef& FuncDef::operator=(FuncDef func) {
 void FuncDef::Swap(FuncDef &func) {
   swap(In, func.In);
   swap(Out, func.Out);
+  swap(Signature, func.Signature);
+  swap(Flags_, func.Flags_);
 }
 
-bool FuncDef::ValidateArgs(ExpressionEvaluator evaluator, ExpressionPtr &expr, string &error) {
-  stringstream ss;
-  string tmpError;
-  if (!In->Validate(evaluator, expr, tmpError)) {
-    if (!Name.empty())
-      ss << Name << ": ";
-    ss <<"Wrong input args: " << tmpError;
-    error = ss.str();
-    return false;
+// Checks the arguments of the call expr against the signature, evaluating
+// the ones whose type is not known yet. Error text is only built on failure.
+bool FuncDef::ValidateArgs(const ExpressionEvaluator &evaluator, ExpressionPtr &expr, string &error) const {
+  if (!expr)
+    throw invalid_argument("ExpressionPtr is empty");
+
+  auto sexp = TypeHelper::GetValue<Sexp>(expr);
+  if (!sexp)
+    return WrongArgs("Expected: Sexp. Actual: " + expr->Type().Name(), error);
+
+  auto &args = sexp->Args;
+  if (args.empty())
+    throw invalid_argument("sexp requires at least one argument");
+  if (!TypeHelper::GetValue<Function>(args.front()))
+    throw invalid_argument("first argument in sexp must be a function");
+
+  size_t nArgs = args.size() - 1;
+  if (!Signature->IsArgCountValid(nArgs))
+    return WrongArgs(Signature->ArgCountError(nArgs), error);
+
+  if (!Signature->Types.empty()) {
+    string argError;
+    for (size_t argIdx = 0; argIdx < nArgs; ++argIdx) {
+      if (!CheckArg(evaluator, args[argIdx + 1], *Signature->GetType(argIdx), argIdx + 1, argError))
+        return WrongArgs(argError, error);
+    }
   }
   return true;
 }
 
+ArgSignature FuncDef::BuildSignature(const ArgDef *argDef) {
+  if (argDef)
+    return argDef->GetSignature();
+  else
+    return ArgSignature { 0, ArgDef::ANY_ARGS, {} };
+}
+
+bool FuncDef::CheckArg(const ExpressionEvaluator &evaluator, ExpressionPtr &arg, const TypeInfo &expectedType, size_t argNum, string &error) {
+  if (arg && TypeHelper::TypeMatches(expectedType, arg->Type()) || evaluator(arg)) {
+    if (&expectedType == &Literal::TypeInstance && &arg->Type() == &Quote::TypeInstance) {
+      return true;
+    }
+
+    if (!TypeHelper::TypeMatches(expectedType, arg)) {
+      error = "Argument " + to_string(argNum) + ": Expected " + expectedType.Name() + ", got " + arg->Type().Name();
+      return false;
+    }
+    else
+      return true;
+  }
+  else {
+    error = "Argument " + to_string(argNum) + ": Failed to evaluate";
+    return false;
+  }
+}
+
+bool FuncDef::WrongArgs(const string &what, string &error) const {
+  error = (Name.empty() ? "" : Name + ": ") + "Wrong input args: " + what;
+  return false;
+}
+
+const ArgSignature& FuncDef::GetSignature() const {
+  return *Signature;
+}
+
+bool FuncDef::HasFlag(Flags flag) const {
+  return (Flags_ & flag) != 0;
+}
+
+// Type the argument is validated against, or nullptr if a call with nArgs
+// arguments is invalid (arguments are then left unevaluated)
+const TypeInfo* FuncDef::GetArgType(size_t argIdx, size_t nArgs) const {
+  return In ? In->GetArgType(argIdx, nArgs) : nullptr;
+}
+
 const string FuncDef::ToString() const {
   stringstream ss;
   ss << In->ToString() << ") -> " << Out->ToString();
@@ -337,7 +356,8 @@ Function::Function(const SourceContext &sourceContext, const TypeInfo &typeInfo,
 Function::Function(const SourceContext &sourceContext, const TypeInfo &typeInfo, FuncDef &&def, ExpressionPtr &&sym):
   Literal { sourceContext, typeInfo },
   Def { move(def) },
-  Symbol { move(sym) }
+  Symbol { move(sym) },
+  DocName { }
 {
   Def.Name = SymbolName();
 }
@@ -351,9 +371,7 @@ Function::Function(const Function &rhs):
   Literal { rhs.GetSourceContext(), rhs.Type() },
   Def { rhs.Def },
   Symbol { },
-  Signatures { rhs.Signatures },
-  Doc { rhs.Doc },
-  Examples { rhs.Examples }
+  DocName { rhs.DocName }
 {
   if (rhs.Symbol)
     Symbol = rhs.Symbol->Clone();
@@ -373,8 +391,7 @@ void Function::Display(ostream &out) const {
 bool Function::operator==(const Function &rhs) const {
   return Def == rhs.Def &&
          (Symbol && rhs.Symbol && *Symbol == *rhs.Symbol) &&
-         Signatures == rhs.Signatures &&
-         Doc == rhs.Doc;
+         DocName == rhs.DocName;
 }
 
 std::string Function::SymbolName() const {
@@ -389,7 +406,7 @@ std::string Function::SymbolName() const {
 
 //=============================================================================
 
-const TypeInfo CompiledFunction::TypeInstance("compiled-fn", TypeInfo::NewUndefined);
+const TypeInfo CompiledFunction::TypeInstance("compiled-fn", TypeInfo::NewUndefined, TypeTag::Function);
 const CompiledFunction CompiledFunction::Null(NullSourceContext);
 
 CompiledFunction::CompiledFunction(const SourceContext &sourceContext):
@@ -440,35 +457,48 @@ void CompiledFunction::Swap(CompiledFunction &rhs) {
 
 //=============================================================================
 
-const TypeInfo InterpretedFunction::TypeInstance("interpreted-fn", TypeInfo::NewUndefined);
+const TypeInfo InterpretedFunction::TypeInstance("interpreted-fn", TypeInfo::NewUndefined, TypeTag::Function);
 const InterpretedFunction InterpretedFunction::Null(NullSourceContext);
 
 InterpretedFunction::InterpretedFunction(const InterpretedFunction &rhs):
   Function(rhs),
-  Code { rhs.GetSourceContext(), ExpressionPtr { } },
+  Code { rhs.Code },
   Args { },
-  Closure { }
+  Closure { },
+  CompiledCode { rhs.CompiledCode },
+  Slots { rhs.Slots },
+  FreeSymbols { rhs.FreeSymbols },
+  EvaluatesData { rhs.EvaluatesData }
 {
   ArgListHelper::CopyTo(rhs.Args, Args);
-  if (rhs.Code.Value)
-    Code.Value = move(rhs.Code.Value->Clone());
   for (auto &kv : rhs.Closure) 
     Closure.emplace(kv.first, kv.second->Clone());
 }
 
 InterpretedFunction::InterpretedFunction(const SourceContext &sourceContext, FuncDef &&def, ExpressionPtr &&code, ArgList &&args):
   Function { sourceContext, TypeInstance, move(def) },
-  Code { sourceContext, move(code) },
+  Code { },
   Args { move(args) },
-  Closure { }
+  Closure { },
+  CompiledCode { },
+  Slots { },
+  FreeSymbols { },
+  EvaluatesData { false }
 {
+  if (code)
+    ResolveSlots(*code);
+  Code = move(code);
 }
 
 InterpretedFunction::InterpretedFunction(const SourceContext &sourceContext):
   Function { sourceContext, TypeInstance },
-  Code { sourceContext, ExpressionPtr {} },
+  Code { },
   Args {},
-  Closure {}
+  Closure {},
+  CompiledCode {},
+  Slots {},
+  FreeSymbols {},
+  EvaluatesData { false }
 {
 }
 
@@ -484,7 +514,7 @@ bool InterpretedFunction::operator==(const Expression &rhs) const {
 
 bool InterpretedFunction::operator==(const InterpretedFunction &rhs) const {
   return static_cast<const Function&>(*this) == static_cast<const Function&>(rhs)
-      && Code == rhs.Code
+      && (Code == rhs.Code || (Code && rhs.Code && *Code == *rhs.Code))
       && ArgListHelper::AreEqual(Args, rhs.Args)
       && Closure == rhs.Closure;
 }
@@ -493,6 +523,93 @@ bool InterpretedFunction::operator!=(const InterpretedFunction &rhs) const {
   return !(rhs == *this);
 }
 
+static const Atom LetSymbol { "let" };
+
+static void AddSlot(vector<Atom> &slots, const Atom &name) {
+  if (find(begin(slots), end(slots), name) == end(slots))
+    slots.push_back(name);
+}
+
+static void CollectLetSlots(const Expression &expr, vector<Atom> &slots) {
+  if (auto *sexp = dynamic_cast<const Sexp*>(&expr)) {
+    auto &args = sexp->Args;
+    if (args.size() >= 2) {
+      auto *head = dynamic_cast<const Symbol*>(args.front());
+      auto *vars = dynamic_cast<const Sexp*>((*next(begin(args))).get());
+      if (head && vars && head->Value == LetSymbol) {
+        for (auto &var : vars->Args) {
+          auto *binding = dynamic_cast<const Sexp*>(var.get());
+          if (binding && !binding->Args.empty()) {
+            if (auto *name = dynamic_cast<const Symbol*>(binding->Args.front()))
+              AddSlot(slots, name->Value);
+          }
+        }
+      }
+    }
+    for (auto &arg : args) {
+      if (arg)
+        CollectLetSlots(*arg, slots);
+    }
+  }
+}
+
+static void AssignSlots(Expression &expr, const vector<Atom> &slots) {
+  if (auto *sym = dynamic_cast<Symbol*>(&expr)) {
+    auto slot = find(begin(slots), end(slots), sym->Value);
+    sym->Slot = slot != end(slots) ? static_cast<size_t>(slot - begin(slots)) : Symbol::NO_SLOT;
+  }
+  else if (auto *sexp = dynamic_cast<Sexp*>(&expr)) {
+    for (auto &arg : sexp->Args) {
+      if (arg)
+        AssignSlots(*arg, slots);
+    }
+  }
+}
+
+// Builtins that evaluate a value as code, or make a symbol from a string
+static const Atom DataEvaluatingSymbols[] { "unquote", "apply", "symbol" };
+
+// Quoted code is included, it may be evaluated in the function later
+static void CollectFreeSymbols(const Expression &expr, const vector<Atom> &slots, vector<Atom> &freeSymbols, bool &evaluatesData) {
+  if (auto *sym = dynamic_cast<const Symbol*>(&expr)) {
+    if (find(begin(slots), end(slots), sym->Value) == end(slots))
+      AddSlot(freeSymbols, sym->Value);
+    if (find(begin(DataEvaluatingSymbols), end(DataEvaluatingSymbols), sym->Value) != end(DataEvaluatingSymbols))
+      evaluatesData = true;
+  }
+  else if (auto *sexp = dynamic_cast<const Sexp*>(&expr)) {
+    for (auto &arg : sexp->Args) {
+      if (arg)
+        CollectFreeSymbols(*arg, slots, freeSymbols, evaluatesData);
+    }
+  }
+  else if (auto *quote = dynamic_cast<const Quote*>(&expr)) {
+    if (quote->Value)
+      CollectFreeSymbols(*quote->Value, slots, freeSymbols, evaluatesData);
+  }
+}
+
+// Formals and let-bound names get a fixed index in the stack frame, symbols
+// in the body that refer to them are tagged with it
+void InterpretedFunction::ResolveSlots(Expression &code) {
+  vector<Atom> slots;
+  for (auto &arg : Args) {
+    if (auto *formal = TypeHelper::GetValue<::Symbol>(arg))
+      AddSlot(slots, formal->Value);
+  }
+  CollectLetSlots(code, slots);
+
+  vector<Atom> freeSymbols;
+  CollectFreeSymbols(code, slots, freeSymbols, EvaluatesData);
+  if (!freeSymbols.empty())
+    FreeSymbols = make_shared<const vector<Atom>>(move(freeSymbols));
+
+  if (!slots.empty()) {
+    AssignSlots(code, slots);
+    Slots = make_shared<const vector<Atom>>(move(slots));
+  }
+}
+
 //=============================================================================
 
 const ExpressionPtr TypeHelper::Null;
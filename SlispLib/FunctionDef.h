@@ -11,11 +11,26 @@
 
 class EvaluationContext;
 class ArgDef;
+class CodeBlock;
 
 using SlipFunction = std::function<bool(EvaluationContext&)>;
 using ExpressionEvaluator = std::function<bool(ExpressionPtr &)>;
 using ArgDefPtr = std::unique_ptr<ArgDef>;
 
+// Arguments a FuncDef accepts, flattened once so a call can be checked
+// without virtual dispatch. Types holds the type of each argument, the last
+// one repeats, and an empty Types accepts anything.
+struct ArgSignature {
+  size_t                       MinArgs;
+  size_t                       MaxArgs;
+  std::vector<const TypeInfo*> Types;
+
+  bool IsArgCountValid(size_t nArgs) const;
+  const TypeInfo* GetType(size_t argIdx) const;
+  std::string ArgCountError(size_t nArgs) const;
+  bool Matches(const ArgList &args) const;
+};
+
 class ArgDef {
   public:
     static const size_t NO_ARGS = 0;
@@ -25,13 +40,11 @@ class ArgDef {
     virtual ArgDefPtr Clone() const = 0;
     virtual bool operator==(const ArgDef &rhs) const = 0;
     virtual const std::string ToString() const = 0;
-    bool Validate(ExpressionEvaluator evaluator, ExpressionPtr &expr, std::string &error) const;
+    virtual const TypeInfo* GetArgType(size_t argIdx, size_t nArgs) const = 0;
+    virtual ArgSignature GetSignature() const = 0;
 
   protected:
-    virtual bool ValidateArgs(ExpressionEvaluator evaluator, ArgList &args, std::string &error) const = 0;
-    bool CheckArgCount(size_t expectedMin, size_t expectedMax, ArgList &args, std::string &error) const;
-    bool CheckArgCount(size_t expected, ArgList &args, std::string &error) const;
-    bool CheckArg(ExpressionEvaluator evaluator, ExpressionPtr &arg, const TypeInfo &expectedType, size_t argNum, std::string &error) const;
+    static bool IsArgCountValid(size_t expectedMin, size_t expectedMax, size_t actualArgCount);
 };
 
 class FuncDef {
@@ -46,9 +59,14 @@ class FuncDef {
     static ArgDefPtr ManyArgs(const TypeInfo &type, size_t minArgs, size_t maxArgs);
     static ArgDefPtr Args(std::initializer_list<const TypeInfo*> &&args);
 
+    enum Flags {
+      Standard    = 0,
+      MutatesArgs = 1 << 0, // keeps or changes a value it is given, so it can't be given one by ref
+    };
+
     std::string Name;
 
-    explicit FuncDef(ArgDefPtr in, ArgDefPtr out);
+    explicit FuncDef(ArgDefPtr in, ArgDefPtr out, int flags = Standard);
     FuncDef(const FuncDef &val);
     FuncDef(FuncDef &&rval);
     FuncDef Clone() const;
@@ -57,7 +75,10 @@ class FuncDef {
     FuncDef& operator=(FuncDef);
     void Swap(FuncDef &func);
     const std::string ToString() const;
-    bool ValidateArgs(ExpressionEvaluator evaluator, ExpressionPtr &expr, std::string &error);
+    bool ValidateArgs(const ExpressionEvaluator &evaluator, ExpressionPtr &expr, std::string &error) const;
+    const TypeInfo* GetArgType(size_t argIdx, size_t nArgs) const;
+    const ArgSignature& GetSignature() const;
+    bool HasFlag(Flags flag) const;
 
   private:
     class VarArgDef: public ArgDef {
@@ -66,6 +87,8 @@ class FuncDef {
         explicit VarArgDef(const TypeInfo &type, size_t minArgs, size_t maxArgs);
         virtual ArgDefPtr Clone() const override;
         virtual const std::string ToString() const override;
+        virtual const TypeInfo* GetArgType(size_t argIdx, size_t nArgs) const override;
+        virtual ArgSignature GetSignature() const override;
         virtual bool operator==(const ArgDef &rhs) const override;
         bool operator==(const VarArgDef &rhs) const;
 
@@ -74,11 +97,7 @@ class FuncDef {
         size_t MinArgs;
         size_t MaxArgs;
 
-        virtual bool ValidateArgs(ExpressionEvaluator evaluator, ArgList &args, std::string &error) const override;
-
         bool IsAnyArgs() const;
-        bool ValidateArgCount(ArgList &args, std::string &error) const;
-        bool ValidateArgTypes(ExpressionEvaluator evaluator, ArgList &args, std::string &error) const;
     };
 
     class ListArgDef: public ArgDef {
@@ -86,17 +105,24 @@ class FuncDef {
         explicit ListArgDef(std::initializer_list<const TypeInfo*> &&types);
         virtual ArgDefPtr Clone() const override;
         virtual const std::string ToString() const override;
+        virtual const TypeInfo* GetArgType(size_t argIdx, size_t nArgs) const override;
+        virtual ArgSignature GetSignature() const override;
         virtual bool operator==(const ArgDef &rhs) const override;
         bool operator==(const ListArgDef &rhs) const;
 
       private:
         std::vector<const TypeInfo*> Types;
-
-        virtual bool ValidateArgs(ExpressionEvaluator evaluator, ArgList &args, std::string &error) const override;
     };
 
-    ArgDefPtr In;
-    ArgDefPtr Out;
+    // Never changed once built, so copies of a definition share them
+    std::shared_ptr<const ArgDef>       In;
+    std::shared_ptr<const ArgDef>       Out;
+    std::shared_ptr<const ArgSignature> Signature;
+    int                                 Flags_;
+
+    static ArgSignature BuildSignature(const ArgDef *argDef);
+    static bool CheckArg(const ExpressionEvaluator &evaluator, ExpressionPtr &arg, const TypeInfo &expectedType, size_t argNum, std::string &error);
+    bool WrongArgs(const std::string &what, std::string &error) const;
 };
 
 // Begin 0.2
@@ -139,9 +165,7 @@ struct Function: public Literal {
 
   FuncDef Def;
   ExpressionPtr Symbol;
-  std::vector<std::string> Signatures;
-  std::string Doc;
-  std::vector<ExampleDef> Examples;
+  Atom DocName; // builtin's name in the FunctionDocs, kept by aliases
 
   explicit Function(const SourceContext &sourceContext, const TypeInfo &typeInfo);
   explicit Function(const SourceContext &sourceContext, const TypeInfo &typeInfo, FuncDef &&func);
@@ -175,9 +199,13 @@ struct InterpretedFunction: public Function {
   static const TypeInfo TypeInstance;
   static const InterpretedFunction Null;
 
-  Quote           Code;
-  ArgList         Args;
-  SymbolTableType Closure;
+  ConstExpressionPtr Code;
+  ArgList            Args;
+  SymbolTableType    Closure;
+  std::shared_ptr<const CodeBlock> CompiledCode;
+  std::shared_ptr<const std::vector<Atom>> Slots;
+  std::shared_ptr<const std::vector<Atom>> FreeSymbols; // names in the body that aren't slots, the locals a closure captures
+  bool               EvaluatesData; // the body turns data into code, which may name any local, so a closure captures them all
 
   explicit InterpretedFunction(const SourceContext &sourceContext, FuncDef &&def, ExpressionPtr &&code, ArgList &&args);
   explicit InterpretedFunction(const InterpretedFunction &rhs);
@@ -186,6 +214,9 @@ struct InterpretedFunction: public Function {
   virtual bool operator==(const Expression &rhs) const override;
   bool operator==(const InterpretedFunction &rhs) const;
   bool operator!=(const InterpretedFunction &rhs) const;
+
+private:
+  void ResolveSlots(Expression &code);
 };
 
 // TODO: add tests
@@ -280,6 +311,7 @@ inline bool TypeHelper::IsA<Literal>(const TypeInfo &type) {
       || SimpleIsA<Literal>(type)
       || SimpleIsA<Quote>(type)
       || SimpleIsA<Ref>(type)
+      || SimpleIsA<Dict>(type)
       ; 
 }
 
@@ -0,0 +1,50 @@
+#include <string>
+#include <vector>
+
+#include "FunctionDocs.h"
+
+using namespace std;
+
+const FunctionDoc FunctionDocs::Empty {};
+
+FunctionDocs::FunctionDocs():
+  Entries(),
+  MaterializedCount(0)
+{
+}
+
+void FunctionDocs::Register(const Atom &name, initializer_list<const char*> signatures, const char *doc, initializer_list<ExampleText> examples) {
+  Entry &entry = Entries[name];
+  if (entry.Materialized)
+    --MaterializedCount;
+  entry.Signatures.assign(signatures);
+  entry.Doc = doc;
+  entry.Examples.assign(examples);
+  entry.Materialized.reset();
+}
+
+const FunctionDoc& FunctionDocs::Find(const Atom &name) {
+  auto it = Entries.find(name);
+  if (it == Entries.end())
+    return Empty;
+
+  Entry &entry = it->second;
+  if (!entry.Materialized) {
+    auto *doc = new FunctionDoc();
+    doc->Signatures.assign(begin(entry.Signatures), end(entry.Signatures));
+    doc->Doc = entry.Doc;
+    for (auto &example : entry.Examples)
+      doc->Examples.push_back(ExampleDef { example.Code, example.ExpectedValue });
+    entry.Materialized.reset(doc);
+    ++MaterializedCount;
+  }
+  return *entry.Materialized;
+}
+
+size_t FunctionDocs::GetCount() const {
+  return Entries.size();
+}
+
+size_t FunctionDocs::GetMaterializedCount() const {
+  return MaterializedCount;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <initializer_list>
+
+#include "Atom.h"
+#include "FunctionDef.h"
+
+struct ExampleText {
+  const char *Code;
+  const char *ExpectedValue;
+};
+
+struct FunctionDoc {
+  std::vector<std::string> Signatures;
+  std::string              Doc;
+  std::vector<ExampleDef>  Examples;
+};
+
+// Help for builtin functions, kept apart from the function values so cloning
+// a function doesn't copy it. Registering only keeps pointers to the string
+// literals, the strings are built the first time a function's help is asked for.
+class FunctionDocs {
+  public:
+    static const FunctionDoc Empty;
+
+    explicit FunctionDocs();
+    void Register(const Atom &name, std::initializer_list<const char*> signatures, const char *doc, std::initializer_list<ExampleText> examples);
+    const FunctionDoc& Find(const Atom &name);
+    size_t GetCount() const;
+    size_t GetMaterializedCount() const;
+
+  private:
+    struct Entry {
+      std::vector<const char*>     Signatures;
+      const char                   *Doc;
+      std::vector<ExampleText>     Examples;
+      std::unique_ptr<FunctionDoc> Materialized;
+    };
+
+    std::unordered_map<Atom, Entry> Entries;
+    size_t                          MaterializedCount;
+};
@@ -5,7 +5,7 @@
 #include <memory>
 #include <algorithm>
 #include <iterator>
-#include <sstream>
+#include <unordered_map>
 
 #include "Interpreter.h"
 #include "Expression.h"
@@ -27,8 +27,13 @@ StackFrame::StackFrame(Interpreter &interp, InterpretedFunction &&func):
   Locals { LocalStore, func.GetSourceContext() },
   Closure { func.Closure, func.GetSourceContext() },
   Dynamics { interp.GetDynamicSymbols(func.GetSourceContext()) },
-  DynamicScope { Dynamics, func.GetSourceContext() }
+  DynamicScope { Dynamics, func.GetSourceContext() },
+  SlotNames { func.Slots },
+  Slots { },
+  TailCallers { }
 {
+  if (SlotNames)
+    Slots.resize(SlotNames->size());
   Interp.PushStackFrame(*this);
 }
 
@@ -36,11 +41,15 @@ StackFrame::~StackFrame() {
   Interp.PopStackFrame();
 }
 
-void StackFrame::PutSymbol(const string &symbolName, ExpressionPtr &value) {
+void StackFrame::PutSymbol(const Atom &symbolName, ExpressionPtr &value) {
   return PutSymbol(symbolName, move(value));
 }
 
-void StackFrame::PutSymbol(const string &symbolName, ExpressionPtr &&value) {
+void StackFrame::PutSymbol(const Atom &symbolName, ExpressionPtr &&value) {
+  size_t slot;
+  if (FindBoundSlot(symbolName, slot))
+    return SymbolTable::StoreValue(symbolName, Slots[slot], move(value));
+
   ExpressionPtr existingValue;
   if (Closure.GetSymbol(symbolName, existingValue))
     Closure.PutSymbol(symbolName, value);
@@ -53,7 +62,11 @@ void StackFrame::PutSymbol(const string &symbolName, ExpressionPtr &&value) {
   }
 }
 
-void StackFrame::PutLocalSymbol(const string &symbolName, ExpressionPtr &&value) {
+void StackFrame::PutLocalSymbol(const Atom &symbolName, ExpressionPtr &&value) {
+  size_t slot;
+  if (FindSlot(symbolName, slot))
+    return SymbolTable::StoreValue(symbolName, Slots[slot], move(value));
+
   Expression *existingSymbol = nullptr;
   if (Closure.GetSymbol(symbolName, existingSymbol)) {
     return Closure.PutSymbol(symbolName, value);
@@ -61,20 +74,25 @@ void StackFrame::PutLocalSymbol(const string &symbolName, ExpressionPtr &&value)
   Locals.PutSymbol(symbolName, value);
 }
 
-void StackFrame::PutLocalSymbol(const string &symbolName, ExpressionPtr &value) {
+void StackFrame::PutLocalSymbol(const Atom &symbolName, ExpressionPtr &value) {
   PutLocalSymbol(symbolName, move(value));
 }
 
-void StackFrame::PutDynamicSymbol(const string &symbolName, ExpressionPtr &&value) {
+void StackFrame::PutDynamicSymbol(const Atom &symbolName, ExpressionPtr &&value) {
   DynamicScope.PutSymbol(symbolName, value);
 }
 
-void StackFrame::PutDynamicSymbol(const string &symbolName, ExpressionPtr &value) {
+void StackFrame::PutDynamicSymbol(const Atom &symbolName, ExpressionPtr &value) {
   PutDynamicSymbol(symbolName, move(value));
 }
 
-bool StackFrame::GetSymbol(const string &symbolName, ExpressionPtr &valueCopy) {
-  if (Closure.GetSymbol(symbolName, valueCopy))
+bool StackFrame::GetSymbol(const Atom &symbolName, ExpressionPtr &valueCopy) {
+  size_t slot;
+  if (FindBoundSlot(symbolName, slot)) {
+    SymbolTable::LoadValue(Slots[slot], valueCopy);
+    return true;
+  }
+  else if (Closure.GetSymbol(symbolName, valueCopy))
     return true;
   else if (Locals.GetSymbol(symbolName, valueCopy))
     return true;
@@ -82,8 +100,13 @@ bool StackFrame::GetSymbol(const string &symbolName, ExpressionPtr &valueCopy) {
     return Dynamics.GetSymbol(symbolName, valueCopy);
 }
 
-bool StackFrame::GetSymbol(const string &symbolName, Expression *&value) {
-  if (Closure.GetSymbol(symbolName, value))
+bool StackFrame::GetSymbol(const Atom &symbolName, Expression *&value) {
+  size_t slot;
+  if (FindBoundSlot(symbolName, slot)) {
+    value = Slots[slot].get();
+    return true;
+  }
+  else if (Closure.GetSymbol(symbolName, value))
     return true;
   else if (Locals.GetSymbol(symbolName, value))
     return true;
@@ -91,7 +114,33 @@ bool StackFrame::GetSymbol(const string &symbolName, Expression *&value) {
     return Dynamics.GetSymbol(symbolName, value);
 }
 
-void StackFrame::DeleteSymbol(const string &symbolName) {
+// Symbols in a function body carry the slot they were resolved to, which
+// only holds if the symbol is being evaluated in that function's frame
+bool StackFrame::GetSymbol(const Symbol &symbol, ExpressionPtr &valueCopy) {
+  size_t slot = symbol.Slot;
+  if (slot < Slots.size() && (*SlotNames)[slot] == symbol.Value && Slots[slot]) {
+    SymbolTable::LoadValue(Slots[slot], valueCopy);
+    return true;
+  }
+  else
+    return GetSymbol(symbol.Value, valueCopy);
+}
+
+bool StackFrame::GetSymbol(const Symbol &symbol, Expression *&value) {
+  size_t slot = symbol.Slot;
+  if (slot < Slots.size() && (*SlotNames)[slot] == symbol.Value && Slots[slot]) {
+    value = Slots[slot].get();
+    return true;
+  }
+  else
+    return GetSymbol(symbol.Value, value);
+}
+
+void StackFrame::DeleteSymbol(const Atom &symbolName) {
+  size_t slot;
+  if (FindBoundSlot(symbolName, slot))
+    return Slots[slot].reset();
+
   ExpressionPtr value;
   if (Closure.GetSymbol(symbolName, value))
     Closure.DeleteSymbol(symbolName);
@@ -109,18 +158,128 @@ SymbolTable& StackFrame::GetLocalSymbols() {
   return Locals;
 }
 
+// Looks at the frame's own symbols and its function's closure, not globals
+bool StackFrame::GetLocalSymbol(const Atom &symbolName, Expression *&value) {
+  size_t slot;
+  if (FindBoundSlot(symbolName, slot)) {
+    value = Slots[slot].get();
+    return true;
+  }
+  else if (Closure.GetSymbol(symbolName, value))
+    return true;
+  else
+    return Locals.GetSymbol(symbolName, value);
+}
+
+// Visits the same symbols as GetLocalSymbol, a name is visited first where
+// GetLocalSymbol would find it
+void StackFrame::ForEachLocal(function<void(const Atom &, ExpressionPtr &)> fn) {
+  for (size_t slot = 0; slot < Slots.size(); ++slot) {
+    if (Slots[slot])
+      fn((*SlotNames)[slot], Slots[slot]);
+  }
+  Closure.ForEach(fn);
+  Locals.ForEach(fn);
+}
+
 InterpretedFunction& StackFrame::GetFunction() {
   return Func;
 }
+
+// Functions that were replaced by this one through tail calls, oldest first
+void StackFrame::SetTailCallers(const vector<Atom> &tailCallers) {
+  TailCallers = &tailCallers;
+}
+
+const vector<Atom>* StackFrame::GetTailCallers() const {
+  return TailCallers;
+}
+
+bool StackFrame::FindSlot(const Atom &symbolName, size_t &slot) const {
+  for (slot = 0; slot < Slots.size(); ++slot) {
+    if ((*SlotNames)[slot] == symbolName)
+      return true;
+  }
+  return false;
+}
+
+ExpressionPtr& StackFrame::GetSlot(size_t slot) {
+  return Slots[slot];
+}
+
+bool StackFrame::FindBoundSlot(const Atom &symbolName, size_t &slot) const {
+  return FindSlot(symbolName, slot) && Slots[slot];
+}
+
 //=============================================================================
 
-EvaluationContext::EvaluationContext(Interpreter &interpreter, CompiledFunction &compiledFunction, Symbol &currentFunction, ExpressionPtr &expr, ArgList &args):
+LocalScope::LocalScope(StackFrame &frame, const SourceContext &sourceContext):
+  Frame { frame },
+  Locals { frame.GetLocalSymbols(), sourceContext },
+  ShadowedSlots { }
+{
+}
+
+LocalScope::~LocalScope() {
+  for (auto shadowed = ShadowedSlots.rbegin(); shadowed != ShadowedSlots.rend(); ++shadowed)
+    Frame.GetSlot(shadowed->first) = move(shadowed->second);
+}
+
+void LocalScope::PutSymbol(const Atom &symbolName, ExpressionPtr &&value) {
+  size_t slot;
+  if (Frame.FindSlot(symbolName, slot)) {
+    auto &stored = Frame.GetSlot(slot);
+    if (!IsScopedSymbol(symbolName))
+      ShadowedSlots.emplace_back(slot, move(stored));
+    SymbolTable::StoreValue(symbolName, stored, move(value));
+  }
+  else
+    Locals.PutSymbol(symbolName, move(value));
+}
+
+void LocalScope::PutSymbol(const Atom &symbolName, ExpressionPtr &value) {
+  PutSymbol(symbolName, move(value));
+}
+
+// For a symbol pointed at something new each time, like a loop variable
+// bound to a ref to the current item
+void LocalScope::RebindSymbol(const Atom &symbolName, ExpressionPtr &&value) {
+  size_t slot;
+  if (Frame.FindSlot(symbolName, slot)) {
+    auto &stored = Frame.GetSlot(slot);
+    if (!IsScopedSymbol(symbolName))
+      ShadowedSlots.emplace_back(slot, move(stored));
+    stored.reset();
+    SymbolTable::StoreValue(symbolName, stored, move(value));
+  }
+  else
+    Locals.RebindSymbol(symbolName, move(value));
+}
+
+bool LocalScope::IsScopedSymbol(const Atom &symbolName) const {
+  size_t slot;
+  if (Frame.FindSlot(symbolName, slot)) {
+    for (auto &shadowed : ShadowedSlots) {
+      if (shadowed.first == slot)
+        return true;
+    }
+    return false;
+  }
+  else
+    return Locals.IsScopedSymbol(symbolName);
+}
+
+//=============================================================================
+
+EvaluationContext::EvaluationContext(Interpreter &interpreter, CompiledFunction &compiledFunction, Symbol &currentFunction, ExpressionPtr &expr, ArgList &args, bool isTail, bool isLazy):
   Interp(interpreter),
   CurrentFunction(currentFunction),
   Expr_(expr),
   Args(args),
   SourceContext_(compiledFunction.GetSourceContext()),
-  Factory(SourceContext_)
+  Factory(SourceContext_),
+  IsTail(isTail),
+  IsLazy(isLazy)
 {
 }
 
@@ -140,11 +299,26 @@ bool EvaluationContext::Evaluate(ExpressionPtr &expr, const string &argName) {
   return EvaluateNoError(expr) ? true : EvaluateError(argName);
 }
 
-bool EvaluationContext::GetSymbol(const string &symName, ExpressionPtr &valueCopy) {
+// For the expression whose value becomes the value of this call. When the
+// call is itself in tail position, a call to an interpreted function there
+// is left in expr for the enclosing function call to run.
+bool EvaluationContext::EvaluateTail(ExpressionPtr &expr, const string &argName) {
+  if (!IsTail)
+    return Evaluate(expr, argName);
+  return Interp.EvaluateTail(expr) ? true : EvaluateError(argName);
+}
+
+// For a list argument that is only iterated. Builtins that can produce their
+// values on demand leave a sequence in expr instead of building a list.
+bool EvaluationContext::EvaluateLazy(ExpressionPtr &expr, const string &argName) {
+  return Interp.EvaluateLazy(expr) ? true : EvaluateError(argName);
+}
+
+bool EvaluationContext::GetSymbol(const Atom &symName, ExpressionPtr &valueCopy) {
   return Interp.GetCurrentStackFrame().GetSymbol(symName, valueCopy);
 }
 
-bool EvaluationContext::GetSymbol(const string &symName, Expression *&value) {
+bool EvaluationContext::GetSymbol(const Atom &symName, Expression *&value) {
   return Interp.GetCurrentStackFrame().GetSymbol(symName, value);
 }
 
@@ -171,18 +345,10 @@ Sexp* EvaluationContext::GetList(ExpressionPtr &expr) {
   return result;
 }
 
+// The name the function was defined under, which a builtin called without
+// a call form also has
 const string EvaluationContext::GetThisFunctionName() {
-  if (auto thisSexp = TypeHelper::GetValue<Sexp>(Expr_)) {
-    if (auto thisFn = TypeHelper::GetValue<Function>(thisSexp->Args.front())) {
-      if (thisFn->Symbol) {
-        if (auto thisFnSym = TypeHelper::GetValue<Symbol>(thisFn->Symbol)) {
-          return thisFnSym->Value;
-        }
-      }
-    }
-  }
-  Error("Failed to get current function name");
-  return "";
+  return CurrentFunction.Value;
 }
 
 bool EvaluationContext::Error(const string &what) {
@@ -194,6 +360,8 @@ bool EvaluationContext::EvaluateError(int argNum) {
 }
 
 bool EvaluationContext::EvaluateError(const string &argName) {
+  if (Interp.HasErrors())
+    return false;
   return Error("Failed to evaluate arg: " + argName);
 }
 
@@ -224,70 +392,84 @@ Interpreter::Interpreter(CommandInterface &cmdInterface):
   Modules { },
   SourceContext_ { CreateModule("Internal", "Internal"), 0 },
   DynamicSymbolStore { },
+  Docs { make_shared<FunctionDocs>() },
   DynamicSymbols { DynamicSymbolStore, SourceContext_ },
   Settings { DynamicSymbols },
   StackFrames { },
   MainFunc { SourceContext_ },
   MainFrame { *this, MainFunc },
-  TypeReducers { },
+  Compiler_ { },
+  VM { *this },
   Errors { },
   ErrorWhere { "Interpreter" },
-  ErrorStackTrace { },
+  ErrorFrames { },
+  ErrorTailCallers { },
+  PartialEvaluator { bind(&Interpreter::EvaluatePartialLoop, this, _1) },
   StopRequested_ { false },
+  TailPosition { false },
+  TailCallPending { false },
+  LazyPosition { false },
   ExitCode { 0 },
-  Environment_ { }
+  Environment_ { },
+  Profiler_ { nullptr }
 {
   MainFunc.Symbol.reset(new Symbol(SourceContext_, "__main__"));
-  RegisterReducers();
 }
 
 Interpreter::~Interpreter() {
-  for (auto it = begin(Modules); it != end(Modules); ++it)
-    delete it->second;
 }
 
 InterpreterSettings& Interpreter::GetSettings() {
   return Settings;
 }
 
-list<EvalError> Interpreter::GetErrors() const {
+const list<EvalError>& Interpreter::GetErrors() const {
   return Errors;
 }
 
+// Errors after the first one of a failure are dropped, callers check this
+// before building a message that would be
+bool Interpreter::HasErrors() const {
+  return !Errors.empty();
+}
+
 vector<string> Interpreter::GetErrorStackTrace() const {
   vector<string> errStackTrace;
-  copy(begin(ErrorStackTrace), end(ErrorStackTrace), back_inserter(errStackTrace));
+  auto tailCaller = begin(ErrorTailCallers);
+  for (auto &frame : ErrorFrames) {
+    string line = frame.Function.Name();
+    auto &src = frame.Where;
+    if (src.Module || src.LineNum)
+      line += " (" + (src.Module ? src.Module->FilePath : "<module>") + ":" + to_string(src.LineNum) + ")";
+    errStackTrace.push_back(move(line));
+    for (size_t i = 0; i < frame.NTailCallers; ++i, ++tailCaller)
+      errStackTrace.push_back(tailCaller->Name());
+  }
   return errStackTrace;
 }
 
-// TODO: Refactor
+// Only the first error of a failure records where it happened. The frames
+// are snapshotted, not formatted, since most errors are caught by (try) or
+// cleared without the trace ever being shown.
 bool Interpreter::PushError(const EvalError &error) {
   if (Errors.empty()) {
     Errors.push_back(error);
-    ErrorStackTrace.clear();
+    ErrorFrames.clear();
+    ErrorTailCallers.clear();
     for (size_t i = StackFrames.size(); i > 0; --i) {
-      stringstream ss;
       auto &frame = StackFrames[i - 1];
-      auto &fn = frame->GetFunction();
-      ss << fn.SymbolName();
+      SourceContext where = error.SourceContext_;
       if (i != StackFrames.size()) {
-        auto &fn2 = StackFrames[i]->GetFunction();
-        if (fn2.Symbol) {
-          auto &src = fn2.Symbol->GetSourceContext();
-          if (src.Module || src.LineNum)
-            ss << " (" 
-               << (src.Module ? src.Module->FilePath : "<module>") << ":" 
-               << src.LineNum << ")";
-        }
+        auto &callee = StackFrames[i]->GetFunction();
+        where = callee.Symbol ? callee.Symbol->GetSourceContext() : SourceContext();
       }
-      else {
-        if (error.SourceContext_.Module || error.SourceContext_.LineNum) {
-          ss << " (" 
-             << (error.SourceContext_.Module ? error.SourceContext_.Module->FilePath : "<module>") << ":" 
-             << error.SourceContext_.LineNum << ")";
-        }
+
+      size_t nTailCallers = 0;
+      if (auto tailCallers = frame->GetTailCallers()) {
+        ErrorTailCallers.insert(end(ErrorTailCallers), tailCallers->rbegin(), tailCallers->rend());
+        nTailCallers = tailCallers->size();
       }
-      ErrorStackTrace.push_back(ss.str());
+      ErrorFrames.push_back(ErrorFrame { frame->GetFunction().SymbolName(), where, nTailCallers });
     }
   }
   return false;
@@ -295,7 +477,8 @@ bool Interpreter::PushError(const EvalError &error) {
 
 void Interpreter::ClearErrors() {
   Errors.clear();
-  ErrorStackTrace.clear();
+  ErrorFrames.clear();
+  ErrorTailCallers.clear();
 }
 
 void Interpreter::Stop() {
@@ -315,7 +498,11 @@ void Interpreter::SetExitCode(int exitCode) {
 }
 
 SymbolTable Interpreter::GetDynamicSymbols(const SourceContext &sourceContext) {
-  return SymbolTable(DynamicSymbolStore, sourceContext);
+  return SymbolTable(DynamicSymbolStore, sourceContext, Docs.get());
+}
+
+FunctionDocs& Interpreter::GetFunctionDocs() {
+  return *Docs;
 }
 
 StackFrame& Interpreter::GetCurrentStackFrame() {
@@ -331,12 +518,16 @@ void Interpreter::PopStackFrame() {
 }
 
 bool Interpreter::EvaluatePartial(ExpressionPtr &expr) {
-  const TypeInfo *type = &(expr->Type());
-  auto search = TypeReducers.find(type);
-  if (search != TypeReducers.end())
-    return search->second(expr);
-  else
-    throw runtime_error("unknown type: ");
+  switch (expr->Type().Tag()) {
+    case TypeTag::Symbol:
+      return ReduceSymbol(expr);
+    case TypeTag::Sexp:
+      return ReduceSexp(expr);
+    case TypeTag::Other:
+      throw runtime_error("unknown type: " + expr->Type().Name());
+    default:
+      return true; // values evaluate to themselves
+  }
 }
 
 bool Interpreter::Evaluate(ExpressionPtr &expr) {
@@ -345,7 +536,21 @@ bool Interpreter::Evaluate(ExpressionPtr &expr) {
 
 bool Interpreter::Evaluate(ExpressionPtr &&expr) {
   ClearErrors();
-  return EvaluatePartial(expr);
+  TailPosition = false;
+  TailCallPending = false;
+  LazyPosition = false;
+  switch (Settings.GetEngine()) {
+    case EngineTypes::VM: {
+      CodeBlockPtr code = Compiler_.Compile(ConstExpressionPtr { move(expr) });
+      return VM.Run(*code, expr);
+    }
+    case EngineTypes::ImmutableTreeWalker: {
+      ConstExpressionPtr source { move(expr) };
+      return EvaluateInto(*source, expr);
+    }
+    default:
+      return EvaluatePartial(expr);
+  }
 }
 
 CommandInterface& Interpreter::GetCommandInterface() {
@@ -359,100 +564,178 @@ Environment& Interpreter::GetEnvironment() {
 ModuleInfo* Interpreter::CreateModule(const string &name, const string &filePath) {
   auto it = Modules.find(name);
   if (it != Modules.end()) {
-    ++(it->second->LoadCount);
-    return it->second;
+    ++(it->second.LoadCount);
+    return it->second.Info.get();
   }
   else {
-    unique_ptr<ModuleInfo> newModule { new ModuleInfo {name, filePath} };
+    shared_ptr<ModuleInfo> newModule { new ModuleInfo {name, filePath} };
     if (newModule) {
-      newModule->LoadCount = 1;
-      ModuleInfo *newModuleInfo = newModule.get();
-      Modules[name] = newModule.release();
-      return newModuleInfo;
+      Modules[name] = LoadedModule { newModule, 1 };
+      return newModule.get();
     }
     else
       return nullptr;
   }
 }
 
-bool Interpreter::GetCurrFrameSymbol(const string &symbolName, ExpressionPtr &value) {
-  return GetCurrentStackFrame().GetSymbol(symbolName, value);
+ModuleInfo* Interpreter::GetModule(const string &name) {
+  auto it = Modules.find(name);
+  return it != Modules.end() ? it->second.Info.get() : nullptr;
 }
 
-void Interpreter::RegisterReducers() {
-  TypeReducers[&Int::TypeInstance]      = bind(&Interpreter::ReduceInt,       this, _1);
-  TypeReducers[&Float::TypeInstance]    = bind(&Interpreter::ReduceFloat,     this, _1);
-  TypeReducers[&Str::TypeInstance]      = bind(&Interpreter::ReduceStr,       this, _1);
-  TypeReducers[&Bool::TypeInstance]     = bind(&Interpreter::ReduceBool,      this, _1);
-  TypeReducers[&Symbol::TypeInstance]   = bind(&Interpreter::ReduceSymbol,    this, _1);
-  TypeReducers[&InterpretedFunction::TypeInstance] = bind(&Interpreter::ReduceFunction,  this, _1);
-  TypeReducers[&CompiledFunction::TypeInstance] = bind(&Interpreter::ReduceFunction,  this, _1);
-  TypeReducers[&Sexp::TypeInstance]     = bind(&Interpreter::ReduceSexp,      this, _1);
-  TypeReducers[&Quote::TypeInstance]    = bind(&Interpreter::ReduceQuote,     this, _1);
-  TypeReducers[&Ref::TypeInstance]      = bind(&Interpreter::ReduceRef,       this, _1);
+uint32_t Interpreter::GetLoadCount(const string &name) const {
+  auto it = Modules.find(name);
+  return it != Modules.end() ? it->second.LoadCount : 0;
 }
 
-bool Interpreter::ReduceBool(ExpressionPtr &expr) {
-  return true;
+using SlotMap = unordered_map<const ExpressionPtr*, ExpressionPtr*>;
+
+static bool HasRefs(const Expression &expr) {
+  switch (expr.Type().Tag()) {
+    case TypeTag::Ref:
+      return true;
+    case TypeTag::Quote:
+      return HasRefs(*static_cast<const Quote&>(expr).Value);
+    case TypeTag::Sexp:
+      for (auto &arg : static_cast<const Sexp&>(expr).Args) {
+        if (arg && HasRefs(*arg))
+          return true;
+      }
+      return false;
+    default:
+      if (auto *fn = dynamic_cast<const InterpretedFunction*>(&expr)) {
+        for (auto &captured : fn->Closure) {
+          if (captured.second && HasRefs(*captured.second))
+            return true;
+        }
+      }
+      return false;
+  }
 }
 
-bool Interpreter::ReduceInt(ExpressionPtr &expr) {
-  return true;
+// Refs to globals are pointed at the copies of those globals, anything else
+// a ref points to is copied in its place
+static void RebindRefs(ExpressionPtr &expr, const SlotMap &slots) {
+  if (!expr || !HasRefs(*expr))
+    return;
+
+  switch (expr->Type().Tag()) {
+    case TypeTag::Ref: {
+      auto &ref = static_cast<Ref&>(*expr);
+      auto slot = slots.find(&ref.Value);
+      if (slot != slots.end())
+        expr.reset(new Ref(ref.GetSourceContext(), *slot->second));
+      else {
+        expr = ref.Value->Clone();
+        RebindRefs(expr, slots);
+      }
+      break;
+    }
+    case TypeTag::Quote:
+      RebindRefs(static_cast<Quote&>(*expr).Value, slots);
+      break;
+    case TypeTag::Sexp:
+      for (auto &arg : static_cast<Sexp&>(*expr).Args)
+        RebindRefs(arg, slots);
+      break;
+    default:
+      for (auto &captured : static_cast<InterpretedFunction&>(*expr).Closure)
+        RebindRefs(captured.second, slots);
+      break;
+  }
 }
 
-bool Interpreter::ReduceFloat(ExpressionPtr &expr) {
-  return true;
+static void CopySymbols(const SymbolTableType &from, SymbolTableType &to) {
+  SlotMap slots;
+  slots.reserve(from.size());
+  to.clear();
+  to.reserve(from.size());
+  for (auto &symbol : from) {
+    ExpressionPtr &slot = to[symbol.first];
+    if (symbol.second)
+      slot = symbol.second->Clone();
+    slots[&symbol.second] = &slot;
+  }
+  for (auto &symbol : to)
+    RebindRefs(symbol.second, slots);
 }
 
-bool Interpreter::ReduceStr(ExpressionPtr &expr) {
-  return true;
+InterpreterSnapshot Interpreter::TakeSnapshot() {
+  InterpreterSnapshot snapshot;
+  CopySymbols(DynamicSymbolStore, snapshot.Symbols);
+  snapshot.InfixSymbols = Settings.GetInfixSymbols();
+  snapshot.Modules = Modules;
+  snapshot.Docs = Docs;
+  return snapshot;
 }
 
-bool Interpreter::ReduceFunction(ExpressionPtr &expr) {
-  return true;
+// The snapshot's modules and help are shared, the modules this interpreter
+// already has are kept
+void Interpreter::Restore(const InterpreterSnapshot &snapshot) {
+  CopySymbols(snapshot.Symbols, DynamicSymbolStore);
+  Settings.SetInfixSymbols(snapshot.InfixSymbols);
+  Modules.insert(begin(snapshot.Modules), end(snapshot.Modules));
+  Docs = snapshot.Docs;
 }
 
-bool Interpreter::ReduceQuote(ExpressionPtr &expr) {
-  return true;
+void Interpreter::SetProfiler(Profiler *profiler) {
+  Profiler_ = profiler;
 }
 
-bool Interpreter::ReduceRef(ExpressionPtr &expr) {
-  return true;
+bool Interpreter::GetCurrFrameSymbol(const Atom &symbolName, ExpressionPtr &value) {
+  return GetCurrentStackFrame().GetSymbol(symbolName, value);
 }
 
 bool Interpreter::ReduceSymbol(ExpressionPtr &expr) {
   auto symbol = static_cast<Symbol*>(expr.get());
-  ExpressionPtr symCopy = symbol->Clone();
   ExpressionPtr value;
-  if (GetCurrFrameSymbol(symbol->Value, value) && value) {
+  if (EvaluateSymbol(*symbol, value)) {
+    expr = move(value);
+    return true;
+  }
+  else
+    return false;
+}
+
+bool Interpreter::EvaluateSymbol(const Symbol &symbol, ExpressionPtr &result) {
+  ExpressionPtr value;
+  if (GetCurrentStackFrame().GetSymbol(symbol, value) && value) {
     if (EvaluatePartial(value) && value) {
-      if (auto copy = value->Clone()) {
-        if (copy) {
-          expr = move(copy);
-          return true;
-        }
-        else
-          throw runtime_error("Clone() didn't return an Expression");
-      }
-      else
-        return PushError(EvalError { ErrorWhere, "Copying symbol value failed: " + value->ToString() });
+      result = move(value);
+      return true;
     }
+    else if (HasErrors())
+      return false;
     else
       return PushError(EvalError { ErrorWhere, "Evaluation failed: " + value->ToString() });
   }
   else
-    return PushError(EvalError { ErrorWhere, "Unknown symbol: " + symbol->Value });
+    return PushError(EvalError { ErrorWhere, "Unknown symbol: " + symbol.Value.Name() });
 }
 
 bool Interpreter::EvaluatePartialLoop(ExpressionPtr &expr) {
   do {
     if (!EvaluatePartial(expr))
-      return PushError(EvalError { ErrorWhere, "Evaluation failed: " + expr->ToString() });
-  } while (dynamic_cast<Symbol*>(expr.get()));
+      return HasErrors() ? false : PushError(EvalError { ErrorWhere, "Evaluation failed: " + expr->ToString() });
+  } while (expr->Type().Tag() == TypeTag::Symbol);
   return true;
 }
 
+bool Interpreter::EvaluateTail(ExpressionPtr &expr) {
+  TailPosition = TypeHelper::SimpleIsA<Sexp>(expr);
+  return EvaluatePartial(expr);
+}
+
+bool Interpreter::EvaluateLazy(ExpressionPtr &expr) {
+  LazyPosition = TypeHelper::SimpleIsA<Sexp>(expr);
+  return EvaluatePartial(expr);
+}
+
 bool Interpreter::ReduceSexp(ExpressionPtr &expr) {
+  bool isTail = TailPosition;
+  bool isLazy = LazyPosition;
+  TailPosition = false;
+  LazyPosition = false;
   auto sexp = static_cast<Sexp*>(expr.get());
   auto &args = sexp->Args;
   int argNum = 0;
@@ -466,7 +749,7 @@ bool Interpreter::ReduceSexp(ExpressionPtr &expr) {
     args.push_front(move(firstArg));
     auto &funcExpr = args.front();
     if (auto func = TypeHelper::GetValue<Function>(funcExpr))
-      return ReduceSexpFunction(expr, *func);
+      return ReduceSexpFunction(expr, *func, isTail, isLazy);
     else if (TypeHelper::TypeMatches(Literal::TypeInstance, funcExpr.get()->Type())) 
       return ReduceSexpList(expr, args);
     else
@@ -476,41 +759,315 @@ bool Interpreter::ReduceSexp(ExpressionPtr &expr) {
     return ReduceSexpList(expr, args);
 }
 
-bool Interpreter::ReduceSexpFunction(ExpressionPtr &expr, Function &function) {
+// Applies a call form whose head has already been evaluated. Arguments the
+// function evaluates are produced by evaluateArg, the rest are copied as is.
+bool Interpreter::EvaluateCall(const Sexp &form, ExpressionPtr &head, const ArgEvaluator &evaluateArg, ExpressionPtr &result, bool isTail) {
+  ExpressionPtr callExpr { new Sexp { form.GetSourceContext() } };
+  auto &callArgs = static_cast<Sexp*>(callExpr.get())->Args;
+  auto formArg = next(begin(form.Args));
+  auto formEnd = end(form.Args);
+
+  if (auto func = TypeHelper::GetValue<Function>(head)) {
+    auto &funcDef = func->Def;
+    size_t nArgs = form.Args.size() - 1;
+    callArgs.push_back(move(head));
+    for (size_t argIdx = 0; formArg != formEnd; ++formArg, ++argIdx) {
+      auto *expectedType = funcDef.GetArgType(argIdx, nArgs);
+      if (expectedType && !TypeHelper::TypeMatches(*expectedType, (*formArg)->Type())) {
+        ExpressionPtr value;
+        if (!evaluateArg(argIdx, value))
+          return HasErrors() ? false : InvalidArgumentsError(*func, "Argument " + to_string(argIdx + 1) + ": Failed to evaluate");
+        bool typeMatches = TypeHelper::TypeMatches(*expectedType, value);
+        callArgs.push_back(move(value));
+        if (!typeMatches)
+          break;
+      }
+      else
+        callArgs.push_back((*formArg)->Clone());
+    }
+    for (; formArg != formEnd; ++formArg)
+      callArgs.push_back((*formArg)->Clone());
+
+    auto evaluated = [](ExpressionPtr &) { return true; };
+    if (ReduceSexpFunction(callExpr, *func, evaluated, isTail, false)) {
+      result = move(callExpr);
+      return true;
+    }
+    else
+      return false;
+  }
+  else if (TypeHelper::TypeMatches(Literal::TypeInstance, head->Type())) {
+    callArgs.push_back(move(head));
+    for (; formArg != formEnd; ++formArg)
+      callArgs.push_back((*formArg)->Clone());
+    if (ReduceSexpList(callExpr, callArgs)) {
+      result = move(callExpr);
+      return true;
+    }
+    else
+      return false;
+  }
+  else
+    return PushError(EvalError { ErrorWhere, "Expecting function: " + head->ToString() });
+}
+
+// Calls function with arguments that are already values. An interpreted
+// function, or a builtin the arguments fit, is called without a call form.
+// Other builtins get one so the arguments are checked and reported as usual.
+bool Interpreter::CallFunction(ExpressionPtr &function, ArgList &args, ExpressionPtr &result) {
+  auto func = TypeHelper::GetValue<Function>(function);
+  if (!func)
+    return PushError(EvalError { ErrorWhere, "Expecting function: " + function->ToString() });
+
+  if (auto interpretedFunction = dynamic_cast<InterpretedFunction*>(func))
+    return ReduceSexpInterpretedFunction(result, *interpretedFunction, args);
+
+  // The builtin's errors are reported where the function came from, like
+  // they are for a call form
+  auto compiledFunction = dynamic_cast<CompiledFunction*>(func);
+  if (compiledFunction && func->Def.GetSignature().Matches(args)) {
+    result.reset(new Ref(function->GetSourceContext(), function));
+    return ReduceSexpCompiledFunction(result, *compiledFunction, args, false, false);
+  }
+
+  result.reset(new Sexp { function->GetSourceContext() });
+  auto &callArgs = static_cast<Sexp&>(*result).Args;
+  if (auto ref = dynamic_cast<Ref*>(function.get()))
+    callArgs.push_back(ref->NewRef());
+  else
+    callArgs.emplace_back(new Ref(function->GetSourceContext(), function));
+  while (!args.empty()) {
+    callArgs.push_back(move(args.front()));
+    args.pop_front();
+  }
+  return ReduceSexpFunction(result, *func, false, false);
+}
+
+// Evaluates a statement that is run repeatedly, like a loop body, in the
+// selected engine. The VM compiles it into compiled on first use.
+bool Interpreter::EvaluateStatement(const Expression &expr, CodeBlockPtr &compiled, ExpressionPtr &result) {
+  switch (Settings.GetEngine()) {
+    case EngineTypes::VM:
+      if (!compiled)
+        compiled = Compiler_.Compile(expr);
+      return VM.Run(*compiled, result);
+    case EngineTypes::ImmutableTreeWalker:
+      return EvaluateInto(expr, result);
+    default:
+      result = expr.Clone();
+      return EvaluatePartial(result);
+  }
+}
+
+// Evaluates expr without modifying it, the value is left in result
+bool Interpreter::EvaluateInto(const Expression &expr, ExpressionPtr &result) {
+  auto &type = expr.Type();
+  if (&type == &Symbol::TypeInstance)
+    return EvaluateSymbol(static_cast<const Symbol&>(expr), result);
+  else if (&type == &Sexp::TypeInstance && !static_cast<const Sexp&>(expr).Args.empty())
+    return EvaluateSexpInto(static_cast<const Sexp&>(expr), result, false);
+  else if (TypeHelper::IsA<Literal>(type)) {
+    result = expr.Clone();
+    return true;
+  }
+  else {
+    ExpressionPtr exprCopy = expr.Clone();
+    if (EvaluatePartial(exprCopy)) {
+      result = move(exprCopy);
+      return true;
+    }
+    else
+      return false;
+  }
+}
+
+bool Interpreter::EvaluateTailInto(const Expression &expr, ExpressionPtr &result) {
+  if (&expr.Type() == &Sexp::TypeInstance && !static_cast<const Sexp&>(expr).Args.empty())
+    return EvaluateSexpInto(static_cast<const Sexp&>(expr), result, true);
+  else
+    return EvaluateInto(expr, result);
+}
+
+static const Atom IfSymbol { "if" };
+static const Atom BeginSymbol { "begin" };
+
+bool Interpreter::EvaluateSexpInto(const Sexp &form, ExpressionPtr &result, bool isTail) {
+  auto &headExpr = *form.Args.front();
+  size_t nArgs = form.Args.size() - 1;
+  if (&headExpr.Type() == &Symbol::TypeInstance) {
+    auto &name = static_cast<const Symbol&>(headExpr).Value;
+    if (name == IfSymbol && (nArgs == 2 || nArgs == 3) && IsBuiltin(name))
+      return EvaluateIfInto(form, result, isTail);
+    else if (name == BeginSymbol && nArgs >= 1 && IsBuiltin(name))
+      return EvaluateBeginInto(form, result, isTail);
+  }
+
+  ExpressionPtr head;
+  if (!EvaluateInto(headExpr, head))
+    return false;
+  while (TypeHelper::SimpleIsA<Symbol>(head)) {
+    if (!EvaluatePartial(head))
+      return false;
+  }
+
+  auto evaluateArg = [this, &form](size_t argIdx, ExpressionPtr &value) {
+    return EvaluateInto(*form.Args[argIdx + 1], value);
+  };
+  return EvaluateCall(form, head, evaluateArg, result, isTail);
+}
+
+bool Interpreter::EvaluateIfInto(const Sexp &form, ExpressionPtr &result, bool isTail) {
+  auto arg = next(begin(form.Args));
+  ExpressionPtr cond;
+  if (!EvaluateInto(**arg, cond))
+    return false;
+
+  if (auto condValue = TypeHelper::GetValue<Bool>(cond)) {
+    ++arg;
+    if (!condValue->Value && ++arg == end(form.Args)) {
+      result = List::GetNil(form.GetSourceContext());
+      return true;
+    }
+    return isTail ? EvaluateTailInto(**arg, result) : EvaluateInto(**arg, result);
+  }
+  else
+    return ConditionTypeError(form, cond);
+}
+
+bool Interpreter::EvaluateBeginInto(const Sexp &form, ExpressionPtr &result, bool isTail) {
+  auto last = prev(end(form.Args));
+  for (auto arg = next(begin(form.Args)); arg != last; ++arg) {
+    if (!EvaluateInto(**arg, result))
+      return false;
+  }
+  return isTail ? EvaluateTailInto(**last, result) : EvaluateInto(**last, result);
+}
+
+// Special forms evaluated inline stay valid only while their symbol is still
+// bound to the builtin
+bool Interpreter::IsBuiltin(const Atom &symbolName) {
+  Expression *value = nullptr;
+  if (GetCurrentStackFrame().GetSymbol(symbolName, value) && value) {
+    if (auto ref = dynamic_cast<Ref*>(value))
+      value = ref->Value.get();
+    if (value && TypeHelper::SimpleIsA<CompiledFunction>(value->Type()))
+      return static_cast<CompiledFunction*>(value)->SymbolName() == symbolName.Name();
+  }
+  return false;
+}
+
+bool Interpreter::ConditionTypeError(const Sexp &form, const ExpressionPtr &cond) {
+  auto &fnName = static_cast<const Symbol&>(*form.Args.front()).Value;
+  return PushError(EvalError { form.GetSourceContext(), fnName, "Expecting: " + Bool::TypeInstance.Name() + ". Got: " + cond->Type().Name() });
+}
+
+bool Interpreter::ReduceSexpFunction(ExpressionPtr &expr, Function &function, bool isTail, bool isLazy) {
+  return ReduceSexpFunction(expr, function, PartialEvaluator, isTail, isLazy);
+}
+
+bool Interpreter::ReduceSexpFunction(ExpressionPtr &expr, Function &function, const ExpressionEvaluator &evaluator, bool isTail, bool isLazy) {
   auto &funcDef = function.Def;
   string error;
-  auto evaluator = bind(&Interpreter::EvaluatePartialLoop, this, _1);
   if (funcDef.ValidateArgs(evaluator, expr, error)) {
-    auto e = static_cast<Sexp*>(expr.get());
-    ArgList args;
-    ArgListHelper::CopyTo(e->Args, args);
+    auto interpretedFunction = dynamic_cast<InterpretedFunction*>(&function);
+    if (interpretedFunction && isTail)
+      return DeferTailCall(expr);
+
+    // The call owns its evaluated arguments, so they are handed to the
+    // function rather than copied. Only the head stays behind in expr.
+    auto &callArgs = static_cast<Sexp*>(expr.get())->Args;
+    ArgList args { move(callArgs) };
+    callArgs.push_back(move(args.front()));
     args.pop_front();
     if (auto compiledFunction = dynamic_cast<CompiledFunction*>(&function))
-      return ReduceSexpCompiledFunction(expr, *compiledFunction, args);
-    else if (auto interpretedFunction = dynamic_cast<InterpretedFunction*>(&function))
+      return ReduceSexpCompiledFunction(expr, *compiledFunction, args, isTail, isLazy);
+    else if (interpretedFunction)
       return ReduceSexpInterpretedFunction(expr, *interpretedFunction, args);
     else
       return PushError(EvalError { ErrorWhere, "Unsupported Function Type" });
   }
-  else {
-    string fnName = function.SymbolName();
-    PushError(EvalError { ErrorWhere, (fnName.empty() ? "" : fnName + ": ") + "Invalid arguments for function" });
-    return PushError(EvalError { ErrorWhere, error });
-  }
+  else
+    return InvalidArgumentsError(function, error);
+}
+
+bool Interpreter::InvalidArgumentsError(Function &function, const string &error) {
+  if (HasErrors())
+    return false;
+  string fnName = function.SymbolName();
+  PushError(EvalError { ErrorWhere, (fnName.empty() ? "" : fnName + ": ") + "Invalid arguments for function" });
+  return PushError(EvalError { ErrorWhere, error });
 }
 
-bool Interpreter::ReduceSexpCompiledFunction(ExpressionPtr &expr, CompiledFunction &function, ArgList &args) {
+bool Interpreter::ReduceSexpCompiledFunction(ExpressionPtr &expr, CompiledFunction &function, ArgList &args, bool isTail, bool isLazy) {
   if (function.Symbol) {
     if (auto fnSym = TypeHelper::GetValue<Symbol>(function.Symbol)) {
-      EvaluationContext ctx(*this, function, *fnSym, expr, args);
+      EvaluationContext ctx(*this, function, *fnSym, expr, args, isTail, isLazy);
+      ProfileScope profile(Profiler_, function);
       return function.Fn(ctx);
     }
   } 
   return PushError(EvalError { ErrorWhere, "No current function" });
 }
 
+// Tail calls made by the body come back pending in expr and run here, after
+// the frame of the call that made them is gone, so tail recursion runs in
+// constant native stack
 bool Interpreter::ReduceSexpInterpretedFunction(ExpressionPtr &expr, InterpretedFunction &function, ArgList &args) {
+  static const size_t MAX_TAIL_CALLERS = 16;
+  InterpretedFunction *currFunction = &function;
+  InterpretedFunction *lastCaller = nullptr;
+  ExpressionPtr tailFunction;
+  ArgList tailArgs;
+  vector<Atom> tailCallers;
+  ProfileScope profile(Profiler_, function);
+  if (!CallInterpretedFunction(expr, function, args, tailCallers))
+    return false;
+
+  while (TailCallPending) {
+    TailCallPending = false;
+    if (currFunction != lastCaller) {
+      if (tailCallers.size() == MAX_TAIL_CALLERS)
+        tailCallers.erase(tailCallers.begin());
+      tailCallers.push_back(currFunction->SymbolName());
+      lastCaller = currFunction;
+    }
+
+    auto &callArgs = static_cast<Sexp&>(*expr).Args;
+    ExpressionPtr head = move(callArgs.front());
+    callArgs.pop_front();
+    tailArgs = move(callArgs);
+    if (!TypeHelper::SimpleIsA<Ref>(head)) {
+      currFunction = static_cast<InterpretedFunction*>(head.get());
+      tailFunction = move(head);
+    }
+    profile.Switch(*currFunction);
+    if (!CallInterpretedFunction(expr, *currFunction, tailArgs, tailCallers))
+      return false;
+  }
+  return true;
+}
+
+// Runs a call in tail position from the enclosing call instead. The frame is
+// gone by then, so references into it are replaced by copies, except for the
+// running function itself, which outlives the frame.
+bool Interpreter::DeferTailCall(ExpressionPtr &expr) {
+  auto &running = GetCurrentStackFrame().GetFunction();
+  auto &args = static_cast<Sexp*>(expr.get())->Args;
+  for (auto &arg : args) {
+    if (auto ref = dynamic_cast<Ref*>(arg.get())) {
+      bool isRunning = &arg == &args.front() && ref->Value.get() == &running;
+      if (!isRunning && ref->Value)
+        arg = ref->Value->Clone();
+    }
+  }
+  TailCallPending = true;
+  return true;
+}
+
+bool Interpreter::CallInterpretedFunction(ExpressionPtr &expr, InterpretedFunction &function, ArgList &args, const vector<Atom> &tailCallers) {
   StackFrame newFrame { *this, function };
+  if (!tailCallers.empty())
+    newFrame.SetTailCallers(tailCallers);
   auto currArg = begin(args);
   auto currFormal = begin(function.Args);
   auto endArg = end(args);
@@ -523,7 +1080,7 @@ bool Interpreter::ReduceSexpInterpretedFunction(ExpressionPtr &expr, Interpreted
         ++currFormal;
       }
       else
-        return PushError(EvalError { ErrorWhere, "Evaluating argument " + sym->Value + " failed" }); 
+        return HasErrors() ? false : PushError(EvalError { ErrorWhere, "Evaluating argument " + sym->Value.Name() + " failed" });
     }
     else
       return PushError(EvalError { ErrorWhere, "Current formal is not a symbol " + (*currFormal)->ToString() });
@@ -533,14 +1090,34 @@ bool Interpreter::ReduceSexpInterpretedFunction(ExpressionPtr &expr, Interpreted
     return PushError(EvalError { ErrorWhere, "too many args passed to function" });
   else if (currFormal != endFormal)
     return PushError(EvalError { ErrorWhere, "not enough args passed to function" });
-  else {
-    ExpressionPtr codeCopy = function.Code.Value->Clone();
-    if (EvaluatePartial(codeCopy)) {
-      expr = move(codeCopy);
-      return true;
+  else if (EvaluateFunctionBody(expr, function))
+    return true;
+  else
+    return HasErrors() ? false : PushError(EvalError { ErrorWhere, "Failed to evaluate function" });
+}
+
+bool Interpreter::EvaluateFunctionBody(ExpressionPtr &expr, InterpretedFunction &function) {
+  // The body is held for the duration of the call, the function itself may be
+  // redefined while it runs
+  ConstExpressionPtr body = function.Code;
+  switch (Settings.GetEngine()) {
+    case EngineTypes::VM: {
+      if (!function.CompiledCode)
+        function.CompiledCode = Compiler_.Compile(body);
+      CodeBlockPtr code = function.CompiledCode;
+      return VM.RunBody(*code, expr);
+    }
+    case EngineTypes::ImmutableTreeWalker:
+      return EvaluateTailInto(*body, expr);
+    default: {
+      ExpressionPtr codeCopy = body->Clone();
+      if (EvaluateTail(codeCopy)) {
+        expr = move(codeCopy);
+        return true;
+      }
+      else
+        return false;
     }
-    else
-      return PushError(EvalError { ErrorWhere, "Failed to evaluate function" });
   }
 }
 
@@ -549,7 +1126,7 @@ bool Interpreter::EvaluateArgs(ArgList &args) {
   int argNum = 1;
   for (auto &arg : args) {
     if (!EvaluatePartial(arg)) 
-      return PushError(EvalError { ErrorWhere, "Failed to evaluate arg " + to_string(argNum) });
+      return HasErrors() ? false : PushError(EvalError { ErrorWhere, "Failed to evaluate arg " + to_string(argNum) });
     ++argNum;
   }
   return true;
@@ -11,7 +11,10 @@
 #include "FunctionDef.h"
 #include "CommandInterface.h"
 #include "InterpreterUtils.h"
+#include "Profiler.h"
 #include "ExpressionFactory.h"
+#include "Compiler.h"
+#include "VirtualMachine.h"
 
 class Interpreter;
 
@@ -20,20 +23,29 @@ class StackFrame {
     explicit StackFrame(Interpreter &interp, InterpretedFunction &&func);
     explicit StackFrame(Interpreter &interp, InterpretedFunction &func);
     ~StackFrame();
-    void PutSymbol(const std::string &symbolName, ExpressionPtr &&value);
-    void PutSymbol(const std::string &symbolName, ExpressionPtr &value);
+    void PutSymbol(const Atom &symbolName, ExpressionPtr &&value);
+    void PutSymbol(const Atom &symbolName, ExpressionPtr &value);
 
     // these needed?
-    void PutLocalSymbol(const std::string &symbolName, ExpressionPtr &&value);
-    void PutLocalSymbol(const std::string &symbolName, ExpressionPtr &value);
-    void PutDynamicSymbol(const std::string &symbolName, ExpressionPtr &value);
-    void PutDynamicSymbol(const std::string &symbolName, ExpressionPtr &&value);
-
-    bool GetSymbol(const std::string &symbolName, ExpressionPtr &valueCopy);
-    bool GetSymbol(const std::string &symbolName, Expression *&value);
-    void DeleteSymbol(const std::string &symbolName);
+    void PutLocalSymbol(const Atom &symbolName, ExpressionPtr &&value);
+    void PutLocalSymbol(const Atom &symbolName, ExpressionPtr &value);
+    void PutDynamicSymbol(const Atom &symbolName, ExpressionPtr &value);
+    void PutDynamicSymbol(const Atom &symbolName, ExpressionPtr &&value);
+
+    bool GetSymbol(const Atom &symbolName, ExpressionPtr &valueCopy);
+    bool GetSymbol(const Atom &symbolName, Expression *&value);
+    bool GetSymbol(const Symbol &symbol, ExpressionPtr &valueCopy);
+    bool GetSymbol(const Symbol &symbol, Expression *&value);
+    void DeleteSymbol(const Atom &symbolName);
     SymbolTable& GetLocalSymbols();
+    bool GetLocalSymbol(const Atom &symbolName, Expression *&value);
+    void ForEachLocal(std::function<void(const Atom &, ExpressionPtr &)> fn);
     InterpretedFunction& GetFunction();
+    void SetTailCallers(const std::vector<Atom> &tailCallers);
+    const std::vector<Atom>* GetTailCallers() const;
+
+    bool FindSlot(const Atom &symbolName, size_t &slot) const;
+    ExpressionPtr& GetSlot(size_t slot);
 
   private:
     Interpreter     &Interp;
@@ -43,6 +55,28 @@ class StackFrame {
     SymbolTable     Locals;
     SymbolTable     Closure;
     Scope           DynamicScope;
+    std::shared_ptr<const std::vector<Atom>> SlotNames;
+    std::vector<ExpressionPtr>               Slots;
+    const std::vector<Atom>                  *TailCallers;
+
+    bool FindBoundSlot(const Atom &symbolName, size_t &slot) const;
+};
+
+// Scope over the locals of a stack frame. Names the function resolved to a
+// slot are bound in place, the rest go through the frame's symbol table.
+class LocalScope {
+  public:
+    explicit LocalScope(StackFrame &frame, const SourceContext &sourceContext);
+    ~LocalScope();
+    void PutSymbol(const Atom &symbolName, ExpressionPtr &value);
+    void PutSymbol(const Atom &symbolName, ExpressionPtr &&value);
+    void RebindSymbol(const Atom &symbolName, ExpressionPtr &&value);
+    bool IsScopedSymbol(const Atom &symbolName) const;
+
+  private:
+    StackFrame                                     &Frame;
+    Scope                                          Locals;
+    std::vector<std::pair<size_t, ExpressionPtr>>  ShadowedSlots;
 };
 
 class EvaluationContext {
@@ -53,14 +87,18 @@ class EvaluationContext {
     ArgList           &Args;
     SourceContext     SourceContext_;
     ExpressionFactory Factory;
+    bool              IsTail;
+    bool              IsLazy;
 
-    explicit EvaluationContext(Interpreter &interpreter, CompiledFunction &compiledFunction, Symbol &currentFunction, ExpressionPtr &expr, ArgList &args);
+    explicit EvaluationContext(Interpreter &interpreter, CompiledFunction &compiledFunction, Symbol &currentFunction, ExpressionPtr &expr, ArgList &args, bool isTail, bool isLazy);
 
     const SourceContext& GetSourceContext() const;
 
     bool Evaluate(ExpressionPtr &expr, int argNum);
     bool Evaluate(ExpressionPtr &expr, const std::string &argName);
     bool EvaluateNoError(ExpressionPtr &expr);
+    bool EvaluateTail(ExpressionPtr &expr, const std::string &argName);
+    bool EvaluateLazy(ExpressionPtr &expr, const std::string &argName);
 
     template<typename T, typename... Args>
     T* Alloc(Args&&... args) {
@@ -139,8 +177,8 @@ class EvaluationContext {
       return nullptr;
     }
 
-    bool GetSymbol(const std::string &symName, ExpressionPtr &valueCopy);
-    bool GetSymbol(const std::string &symName, Expression *&value);
+    bool GetSymbol(const Atom &symName, ExpressionPtr &valueCopy);
+    bool GetSymbol(const Atom &symName, Expression *&value);
 
     Sexp* GetList(ExpressionPtr &expr);
     Sexp* GetRequiredListValue(ExpressionPtr &expr);
@@ -162,9 +200,38 @@ class EvaluationContext {
     bool AllocationError();
 };
 
+// What the stack trace of an error needs from a frame, kept once the frame
+// is gone so the trace can be formatted later. The frame's tail callers
+// follow the ones of the frames before it in ErrorTailCallers.
+struct ErrorFrame {
+  Atom          Function;
+  SourceContext Where;
+  size_t        NTailCallers;
+};
+
+struct LoadedModule {
+  std::shared_ptr<ModuleInfo> Info;
+  uint32_t                    LoadCount;
+};
+
+// A copy of the global environment of an interpreter: its dynamic symbols,
+// infix operators, modules and builtin help. Restoring one into a new interpreter is
+// cheaper than loading its libraries and preludes again. Copies share list
+// and dict storage with each other, so a snapshot is used from one thread.
+class InterpreterSnapshot {
+  private:
+    SymbolTableType                     Symbols;
+    std::vector<Atom>                   InfixSymbols;
+    std::map<std::string, LoadedModule> Modules;
+    std::shared_ptr<FunctionDocs>       Docs;
+
+  friend class Interpreter;
+};
+
 class Interpreter {
   public:    
     using SymbolFunctor = std::function<void(const std::string&, ExpressionPtr&)>;
+    using ArgEvaluator  = std::function<bool(size_t argIdx, ExpressionPtr &value)>;
 
     explicit Interpreter(CommandInterface &commandInterface);
     ~Interpreter();
@@ -173,11 +240,19 @@ class Interpreter {
     bool Evaluate(ExpressionPtr &expr);
     bool EvaluatePartial(ExpressionPtr &expr);
     bool EvaluatePartialLoop(ExpressionPtr &expr);
+    bool EvaluateInto(const Expression &expr, ExpressionPtr &result);
+    bool EvaluateStatement(const Expression &expr, CodeBlockPtr &compiled, ExpressionPtr &result);
+    bool EvaluateSymbol(const Symbol &symbol, ExpressionPtr &value);
+    bool EvaluateCall(const Sexp &form, ExpressionPtr &head, const ArgEvaluator &evaluateArg, ExpressionPtr &result, bool isTail);
+    bool CallFunction(ExpressionPtr &function, ArgList &args, ExpressionPtr &result);
+    bool EvaluateTail(ExpressionPtr &expr);
+    bool EvaluateLazy(ExpressionPtr &expr);
 
     InterpreterSettings& GetSettings();
 
     bool PushError(const EvalError &error);
-    std::list<EvalError> GetErrors() const;
+    const std::list<EvalError>& GetErrors() const;
+    bool HasErrors() const;
     void ClearErrors();
     std::vector<std::string> GetErrorStackTrace() const;
 
@@ -188,6 +263,7 @@ class Interpreter {
     void SetExitCode(int exitCode);
 
     SymbolTable GetDynamicSymbols(const SourceContext &sourceContext);
+    FunctionDocs& GetFunctionDocs();
 
     StackFrame& GetCurrentStackFrame();
     void PushStackFrame(StackFrame &stackFrame);
@@ -198,50 +274,68 @@ class Interpreter {
     Environment& GetEnvironment();
 
     ModuleInfo* CreateModule(const std::string &moduleName, const std::string &filePath);
+    ModuleInfo* GetModule(const std::string &moduleName);
+    uint32_t GetLoadCount(const std::string &moduleName) const;
+
+    InterpreterSnapshot TakeSnapshot();
+    void Restore(const InterpreterSnapshot &snapshot);
+
+    void SetProfiler(Profiler *profiler);
 
   private:
-    using TypeReducer      = std::function<bool(ExpressionPtr &expr)>;
-    using TypeReducersType = std::map<const TypeInfo*, TypeReducer>;
-    
     CommandInterface                   &CmdInterface;
-    std::map<std::string, ModuleInfo*> Modules;  
+    std::map<std::string, LoadedModule> Modules;
     SourceContext                      SourceContext_;
     SymbolTableType                    DynamicSymbolStore;
+    std::shared_ptr<FunctionDocs>      Docs;
     SymbolTable                        DynamicSymbols;
     InterpreterSettings                Settings;
     std::vector<StackFrame*>           StackFrames;
     InterpretedFunction                MainFunc;
     StackFrame                         MainFrame;
-    TypeReducersType                   TypeReducers;
+    Compiler                           Compiler_;
+    VirtualMachine                     VM;
     std::list<EvalError>               Errors;
     std::string                        ErrorWhere;
-    std::vector<std::string>           ErrorStackTrace;
+    std::vector<ErrorFrame>            ErrorFrames;
+    std::vector<Atom>                  ErrorTailCallers;
+    ExpressionEvaluator                PartialEvaluator;
     Sexp                               *Current;
     bool                               StopRequested_;
+    bool                               TailPosition;
+    bool                               TailCallPending;
+    bool                               LazyPosition;
     int                                ExitCode;
     Environment                        Environment_;
+    Profiler                           *Profiler_;
 
     template<class T>          bool InterpretLiteral(T *expr, char *wrapper = nullptr);
-    template<class S, class V> bool GetLiteral(const std::string &symbolName, V &value);
+    template<class S, class V> bool GetLiteral(const Atom &symbolName, V &value);
 
     bool GetSpecialFunction(const std::string &name, FunctionPtr &func);
-    bool GetCurrFrameSymbol(const std::string &symbolName, ExpressionPtr &value);
-    void RegisterReducers();
-    bool ReduceBool(ExpressionPtr &expr);
-    bool ReduceInt(ExpressionPtr &expr);
-    bool ReduceFloat(ExpressionPtr &expr);
-    bool ReduceStr(ExpressionPtr &expr);
+    bool GetCurrFrameSymbol(const Atom &symbolName, ExpressionPtr &value);
     bool ReduceSymbol(ExpressionPtr &expr);
-    bool ReduceFunction(ExpressionPtr &expr);
     bool ReduceSexp(ExpressionPtr &expr);
-    bool ReduceSexpFunction(ExpressionPtr &expr, Function &function);
-    bool ReduceSexpCompiledFunction(ExpressionPtr &expr, CompiledFunction &function, ArgList &args);
+    bool ReduceSexpFunction(ExpressionPtr &expr, Function &function, bool isTail, bool isLazy);
+    bool ReduceSexpFunction(ExpressionPtr &expr, Function &function, const ExpressionEvaluator &evaluator, bool isTail, bool isLazy);
+    bool ReduceSexpCompiledFunction(ExpressionPtr &expr, CompiledFunction &function, ArgList &args, bool isTail, bool isLazy);
     bool ReduceSexpInterpretedFunction(ExpressionPtr &expr, InterpretedFunction &function, ArgList &args);
+    bool CallInterpretedFunction(ExpressionPtr &expr, InterpretedFunction &function, ArgList &args, const std::vector<Atom> &tailCallers);
+    bool DeferTailCall(ExpressionPtr &expr);
     bool ReduceSexpList(ExpressionPtr &expr, ArgList &args);
-    bool ReduceQuote(ExpressionPtr &expr);
-    bool ReduceRef(ExpressionPtr &expr);
 
     bool EvaluateArgs(ArgList &args);
+    bool EvaluateFunctionBody(ExpressionPtr &expr, InterpretedFunction &function);
+    bool EvaluateTailInto(const Expression &expr, ExpressionPtr &result);
+    bool EvaluateSexpInto(const Sexp &form, ExpressionPtr &result, bool isTail);
+    bool EvaluateIfInto(const Sexp &form, ExpressionPtr &result, bool isTail);
+    bool EvaluateBeginInto(const Sexp &form, ExpressionPtr &result, bool isTail);
+    bool InvalidArgumentsError(Function &function, const std::string &error);
+    bool ConditionTypeError(const Sexp &form, const ExpressionPtr &cond);
+    bool IsBuiltin(const Atom &symbolName);
     bool BuildListSexp(Sexp &wrappedSexp, ArgList &args);
+
+  friend class VirtualMachine;
+  friend class StdLib;
 };
 
@@ -21,90 +21,68 @@ EvalError::EvalError(const SourceContext &sourceContext, const string &where, co
 }
 
 //=============================================================================
-SymbolTable::SymbolTable(SymbolTableType& symbols, const SourceContext &sourceContext):
+SymbolTable::SymbolTable(SymbolTableType& symbols, const SourceContext &sourceContext, FunctionDocs *docs):
   Symbols(symbols),
-  SourceContext_(sourceContext)
+  SourceContext_(sourceContext),
+  Docs(docs)
 {
 }
 
-void SymbolTable::PutSymbol(const string &symbolName, ExpressionPtr &value) {
+void SymbolTable::PutSymbol(const Atom &symbolName, ExpressionPtr &value) {
   PutSymbol(symbolName, move(value));
 }
 
-void SymbolTable::PutSymbol(const string &symbolName, ExpressionPtr &&value) {
-  if (auto fn = dynamic_cast<Function*>(value.get()))
-    fn->Symbol.reset(new Symbol(fn->GetSourceContext(), symbolName));
-
-  auto search = Symbols.find(symbolName);
-  if (search != Symbols.end()) {
-    if (auto *ref = dynamic_cast<Ref*>(search->second.get())) {
-      if (auto *refValue = dynamic_cast<Ref*>(value.get()))
-        ref->Value = refValue->Clone();
-      else
-        ref->Value = move(value);
-    }
-    else
-      search->second = move(value);
-  }
-  else
-    Symbols.emplace(symbolName, move(value));
+void SymbolTable::PutSymbol(const Atom &symbolName, ExpressionPtr &&value) {
+  StoreValue(symbolName, Symbols[symbolName], move(value));
 }
 
-void SymbolTable::PutSymbolBool(const string &symbolName, bool value) {
+void SymbolTable::PutSymbolBool(const Atom &symbolName, bool value) {
   PutSymbol(symbolName, ExpressionPtr { new Bool { SourceContext_, value } });
 }
 
-void SymbolTable::PutSymbolStr(const string &symbolName, const string &value) {
+void SymbolTable::PutSymbolStr(const Atom &symbolName, const string &value) {
   PutSymbol(symbolName, ExpressionPtr { new Str { SourceContext_, value } });
 }
 
-void SymbolTable::PutSymbolInt(const string &symbolName, int64_t value) {
+void SymbolTable::PutSymbolInt(const Atom &symbolName, int64_t value) {
   PutSymbol(symbolName, ExpressionPtr { new Int { SourceContext_, value } });
 }
 
-void SymbolTable::PutSymbolFloat(const string &symbolName, double value) {
+void SymbolTable::PutSymbolFloat(const Atom &symbolName, double value) {
   PutSymbol(symbolName, ExpressionPtr { new Float { SourceContext_, value } });
 }
 
-void SymbolTable::PutSymbolQuote(const string &symbolName, ExpressionPtr &&value) {
+void SymbolTable::PutSymbolQuote(const Atom &symbolName, ExpressionPtr &&value) {
   PutSymbol(symbolName, ExpressionPtr { new Quote { SourceContext_, move(value) } });
 }
 
-void SymbolTable::PutSymbolFunction(const string &symbolName, Function &&func) {
+void SymbolTable::PutSymbolFunction(const Atom &symbolName, Function &&func) {
   PutSymbol(symbolName, func.Clone());
 }
 
-void SymbolTable::PutSymbolFunction(const string &symbolName, initializer_list<string> signatures, const string &doc, initializer_list<ExampleDef> examples, SlipFunction fn, FuncDef &&def) {
+// Tables that are not an interpreter's have nowhere to keep the help
+void SymbolTable::PutSymbolFunction(const Atom &symbolName, initializer_list<const char*> signatures, const char *doc, initializer_list<ExampleText> examples, SlipFunction fn, FuncDef &&def) {
   ExpressionPtr funcExpr { new CompiledFunction { SourceContext_, move(def), fn } };
   if (funcExpr) {
-    auto *func = static_cast<CompiledFunction*>(funcExpr.get());
-    func->Signatures = signatures;
-    func->Doc = doc;
-    func->Examples = examples;
+    if (Docs) {
+      Docs->Register(symbolName, signatures, doc, examples);
+      static_cast<CompiledFunction&>(*funcExpr).DocName = symbolName;
+    }
     PutSymbol(symbolName, move(funcExpr));
   }
 }
 
-bool SymbolTable::GetSymbol(const string &symbolName, ExpressionPtr &valueCopy) {
+bool SymbolTable::GetSymbol(const Atom &symbolName, ExpressionPtr &valueCopy) {
   auto it = Symbols.find(symbolName);
   if (it != Symbols.end()) {
-    if (it->second) {
-      if (auto func = dynamic_cast<Function*>(it->second.get()))
-        valueCopy.reset(new Ref(it->second->GetSourceContext(), it->second));
-      else if (auto ref = dynamic_cast<Ref*>(it->second.get()))
-        valueCopy = ref->NewRef();
-      else
-        valueCopy = ExpressionPtr { it->second->Clone() };
-    }
-    else
-      valueCopy = ExpressionPtr { };
+    LoadValue(it->second, valueCopy);
     return true;
   }
   else
     return false;
 }
 
-bool SymbolTable::GetSymbol(const string &symbolName, Expression *&value) {
+bool SymbolTable::GetSymbol(const Atom &symbolName, Expression *&value) {
   auto it = Symbols.find(symbolName);
   if (it != Symbols.end()) {
     if (it->second)
@@ -117,19 +95,67 @@ bool SymbolTable::GetSymbol(const string &symbolName, Expression *&value) {
     return false;
 }
 
-void SymbolTable::DeleteSymbol(const string &symbolName) {
+// Unlike PutSymbol, a ref the symbol holds is replaced rather than stored
+// through
+void SymbolTable::RebindSymbol(const Atom &symbolName, ExpressionPtr &&value) {
+  auto &stored = Symbols[symbolName];
+  stored.reset();
+  StoreValue(symbolName, stored, move(value));
+}
+
+void SymbolTable::DeleteSymbol(const Atom &symbolName) {
   Symbols.erase(symbolName);
 }
 
-void SymbolTable::ForEach(function<void(const string &, ExpressionPtr &)> fn) {
+void SymbolTable::ForEach(function<void(const Atom &, ExpressionPtr &)> fn) {
   for (auto &sym : Symbols)
     fn(sym.first, sym.second);
 }
 
+// Symbols are hashed by atom, so listings that are shown to the user sort by name first
+void SymbolTable::ForEachSorted(function<void(const Atom &, ExpressionPtr &)> fn) {
+  vector<SymbolTableType::value_type*> sorted;
+  sorted.reserve(Symbols.size());
+  for (auto &sym : Symbols)
+    sorted.push_back(&sym);
+  sort(begin(sorted), end(sorted), [](SymbolTableType::value_type *lhs, SymbolTableType::value_type *rhs) {
+    return lhs->first < rhs->first;
+  });
+  for (auto *sym : sorted)
+    fn(sym->first, sym->second);
+}
+
 size_t SymbolTable::GetCount() const {
   return Symbols.size();
 }
 
+void SymbolTable::StoreValue(const Atom &symbolName, ExpressionPtr &stored, ExpressionPtr &&value) {
+  if (auto fn = dynamic_cast<Function*>(value.get()))
+    fn->Symbol.reset(new Symbol(fn->GetSourceContext(), symbolName));
+
+  if (auto *ref = dynamic_cast<Ref*>(stored.get())) {
+    if (auto *refValue = dynamic_cast<Ref*>(value.get()))
+      ref->Value = refValue->Clone();
+    else
+      ref->Value = move(value);
+  }
+  else
+    stored = move(value);
+}
+
+void SymbolTable::LoadValue(ExpressionPtr &stored, ExpressionPtr &valueCopy) {
+  if (stored) {
+    if (dynamic_cast<Function*>(stored.get()))
+      valueCopy.reset(new Ref(stored->GetSourceContext(), stored));
+    else if (auto ref = dynamic_cast<Ref*>(stored.get()))
+      valueCopy = ref->NewRef();
+    else
+      valueCopy = ExpressionPtr { stored->Clone() };
+  }
+  else
+    valueCopy = ExpressionPtr { };
+}
+
 //=============================================================================
 
 Scope::Scope(SymbolTable &symbols, const SourceContext &sourceContext):
@@ -145,27 +171,35 @@ Scope::~Scope() {
     Symbols.DeleteSymbol(scopedSymbol);
   }
 
-  ShadowedSymbols.ForEach([this](const string &symbolName, ExpressionPtr &value) {
+  ShadowedSymbols.ForEach([this](const Atom &symbolName, ExpressionPtr &value) {
     Symbols.PutSymbol(symbolName, move(value));
   });
 }
 
-void Scope::PutSymbol(const string &symbolName, ExpressionPtr &&value) {
-  ExpressionPtr oldValue;
-  bool isScoped = IsScopedSymbol(symbolName);
-  if (!isScoped) {
+void Scope::PutSymbol(const Atom &symbolName, ExpressionPtr &&value) {
+  Shadow(symbolName);
+  Symbols.PutSymbol(symbolName, move(value));
+}
+
+void Scope::RebindSymbol(const Atom &symbolName, ExpressionPtr &&value) {
+  Shadow(symbolName);
+  Symbols.RebindSymbol(symbolName, move(value));
+}
+
+void Scope::Shadow(const Atom &symbolName) {
+  if (!IsScopedSymbol(symbolName)) {
+    ExpressionPtr oldValue;
     if (Symbols.GetSymbol(symbolName, oldValue))
       ShadowedSymbols.PutSymbol(symbolName, move(oldValue));
     ScopedSymbols.push_back(symbolName);
   }
-  Symbols.PutSymbol(symbolName, move(value));
 }
 
-void Scope::PutSymbol(const string &symbolName, ExpressionPtr &value) {
+void Scope::PutSymbol(const Atom &symbolName, ExpressionPtr &value) {
   PutSymbol(symbolName, move(value));
 }
 
-bool Scope::IsScopedSymbol(const string &symbolName) const {
+bool Scope::IsScopedSymbol(const Atom &symbolName) const {
   auto scopeBegin = begin(ScopedSymbols),
        scopeEnd   = end(ScopedSymbols);
   return find(scopeBegin, scopeEnd, symbolName) != scopeEnd;
@@ -177,15 +211,16 @@ InterpreterSettings::InterpreterSettings(SymbolTable &dynamicSymbols):
   DynamicSymbols { dynamicSymbols },
   InfixSymbolNames { },
   DefaultSexp { "__default_sexp__" },
-  ListSexp { "__list__sexp__" }
+  ListSexp { "__list__sexp__" },
+  Engine { EngineTypes::TreeWalker }
 {
 }
 
-const string InterpreterSettings::GetDefaultSexp() const {
+const Atom& InterpreterSettings::GetDefaultSexp() const {
   return DefaultSexp;
 }
 
-const string InterpreterSettings::GetListSexp() const {
+const Atom& InterpreterSettings::GetListSexp() const {
   return ListSexp;
 }
 
@@ -205,11 +240,11 @@ void InterpreterSettings::PutListFunction(Function &&func) {
   DynamicSymbols.PutSymbolFunction(ListSexp, move(func));
 }
 
-void InterpreterSettings::RegisterInfixSymbol(const string &symbolName) {
+void InterpreterSettings::RegisterInfixSymbol(const Atom &symbolName) {
   InfixSymbolNames.push_back(symbolName);
 }
 
-void InterpreterSettings::UnregisterInfixSymbol(const string &symbolName) {
+void InterpreterSettings::UnregisterInfixSymbol(const Atom &symbolName) {
   auto beg = begin(InfixSymbolNames);
   auto en = end(InfixSymbolNames);
   auto target = find(beg, en, symbolName);
@@ -217,7 +252,7 @@ void InterpreterSettings::UnregisterInfixSymbol(const string &symbolName) {
     InfixSymbolNames.erase(target);
 }
 
-int InterpreterSettings::GetInfixSymbolPrecedence(const string &symbolName) const {
+int InterpreterSettings::GetInfixSymbolPrecedence(const Atom &symbolName) const {
   for (size_t i = 0; i < InfixSymbolNames.size(); ++i) {
     if (InfixSymbolNames[i] == symbolName)
       return i;
@@ -225,13 +260,29 @@ int InterpreterSettings::GetInfixSymbolPrecedence(const string &symbolName) cons
   return NO_PRECEDENCE;
 }
 
-bool InterpreterSettings::IsSymbolFunction(const string &symbolName) const {
+const vector<Atom>& InterpreterSettings::GetInfixSymbols() const {
+  return InfixSymbolNames;
+}
+
+void InterpreterSettings::SetInfixSymbols(const vector<Atom> &symbolNames) {
+  InfixSymbolNames = symbolNames;
+}
+
+bool InterpreterSettings::IsSymbolFunction(const Atom &symbolName) const {
   ExpressionPtr value { };
   return DynamicSymbols.GetSymbol(symbolName, value) &&
          TypeHelper::GetValue<Function>(value);
 }
 
-bool InterpreterSettings::GetSpecialFunction(const string &name, FunctionPtr &func) const {
+EngineTypes InterpreterSettings::GetEngine() const {
+  return Engine;
+}
+
+void InterpreterSettings::SetEngine(EngineTypes engine) {
+  Engine = engine;
+}
+
+bool InterpreterSettings::GetSpecialFunction(const Atom &name, FunctionPtr &func) const {
   ExpressionPtr symbol;
   if (DynamicSymbols.GetSymbol(name, symbol) && symbol) {
     if (auto *ref = dynamic_cast<Ref*>(symbol.get())) {
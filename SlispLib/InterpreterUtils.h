@@ -8,6 +8,7 @@
 
 #include "Expression.h"
 #include "FunctionDef.h"
+#include "FunctionDocs.h"
 
 struct EvalError {
   std::string Where; //TODO: Function
@@ -20,41 +21,56 @@ struct EvalError {
 
 class SymbolTable {
   public:
-    explicit SymbolTable(SymbolTableType& symbols, const SourceContext &sourceContext);
-    void PutSymbol(const std::string &symbolName, ExpressionPtr &value);
-    void PutSymbol(const std::string &symbolName, ExpressionPtr &&value);
-    void PutSymbolBool(const std::string &symbolName, bool value);
-    void PutSymbolInt(const std::string &symbolName, int64_t value);
-    void PutSymbolFloat(const std::string &symbolName, double value);
-    void PutSymbolStr(const std::string &symbolName, const std::string &value);
-    void PutSymbolFunction(const std::string &symbolName, Function &&func);
-    void PutSymbolFunction(const std::string &symbolName, std::initializer_list<std::string> signatures, const std::string &doc, std::initializer_list<ExampleDef> examples, SlipFunction fn, FuncDef &&def);
-    void PutSymbolQuote(const std::string &symbolName, ExpressionPtr &&value);
-    bool GetSymbol(const std::string &symbolName, ExpressionPtr &valueCopy);
-    bool GetSymbol(const std::string &symbolName, Expression *&value);
-    //bool GetSymbolRef(const std::string &symbolName, ExpressionPtr &ref);
-    void DeleteSymbol(const std::string &symbolName);
-    void ForEach(std::function<void(const std::string &, ExpressionPtr &)>);
+    explicit SymbolTable(SymbolTableType& symbols, const SourceContext &sourceContext, FunctionDocs *docs = nullptr);
+    void PutSymbol(const Atom &symbolName, ExpressionPtr &value);
+    void PutSymbol(const Atom &symbolName, ExpressionPtr &&value);
+    void PutSymbolBool(const Atom &symbolName, bool value);
+    void PutSymbolInt(const Atom &symbolName, int64_t value);
+    void PutSymbolFloat(const Atom &symbolName, double value);
+    void PutSymbolStr(const Atom &symbolName, const std::string &value);
+    void PutSymbolFunction(const Atom &symbolName, Function &&func);
+    void PutSymbolFunction(const Atom &symbolName, std::initializer_list<const char*> signatures, const char *doc, std::initializer_list<ExampleText> examples, SlipFunction fn, FuncDef &&def);
+    void PutSymbolQuote(const Atom &symbolName, ExpressionPtr &&value);
+    void RebindSymbol(const Atom &symbolName, ExpressionPtr &&value);
+    bool GetSymbol(const Atom &symbolName, ExpressionPtr &valueCopy);
+    bool GetSymbol(const Atom &symbolName, Expression *&value);
+    //bool GetSymbolRef(const Atom &symbolName, ExpressionPtr &ref);
+    void DeleteSymbol(const Atom &symbolName);
+    void ForEach(std::function<void(const Atom &, ExpressionPtr &)>);
+    void ForEachSorted(std::function<void(const Atom &, ExpressionPtr &)>);
     size_t GetCount() const;
 
+    static void StoreValue(const Atom &symbolName, ExpressionPtr &stored, ExpressionPtr &&value);
+    static void LoadValue(ExpressionPtr &stored, ExpressionPtr &valueCopy);
+
   private:
     SymbolTableType& Symbols;
     SourceContext SourceContext_;
+    FunctionDocs *Docs;
 };
 
 class Scope {
   public:
     explicit Scope(SymbolTable &symbols, const SourceContext &sourceContext);
     ~Scope();
-    void PutSymbol(const std::string &symbolName, ExpressionPtr &value);
-    void PutSymbol(const std::string &symbolName, ExpressionPtr &&value);
-    bool IsScopedSymbol(const std::string &symbolName) const;
+    void PutSymbol(const Atom &symbolName, ExpressionPtr &value);
+    void PutSymbol(const Atom &symbolName, ExpressionPtr &&value);
+    void RebindSymbol(const Atom &symbolName, ExpressionPtr &&value);
+    bool IsScopedSymbol(const Atom &symbolName) const;
 
   private:
     SymbolTable                  &Symbols;
     SymbolTableType              ShadowedSymbolStore;
     SymbolTable                  ShadowedSymbols;
-    std::vector<std::string>     ScopedSymbols;
+    std::vector<Atom>            ScopedSymbols;
+
+    void Shadow(const Atom &symbolName);
+};
+
+enum class EngineTypes {
+  TreeWalker,
+  ImmutableTreeWalker,
+  VM
 };
 
 class InterpreterSettings {
@@ -63,8 +79,8 @@ class InterpreterSettings {
 
     explicit InterpreterSettings(SymbolTable &dynamicSymbols);
 
-    const std::string GetDefaultSexp() const;
-    const std::string GetListSexp() const;
+    const Atom& GetDefaultSexp() const;
+    const Atom& GetListSexp() const;
 
     bool GetDefaultFunction(FunctionPtr &func) const;
     bool GetListFunction(FunctionPtr &func) const;
@@ -72,19 +88,25 @@ class InterpreterSettings {
     void PutDefaultFunction(Function &&func);
     void PutListFunction(Function &&func);
 
-    void RegisterInfixSymbol(const std::string &symbolName);
-    void UnregisterInfixSymbol(const std::string &symbolName);
-    int GetInfixSymbolPrecedence(const std::string &symbolName) const;
+    void RegisterInfixSymbol(const Atom &symbolName);
+    void UnregisterInfixSymbol(const Atom &symbolName);
+    int GetInfixSymbolPrecedence(const Atom &symbolName) const;
+    const std::vector<Atom>& GetInfixSymbols() const;
+    void SetInfixSymbols(const std::vector<Atom> &symbolNames);
+
+    bool IsSymbolFunction(const Atom &symbolName) const;
 
-    bool IsSymbolFunction(const std::string &symbolName) const;
+    EngineTypes GetEngine() const;
+    void SetEngine(EngineTypes engine);
 
   private:
     SymbolTable& DynamicSymbols;
-    std::vector<std::string> InfixSymbolNames;
-    std::string DefaultSexp;
-    std::string ListSexp;
+    std::vector<Atom> InfixSymbolNames;
+    Atom DefaultSexp;
+    Atom ListSexp;
+    EngineTypes Engine;
 
-    bool GetSpecialFunction(const std::string &name, FunctionPtr &func) const;
+    bool GetSpecialFunction(const Atom &name, FunctionPtr &func) const;
 };
 
 struct SlispVersion {
@@ -6,6 +6,7 @@ class Library {
   public:
     virtual ~Library();
     virtual bool Load(Interpreter &interpreter) = 0;
+    virtual bool Attach(Interpreter &interpreter) = 0;
     virtual void UnLoad(Interpreter &interpreter) = 0;
     virtual void SetInteractiveMode(Interpreter &interpreter, bool enabled);
 };
\ No newline at end of file
@@ -0,0 +1,363 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "ModuleCache.h"
+
+using namespace std;
+
+// File layout, numbers are varints unless noted:
+//   magic, format version (byte), source length, source hash (8 bytes)
+//   name count, names (length + bytes)
+//   form count, first line of each form
+//   forms (queries, expression), lines are kept relative to the first line
+static const string Magic = "slispc";
+
+const uint8_t ModuleCache::FormatVersion = 1;
+
+static void WriteVarint(string &out, uint64_t value) {
+  while (value >= 0x80) {
+    out += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out += static_cast<char>(value);
+}
+
+static uint64_t ZigZag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t UnZigZag(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+static void WriteFixed(string &out, uint64_t value) {
+  for (int i = 0; i < 8; ++i)
+    out += static_cast<char>((value >> (8 * i)) & 0xff);
+}
+
+//=============================================================================
+
+ModuleCache::ModuleCache(const string &dir):
+  Dir(dir)
+{
+}
+
+bool ModuleCache::Enabled() const {
+  return !Dir.empty();
+}
+
+string ModuleCache::GetPath(const string &source) const {
+  char name[17];
+  snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(Hash(source)));
+  return Dir + "/" + name + ".slispc";
+}
+
+// FNV-1a
+uint64_t ModuleCache::Hash(const string &source) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (char c : source) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+//=============================================================================
+
+ModuleCacheWriter::ModuleCacheWriter():
+  Forms(),
+  FirstLines(),
+  Names(),
+  NameIds(),
+  Valid(true)
+{
+}
+
+void ModuleCacheWriter::Add(size_t firstLine, const vector<InfixQuery> &queries, const Expression &expr) {
+  if (!Valid)
+    return;
+
+  // The same question is often asked more than once while parsing a form
+  vector<InfixQuery> unique { queries };
+  sort(begin(unique), end(unique), [](const InfixQuery &lhs, const InfixQuery &rhs) {
+    return lhs.Type != rhs.Type ? lhs.Type < rhs.Type : lhs.Name < rhs.Name;
+  });
+  unique.erase(std::unique(begin(unique), end(unique), [](const InfixQuery &lhs, const InfixQuery &rhs) {
+    return lhs.Type == rhs.Type && lhs.Name == rhs.Name;
+  }), end(unique));
+
+  FirstLines.push_back(firstLine);
+  WriteVarint(Forms, unique.size());
+  for (auto &query : unique) {
+    Forms += static_cast<char>(query.Type);
+    WriteName(Forms, query.Name);
+    WriteVarint(Forms, ZigZag(query.Result));
+  }
+  if (!WriteExpression(Forms, expr, firstLine))
+    Invalidate();
+}
+
+void ModuleCacheWriter::Invalidate() {
+  Valid = false;
+  Forms.clear();
+  FirstLines.clear();
+}
+
+bool ModuleCacheWriter::Save(const string &path, const string &source) const {
+  if (!Valid)
+    return false;
+
+  string data = Magic;
+  data += static_cast<char>(ModuleCache::FormatVersion);
+  WriteVarint(data, source.size());
+  WriteFixed(data, ModuleCache::Hash(source));
+  WriteVarint(data, Names.size());
+  for (auto &name : Names) {
+    WriteVarint(data, name.Name().size());
+    data += name.Name();
+  }
+  WriteVarint(data, FirstLines.size());
+  for (size_t firstLine : FirstLines)
+    WriteVarint(data, firstLine);
+  data += Forms;
+
+  // Other processes may be loading or saving the same module
+  string tempPath = path + "." + to_string(random_device()()) + ".tmp";
+  ofstream out(tempPath, ios_base::out | ios_base::binary);
+  if (!out.is_open())
+    return false;
+  out.write(data.data(), data.size());
+  out.close();
+  if (out.fail() || rename(tempPath.c_str(), path.c_str()) != 0) {
+    remove(tempPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+void ModuleCacheWriter::WriteName(string &out, const Atom &name) {
+  auto id = NameIds.find(name);
+  if (id == NameIds.end()) {
+    id = NameIds.emplace(name, Names.size()).first;
+    Names.push_back(name);
+  }
+  WriteVarint(out, id->second);
+}
+
+bool ModuleCacheWriter::WriteExpression(string &out, const Expression &expr, size_t firstLine) {
+  TypeTag tag = expr.Type().Tag();
+  out += static_cast<char>(tag);
+  WriteVarint(out, ZigZag(static_cast<int64_t>(expr.GetSourceContext().LineNum - firstLine)));
+  switch (tag) {
+    case TypeTag::Int:
+      WriteVarint(out, ZigZag(static_cast<const Int&>(expr).Value));
+      return true;
+    case TypeTag::Float: {
+      uint64_t bits;
+      memcpy(&bits, &static_cast<const Float&>(expr).Value, sizeof(bits));
+      WriteFixed(out, bits);
+      return true;
+    }
+    case TypeTag::Str: {
+      auto &value = static_cast<const Str&>(expr).Value;
+      WriteVarint(out, value.size());
+      out += value;
+      return true;
+    }
+    case TypeTag::Symbol:
+      WriteName(out, static_cast<const Symbol&>(expr).Value);
+      return true;
+    case TypeTag::Quote:
+      return WriteExpression(out, *static_cast<const Quote&>(expr).Value, firstLine);
+    case TypeTag::Sexp: {
+      auto &args = static_cast<const Sexp&>(expr).Args;
+      WriteVarint(out, args.size());
+      for (auto &arg : args) {
+        if (!WriteExpression(out, *arg, firstLine))
+          return false;
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+//=============================================================================
+
+ModuleCacheReader::ModuleCacheReader():
+  Data(),
+  Pos(0),
+  Names(),
+  FirstLines(),
+  FormIdx(0)
+{
+}
+
+bool ModuleCacheReader::Open(const string &path, const string &source) {
+  ifstream in(path, ios_base::in | ios_base::binary);
+  if (!in.is_open())
+    return false;
+  stringstream contents;
+  contents << in.rdbuf();
+  Data = contents.str();
+  Pos = 0;
+
+  if (Data.compare(0, Magic.size(), Magic) != 0)
+    return false;
+  Pos = Magic.size();
+  if (Pos + 9 > Data.size() || static_cast<uint8_t>(Data[Pos++]) != ModuleCache::FormatVersion)
+    return false;
+
+  uint64_t length, hash = 0;
+  if (!ReadVarint(length) || length != source.size() || Pos + 8 > Data.size())
+    return false;
+  for (int i = 0; i < 8; ++i)
+    hash |= static_cast<uint64_t>(static_cast<uint8_t>(Data[Pos++])) << (8 * i);
+  if (hash != ModuleCache::Hash(source))
+    return false;
+
+  uint64_t nNames, nameLength;
+  if (!ReadVarint(nNames))
+    return false;
+  Names.clear();
+  for (uint64_t i = 0; i < nNames; ++i) {
+    if (!ReadVarint(nameLength) || nameLength > Data.size() - Pos)
+      return false;
+    Names.emplace_back(Data.substr(Pos, nameLength));
+    Pos += nameLength;
+  }
+
+  uint64_t nForms, firstLine;
+  if (!ReadVarint(nForms) || nForms > Data.size() - Pos)
+    return false;
+  FirstLines.clear();
+  for (uint64_t i = 0; i < nForms; ++i) {
+    if (!ReadVarint(firstLine))
+      return false;
+    FirstLines.push_back(firstLine);
+  }
+  FormIdx = 0;
+  return true;
+}
+
+bool ModuleCacheReader::Next(ModuleInfo *module, CachedForm &form) {
+  if (AtEnd())
+    return false;
+  form.FirstLine = FirstLines[FormIdx++];
+  form.Queries.clear();
+
+  uint64_t nQueries;
+  if (!ReadVarint(nQueries))
+    return false;
+  for (uint64_t i = 0; i < nQueries; ++i) {
+    InfixQuery query;
+    uint64_t result;
+    if (Pos >= Data.size())
+      return false;
+    query.Type = static_cast<InfixQueryTypes>(Data[Pos++]);
+    if (!ReadName(query.Name) || !ReadVarint(result))
+      return false;
+    query.Result = static_cast<int>(UnZigZag(result));
+    form.Queries.push_back(query);
+  }
+  return ReadExpression(module, form.Expr, form.FirstLine);
+}
+
+bool ModuleCacheReader::AtEnd() const {
+  return FormIdx == FirstLines.size();
+}
+
+bool ModuleCacheReader::ReadVarint(uint64_t &value) {
+  value = 0;
+  for (int shift = 0; shift < 64 && Pos < Data.size(); shift += 7) {
+    uint8_t byte = static_cast<uint8_t>(Data[Pos++]);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+bool ModuleCacheReader::ReadName(Atom &name) {
+  uint64_t id;
+  if (!ReadVarint(id) || id >= Names.size())
+    return false;
+  name = Names[id];
+  return true;
+}
+
+bool ModuleCacheReader::ReadExpression(ModuleInfo *module, ExpressionPtr &expr, size_t firstLine) {
+  uint64_t lineNum;
+  if (Pos >= Data.size())
+    return false;
+  TypeTag tag = static_cast<TypeTag>(Data[Pos++]);
+  if (!ReadVarint(lineNum))
+    return false;
+
+  SourceContext sourceContext { module, firstLine + UnZigZag(lineNum) };
+  switch (tag) {
+    case TypeTag::Int: {
+      uint64_t value;
+      if (!ReadVarint(value))
+        return false;
+      expr.reset(new Int(sourceContext, UnZigZag(value)));
+      return true;
+    }
+    case TypeTag::Float: {
+      if (Pos + 8 > Data.size())
+        return false;
+      uint64_t bits = 0;
+      for (int i = 0; i < 8; ++i)
+        bits |= static_cast<uint64_t>(static_cast<uint8_t>(Data[Pos++])) << (8 * i);
+      double value;
+      memcpy(&value, &bits, sizeof(value));
+      expr.reset(new Float(sourceContext, value));
+      return true;
+    }
+    case TypeTag::Str: {
+      uint64_t length;
+      if (!ReadVarint(length) || length > Data.size() - Pos)
+        return false;
+      expr.reset(new Str(sourceContext, Data.substr(Pos, length)));
+      Pos += length;
+      return true;
+    }
+    case TypeTag::Symbol: {
+      Atom name;
+      if (!ReadName(name))
+        return false;
+      expr.reset(new Symbol(sourceContext, name));
+      return true;
+    }
+    case TypeTag::Quote: {
+      ExpressionPtr value;
+      if (!ReadExpression(module, value, firstLine))
+        return false;
+      expr.reset(new Quote(sourceContext, move(value)));
+      return true;
+    }
+    case TypeTag::Sexp: {
+      uint64_t nArgs;
+      if (!ReadVarint(nArgs) || nArgs > Data.size() - Pos)
+        return false;
+      auto *sexp = new Sexp(sourceContext);
+      expr.reset(sexp);
+      for (uint64_t i = 0; i < nArgs; ++i) {
+        ExpressionPtr arg;
+        if (!ReadExpression(module, arg, firstLine))
+          return false;
+        sexp->Args.push_back(move(arg));
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "Expression.h"
+#include "Parser.h"
+
+// A top level form of a module as the parser left it, with the line it
+// starts on and the infix queries it depends on
+struct CachedForm {
+  size_t                  FirstLine;
+  std::vector<InfixQuery> Queries;
+  ExpressionPtr           Expr;
+};
+
+// Parsed modules saved in a directory under the hash of their source, so a
+// module that has not changed can be run without parsing it again
+class ModuleCache {
+  public:
+    explicit ModuleCache(const std::string &dir);
+    bool Enabled() const;
+    std::string GetPath(const std::string &source) const;
+
+    static uint64_t Hash(const std::string &source);
+    static const uint8_t FormatVersion;
+
+  private:
+    std::string Dir;
+};
+
+class ModuleCacheWriter {
+  public:
+    explicit ModuleCacheWriter();
+    void Add(size_t firstLine, const std::vector<InfixQuery> &queries, const Expression &expr);
+    void Invalidate();
+    bool Save(const std::string &path, const std::string &source) const;
+
+  private:
+    std::string                       Forms;
+    std::vector<size_t>               FirstLines;
+    std::vector<Atom>                 Names;
+    std::unordered_map<Atom, size_t>  NameIds;
+    bool                              Valid;
+
+    void WriteName(std::string &out, const Atom &name);
+    bool WriteExpression(std::string &out, const Expression &expr, size_t firstLine);
+};
+
+// Reads the forms one at a time, so nothing is built for the forms that
+// are not run. Any damage to the file makes Open or Next fail, Next still
+// sets the line the form starts on so the rest can be parsed instead.
+class ModuleCacheReader {
+  public:
+    explicit ModuleCacheReader();
+    bool Open(const std::string &path, const std::string &source);
+    bool Next(ModuleInfo *module, CachedForm &form);
+    bool AtEnd() const;
+
+  private:
+    std::string         Data;
+    size_t              Pos;
+    std::vector<Atom>   Names;
+    std::vector<size_t> FirstLines;
+    size_t              FormIdx;
+
+    bool ReadVarint(uint64_t &value);
+    bool ReadName(Atom &name);
+    bool ReadExpression(ModuleInfo *module, ExpressionPtr &expr, size_t firstLine);
+};
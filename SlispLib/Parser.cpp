@@ -17,6 +17,7 @@ Parser::Parser(CommandInterface &commandInterface, ITokenizer &tokenizer, Interp
   Tokenizer_ { tokenizer },
   Settings { settings },
   SourceContext_ { },
+  QueryLog { nullptr },
   Debug { debug }
 {
 }
@@ -24,10 +25,11 @@ Parser::Parser(CommandInterface &commandInterface, ITokenizer &tokenizer, Interp
 bool Parser::Parse() {
   Reset();
 
-  string line;
+  const char *line;
+  size_t length;
   ++SourceContext_.LineNum;
-  if (CommandInterface_.ReadInputLine(line)) {
-    Tokenizer_.SetLine(line);
+  if (CommandInterface_.ReadInputLine(line, length)) {
+    Tokenizer_.SetLine(line, length);
     
     ++Tokenizer_;
     bool parseResult = true;
@@ -62,11 +64,14 @@ bool Parser::HasInfixArgCount(InterpreterSettings &settings, Sexp &sexp, ArgList
   return true;
 }
 
-using InfixOp = pair<string, int>;
-bool PopulateInfixOperators(InterpreterSettings &settings, ArgList::const_iterator firstPosArg, ArgList::const_iterator endArg, vector<InfixOp> &infixOperators) {
+using InfixOp = pair<Atom, int>;
+bool PopulateInfixOperators(InterpreterSettings &settings, ArgList::const_iterator firstPosArg, ArgList::const_iterator endArg, vector<InfixOp> &infixOperators, vector<InfixQuery> *queryLog) {
   auto currArg = firstPosArg;
   if (auto firstArgSym = dynamic_cast<Symbol*>((*currArg).get())) {
-    if (settings.IsSymbolFunction(firstArgSym->Value))
+    bool isFunction = settings.IsSymbolFunction(firstArgSym->Value);
+    if (queryLog)
+      queryLog->push_back({ InfixQueryTypes::IsFunction, firstArgSym->Value, isFunction });
+    if (isFunction)
       return false;
   }
 
@@ -74,8 +79,10 @@ bool PopulateInfixOperators(InterpreterSettings &settings, ArgList::const_iterat
   while (currArg != endArg) {
     if ((argNum % 2) == 0) {
       if (auto fnSym = dynamic_cast<Symbol*>((*currArg).get())) {
-        string op = fnSym->Value;
+        Atom op = fnSym->Value;
         int precedence = settings.GetInfixSymbolPrecedence(op);
+        if (queryLog)
+          queryLog->push_back({ InfixQueryTypes::Precedence, op, precedence });
         if (precedence == InterpreterSettings::NO_PRECEDENCE)
           return false;
         infixOperators.push_back({ op, precedence });
@@ -99,7 +106,7 @@ void Parser::TransformInfixSexp(Sexp &sexp, bool isImplicit) const {
     return;
 
   vector<InfixOp> infixOperators;
-  if (!PopulateInfixOperators(Settings, firstPos, endArg, infixOperators))
+  if (!PopulateInfixOperators(Settings, firstPos, endArg, infixOperators, QueryLog))
     return;
 
   sort(begin(infixOperators), end(infixOperators), [](const InfixOp &lhs, const InfixOp &rhs) { 
@@ -138,7 +145,7 @@ void Parser::TransformInfixSexp(Sexp &sexp, bool isImplicit) const {
         }
         else {
           if (insideOp) {
-            newArgs.insert(fnCurr, opExpr->Clone());
+            fnCurr = newArgs.insert(fnCurr, opExpr->Clone()) + 1;
 
             insideOp = false;
             fnArgNum = 1;
@@ -155,11 +162,11 @@ void Parser::TransformInfixSexp(Sexp &sexp, bool isImplicit) const {
         }
       }
 
-      auto oldCurr = fnCurr;
-      ++fnCurr;
       ++totalArgNum;
       if (consumedCurrArg)
-        newArgs.erase(oldCurr);
+        fnCurr = newArgs.erase(fnCurr);
+      else
+        ++fnCurr;
     }
 
     if (!opSexp.Args.empty())
@@ -191,6 +198,23 @@ void Parser::SetSourceContext(const SourceContext &sourceContext) {
   SourceContext_ = sourceContext;
 }
 
+void Parser::SetQueryLog(vector<InfixQuery> *queryLog) {
+  QueryLog = queryLog;
+}
+
+bool Parser::QueriesMatch(const vector<InfixQuery> &queries) const {
+  for (auto &query : queries) {
+    int result;
+    if (query.Type == InfixQueryTypes::IsFunction)
+      result = Settings.IsSymbolFunction(query.Name);
+    else
+      result = Settings.GetInfixSymbolPrecedence(query.Name);
+    if (result != query.Result)
+      return false;
+  }
+  return true;
+}
+
 void Parser::Reset() {
   ExprTree = unique_ptr<Sexp>(new Sexp(SourceContext_));
   ExprTree->Args.push_back(ExpressionPtr { new Symbol { SourceContext_, Settings.GetDefaultSexp() } });
@@ -312,11 +336,12 @@ begin:
   }
   else  {
     if (Depth) {
-      string line;
+      const char *line;
+      size_t length;
       if (CommandInterface_.HasMore()) {
         ++SourceContext_.LineNum;
-        CommandInterface_.ReadContinuedInputLine(line);
-        Tokenizer_.SetLine(line);
+        CommandInterface_.ReadContinuedInputLine(line, length);
+        Tokenizer_.SetLine(line, length);
         ++Tokenizer_;
 
         TransformInfixSexp(currLineSexp, true);
@@ -1,12 +1,26 @@
 #pragma once
 #include <iostream>
 #include <memory>
+#include <vector>
 
 #include "Tokenizer.h"
 #include "Expression.h"
 #include "CommandInterface.h"
 #include "InterpreterUtils.h"
 
+enum class InfixQueryTypes: uint8_t {
+  IsFunction,
+  Precedence
+};
+
+// An answer the parser got from the settings while looking for infix
+// expressions. A parsed form can only be reused while they stay the same.
+struct InfixQuery {
+  InfixQueryTypes Type;
+  Atom            Name;
+  int             Result;
+};
+
 class Parser {
   public:
     explicit Parser(CommandInterface &commandInterface, ITokenizer &tokenizer, InterpreterSettings &settings, bool debug = false);
@@ -21,6 +35,8 @@ class Parser {
     std::unique_ptr<Sexp> ExpressionTree() const;
     SourceContext GetSourceContext() const;
     void SetSourceContext(const SourceContext &sourceContext);
+    void SetQueryLog(std::vector<InfixQuery> *queryLog);
+    bool QueriesMatch(const std::vector<InfixQuery> &queries) const;
 
   private:
     CommandInterface      &CommandInterface_;
@@ -29,6 +45,7 @@ class Parser {
     SourceContext         SourceContext_;
     std::unique_ptr<Sexp> ExprTree;
     std::string           Error_;
+    std::vector<InfixQuery> *QueryLog;
     int                   Depth;
     bool                  Debug;
 
@@ -0,0 +1,180 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <iomanip>
+
+#include "Profiler.h"
+#include "ExpressionAllocator.h"
+
+using namespace std;
+
+static const Atom AnonymousName { "fn" };
+
+bool Profiler::FunctionKey::operator==(const FunctionKey &rhs) const {
+  return Name == rhs.Name && Module == rhs.Module && LineNum == rhs.LineNum;
+}
+
+size_t Profiler::FunctionKeyHash::operator()(const FunctionKey &key) const {
+  return key.Name.Hash() ^ (hash<ModuleInfo*>()(key.Module) << 1) ^ (key.LineNum << 2);
+}
+
+//=============================================================================
+
+Profiler::Profiler():
+  FunctionIds(),
+  Functions(),
+  Nodes(),
+  Calls()
+{
+  Reset();
+}
+
+void Profiler::Enter(const Function &function) {
+  size_t functionId = GetFunctionId(function);
+  size_t parent = Calls.empty() ? ROOT : Calls.back().Node;
+  size_t node = GetChild(parent, functionId);
+  ++Nodes[node].Calls;
+  auto &stats = Functions[functionId];
+  ++stats.Calls;
+  ++stats.Active;
+  Calls.push_back(OpenCall { node, Clock::now(), ExpressionAllocator::GetStats().Objects, 0, 0 });
+}
+
+void Profiler::Exit() {
+  if (Calls.empty())
+    return;
+
+  OpenCall call = Calls.back();
+  Calls.pop_back();
+  uint64_t elapsed = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - call.Start).count();
+  uint64_t allocations = ExpressionAllocator::GetStats().Objects - call.StartAllocations;
+
+  auto &node = Nodes[call.Node];
+  node.ExclusiveNs += elapsed - min(elapsed, call.ChildNs);
+  node.Allocations += allocations - min(allocations, call.ChildAllocations);
+
+  // Recursive calls are already inside the time of the outermost one
+  auto &stats = Functions[node.Function];
+  if (--stats.Active == 0)
+    stats.InclusiveNs += elapsed;
+
+  if (!Calls.empty()) {
+    Calls.back().ChildNs += elapsed;
+    Calls.back().ChildAllocations += allocations;
+  }
+}
+
+void Profiler::Reset() {
+  FunctionIds.clear();
+  Functions.clear();
+  Nodes.clear();
+  Calls.clear();
+  Nodes.push_back(Node { ROOT, ROOT, {}, 0, 0, 0 });
+}
+
+void Profiler::WriteCollapsedStacks(ostream &out) const {
+  for (size_t node = ROOT + 1; node < Nodes.size(); ++node) {
+    uint64_t us = Nodes[node].ExclusiveNs / 1000;
+    if (us > 0) {
+      WritePath(out, node);
+      out << " " << us << "\n";
+    }
+  }
+}
+
+vector<ProfileEntry> Profiler::GetEntries() const {
+  vector<ProfileEntry> entries;
+  for (auto &stats : Functions)
+    entries.push_back(ProfileEntry { stats.Name, stats.Calls, stats.InclusiveNs, 0, 0 });
+  for (size_t node = ROOT + 1; node < Nodes.size(); ++node) {
+    auto &entry = entries[Nodes[node].Function];
+    entry.ExclusiveNs += Nodes[node].ExclusiveNs;
+    entry.Allocations += Nodes[node].Allocations;
+  }
+  sort(begin(entries), end(entries), [](const ProfileEntry &lhs, const ProfileEntry &rhs) {
+    return lhs.ExclusiveNs > rhs.ExclusiveNs;
+  });
+  return entries;
+}
+
+void Profiler::WriteSummary(ostream &out) const {
+  out << setw(10) << "calls" << setw(12) << "total ms" << setw(12) << "self ms" << setw(12) << "self allocs" << "  function\n";
+  out << fixed << setprecision(3);
+  for (auto &entry : GetEntries()) {
+    out << setw(10) << entry.Calls
+        << setw(12) << entry.InclusiveNs / 1e6
+        << setw(12) << entry.ExclusiveNs / 1e6
+        << setw(12) << entry.Allocations
+        << "  " << entry.Name << "\n";
+  }
+}
+
+// Interpreted functions are made by the lambda builtin, their body says where
+// they were written
+size_t Profiler::GetFunctionId(const Function &function) {
+  SourceContext where = function.GetSourceContext();
+  if (auto *interpreted = dynamic_cast<const InterpretedFunction*>(&function)) {
+    if (interpreted->Code)
+      where = interpreted->Code->GetSourceContext();
+  }
+  FunctionKey key { AnonymousName, where.Module, where.LineNum };
+  if (function.Symbol) {
+    if (auto *sym = dynamic_cast<const Symbol*>(function.Symbol.get()))
+      key.Name = sym->Value;
+  }
+
+  auto id = FunctionIds.find(key);
+  if (id != FunctionIds.end())
+    return id->second;
+
+  string name = key.Name.Name();
+  if (key.Module) {
+    name += " (" + key.Module->Name;
+    if (key.LineNum > 0)
+      name += ":" + to_string(key.LineNum);
+    name += ")";
+  }
+  Functions.push_back(FunctionStats { name, 0, 0, 0 });
+  FunctionIds.emplace(key, Functions.size() - 1);
+  return Functions.size() - 1;
+}
+
+size_t Profiler::GetChild(size_t parent, size_t functionId) {
+  for (size_t child : Nodes[parent].Children) {
+    if (Nodes[child].Function == functionId)
+      return child;
+  }
+  Nodes.push_back(Node { functionId, parent, {}, 0, 0, 0 });
+  Nodes[parent].Children.push_back(Nodes.size() - 1);
+  return Nodes.size() - 1;
+}
+
+void Profiler::WritePath(ostream &out, size_t node) const {
+  if (Nodes[node].Parent != ROOT) {
+    WritePath(out, Nodes[node].Parent);
+    out << ";";
+  }
+  out << Functions[Nodes[node].Function].Name;
+}
+
+//=============================================================================
+
+ProfileScope::ProfileScope(Profiler *profiler, const Function &function):
+  Profiler_(profiler)
+{
+  if (Profiler_)
+    Profiler_->Enter(function);
+}
+
+ProfileScope::~ProfileScope() {
+  if (Profiler_)
+    Profiler_->Exit();
+}
+
+// A tail call takes the place of the call that made it
+void ProfileScope::Switch(const Function &function) {
+  if (Profiler_) {
+    Profiler_->Exit();
+    Profiler_->Enter(function);
+  }
+}
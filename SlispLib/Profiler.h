@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ostream>
+#include <unordered_map>
+
+#include "Expression.h"
+#include "FunctionDef.h"
+
+struct ProfileEntry {
+  std::string Name;
+  uint64_t    Calls;
+  uint64_t    InclusiveNs;
+  uint64_t    ExclusiveNs;
+  uint64_t    Allocations;
+};
+
+// Times every function call the interpreter makes. Calls are kept in a tree
+// of call paths, so the same function reached from two callers is two nodes.
+// Functions are named with the module and line they were defined at.
+class Profiler {
+  public:
+    explicit Profiler();
+    void Enter(const Function &function);
+    void Exit();
+    void Reset();
+
+    // One line per call path: frames separated by ';' and the time spent in
+    // the last frame itself, in microseconds. Paths under 1us are left out.
+    void WriteCollapsedStacks(std::ostream &out) const;
+    std::vector<ProfileEntry> GetEntries() const;
+    void WriteSummary(std::ostream &out) const;
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct FunctionKey {
+      Atom        Name;
+      ModuleInfo *Module;
+      size_t      LineNum;
+      bool operator==(const FunctionKey &rhs) const;
+    };
+
+    struct FunctionKeyHash {
+      size_t operator()(const FunctionKey &key) const;
+    };
+
+    struct FunctionStats {
+      std::string Name;
+      uint64_t    Calls;
+      uint64_t    InclusiveNs;
+      size_t      Active;
+    };
+
+    struct Node {
+      size_t              Function;
+      size_t              Parent;
+      std::vector<size_t> Children;
+      uint64_t            Calls;
+      uint64_t            ExclusiveNs;
+      uint64_t            Allocations;
+    };
+
+    struct OpenCall {
+      size_t            Node;
+      Clock::time_point Start;
+      uint64_t          StartAllocations;
+      uint64_t          ChildNs;
+      uint64_t          ChildAllocations;
+    };
+
+    static const size_t ROOT = 0;
+
+    std::unordered_map<FunctionKey, size_t, FunctionKeyHash> FunctionIds;
+    std::vector<FunctionStats> Functions;
+    std::vector<Node>          Nodes;
+    std::vector<OpenCall>      Calls;
+
+    size_t GetFunctionId(const Function &function);
+    size_t GetChild(size_t parent, size_t functionId);
+    void WritePath(std::ostream &out, size_t node) const;
+};
+
+// Profiles the call it is declared in, does nothing without a profiler
+class ProfileScope {
+  public:
+    explicit ProfileScope(Profiler *profiler, const Function &function);
+    ~ProfileScope();
+    void Switch(const Function &function);
+
+  private:
+    Profiler *Profiler_;
+};
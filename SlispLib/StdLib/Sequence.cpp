@@ -0,0 +1,326 @@
+#include <string>
+#include <vector>
+
+#include "Sequence.h"
+
+using namespace std;
+
+//=============================================================================
+
+SequenceIterator::SequenceIterator(EvaluationContext &ctx, ExpressionPtr &&fn):
+  Interp(ctx.Interp),
+  SourceContext_(ctx.Expr_->GetSourceContext()),
+  Factory(SourceContext_),
+  FnName(ctx.CurrentFunction.Value),
+  Fn(move(fn)),
+  Curr(),
+  ItemNum(0),
+  Failed_(false)
+{
+}
+
+int64_t SequenceIterator::GetLength() {
+  return LENGTH_UNKNOWN;
+}
+
+bool SequenceIterator::Failed() const {
+  return Failed_;
+}
+
+// Reads the list, dict or sequence expr evaluates to, lazily if expr is a call.
+// Iterators move from the values they read, so a value expr only refers to,
+// such as a foreach element, is copied first.
+bool SequenceIterator::GetSource(EvaluationContext &ctx, ExpressionPtr &&expr, SequenceSource &source) {
+  source.Expr = move(expr);
+  if (!ctx.GetList(source.Expr) && !ctx.EvaluateLazy(source.Expr, "list"))
+    return false;
+
+  if (auto ref = dynamic_cast<Ref*>(source.Expr.get())) {
+    if (ref->Value)
+      source.Expr = ref->Value->Clone();
+  }
+
+  if (auto sequence = TypeHelper::GetValue<Sequence>(source.Expr))
+    source.Iterator = sequence->GetIterator();
+  else if (auto list = ctx.GetList(source.Expr))
+    source.Iterator = list->GetIterator();
+  else if (auto dict = TypeHelper::GetValue<Dict>(source.Expr))
+    source.Iterator = dict->GetIterator();
+
+  if (source.Iterator)
+    return true;
+  else
+    return ctx.TypeError("list", source.Expr);
+}
+
+// Hands the sequence to a caller that iterates it, anyone else gets a list
+bool SequenceIterator::Return(EvaluationContext &ctx, IteratorPtr &&iterator) {
+  if (ctx.IsLazy)
+    return ctx.ReturnNew<Sequence>(move(iterator));
+
+  if (auto list = ctx.New<Sexp>()) {
+    while (ExpressionPtr &curr = iterator->Next())
+      list.Val.Args.push_back(move(curr));
+    if (iterator->Failed())
+      return false;
+    return ctx.ReturnNew<Quote>(move(list.Expr));
+  }
+  else
+    return false;
+}
+
+ExpressionPtr SequenceIterator::RefTo(ExpressionFactory &factory, ExpressionPtr &value) {
+  if (auto ref = dynamic_cast<Ref*>(value.get()))
+    return ref->NewRef();
+  else
+    return ExpressionPtr { factory.Alloc<Ref>(value) };
+}
+
+ExpressionPtr& SequenceIterator::Return(ExpressionPtr &&value) {
+  Curr = move(value);
+  return Curr;
+}
+
+ExpressionPtr& SequenceIterator::End(const IIterator &source) {
+  Failed_ = source.Failed();
+  return Null;
+}
+
+ExpressionPtr& SequenceIterator::Fail(const string &what) {
+  Interp.PushError(EvalError { SourceContext_, FnName, what });
+  Failed_ = true;
+  return Null;
+}
+
+bool SequenceIterator::Call(ExpressionPtr &call) {
+  if (Interp.EvaluatePartial(call)) {
+    ++ItemNum;
+    return true;
+  }
+  Fail("Failed to call " + Fn->ToString() + " on item " + to_string(ItemNum));
+  return false;
+}
+
+bool SequenceIterator::Test(ExpressionPtr &item, bool &result) {
+  ExpressionPtr call { Factory.Alloc<Sexp>() };
+  auto &callArgs = static_cast<Sexp&>(*call).Args;
+  callArgs.push_back(RefTo(Factory, Fn));
+  callArgs.push_back(item->Clone());
+  if (!Call(call))
+    return false;
+
+  if (auto value = TypeHelper::GetValue<Bool>(call)) {
+    result = value->Value;
+    return true;
+  }
+  Fail("Expecting: " + Bool::TypeInstance.Name() + ". Got: " + call->Type().Name());
+  return false;
+}
+
+//=============================================================================
+
+RangeIterator::RangeIterator(EvaluationContext &ctx, int64_t start, int64_t end, int64_t step):
+  SequenceIterator(ctx, ExpressionPtr {}),
+  Value(start),
+  Last(end),
+  Step(step)
+{
+}
+
+ExpressionPtr& RangeIterator::Next() {
+  if (Step > 0 ? Value > Last : Value < Last)
+    return Null;
+  Curr.reset(Factory.Alloc<Int>(Value));
+  Value += Step;
+  return Curr;
+}
+
+int64_t RangeIterator::GetLength() {
+  if (Step > 0 ? Value > Last : Value < Last)
+    return 0;
+  return (Last - Value) / Step + 1;
+}
+
+//=============================================================================
+
+MapIterator::MapIterator(EvaluationContext &ctx, ExpressionPtr &&fn, SequenceSource &&source):
+  SequenceIterator(ctx, move(fn)),
+  Source(move(source))
+{
+}
+
+ExpressionPtr& MapIterator::Next() {
+  ExpressionPtr &item = Source.Iterator->Next();
+  if (!item)
+    return End(*Source.Iterator);
+
+  ExpressionPtr call { Factory.Alloc<Sexp>() };
+  auto &callArgs = static_cast<Sexp&>(*call).Args;
+  callArgs.push_back(RefTo(Factory, Fn));
+  callArgs.push_back(move(item));
+  if (Call(call))
+    return Return(move(call));
+  else
+    return Null;
+}
+
+int64_t MapIterator::GetLength() {
+  return Source.Iterator->GetLength();
+}
+
+//=============================================================================
+
+FilterIterator::FilterIterator(EvaluationContext &ctx, ExpressionPtr &&fn, SequenceSource &&source, bool keep):
+  SequenceIterator(ctx, move(fn)),
+  Source(move(source)),
+  Keep(keep)
+{
+}
+
+ExpressionPtr& FilterIterator::Next() {
+  while (ExpressionPtr &item = Source.Iterator->Next()) {
+    bool matches = false;
+    if (!Test(item, matches))
+      return Null;
+    if (matches == Keep)
+      return item;
+  }
+  return End(*Source.Iterator);
+}
+
+size_t FilterIterator::GetItemsRead() const {
+  return ItemNum;
+}
+
+//=============================================================================
+
+TakeIterator::TakeIterator(EvaluationContext &ctx, int64_t count, SequenceSource &&source):
+  SequenceIterator(ctx, ExpressionPtr {}),
+  Source(move(source)),
+  Count(count)
+{
+}
+
+TakeIterator::TakeIterator(EvaluationContext &ctx, ExpressionPtr &&fn, SequenceSource &&source):
+  SequenceIterator(ctx, move(fn)),
+  Source(move(source)),
+  Count(-1)
+{
+}
+
+ExpressionPtr& TakeIterator::Next() {
+  if (Count == 0)
+    return Null;
+
+  ExpressionPtr &item = Source.Iterator->Next();
+  if (!item)
+    return End(*Source.Iterator);
+
+  if (Fn) {
+    bool matches = false;
+    if (!Test(item, matches))
+      return Null;
+    if (!matches) {
+      Count = 0;
+      return Null;
+    }
+  }
+  else
+    --Count;
+  return item;
+}
+
+//=============================================================================
+
+SkipIterator::SkipIterator(EvaluationContext &ctx, int64_t count, SequenceSource &&source):
+  SequenceIterator(ctx, ExpressionPtr {}),
+  Source(move(source)),
+  Count(count),
+  Skipped(false)
+{
+}
+
+SkipIterator::SkipIterator(EvaluationContext &ctx, ExpressionPtr &&fn, SequenceSource &&source):
+  SequenceIterator(ctx, move(fn)),
+  Source(move(source)),
+  Count(-1),
+  Skipped(false)
+{
+}
+
+ExpressionPtr& SkipIterator::Next() {
+  while (!Skipped && Count != 0) {
+    ExpressionPtr &item = Source.Iterator->Next();
+    if (!item)
+      return End(*Source.Iterator);
+
+    if (Fn) {
+      bool matches = false;
+      if (!Test(item, matches))
+        return Null;
+      if (!matches) {
+        Skipped = true;
+        return item;
+      }
+    }
+    else
+      --Count;
+  }
+  Skipped = true;
+
+  ExpressionPtr &item = Source.Iterator->Next();
+  if (item)
+    return item;
+  else
+    return End(*Source.Iterator);
+}
+
+//=============================================================================
+
+ZipIterator::ZipIterator(EvaluationContext &ctx, ExpressionPtr &&fn, vector<SequenceSource> &&sources):
+  SequenceIterator(ctx, move(fn)),
+  Sources(move(sources))
+{
+}
+
+ExpressionPtr& ZipIterator::Next() {
+  ExpressionPtr element { Factory.Alloc<Sexp>() };
+  auto &elementArgs = static_cast<Sexp&>(*element).Args;
+  if (Fn)
+    elementArgs.push_back(RefTo(Factory, Fn));
+
+  bool more = true;
+  size_t listNum = 1;
+  for (auto &source : Sources) {
+    ExpressionPtr &item = source.Iterator->Next();
+    if (!item && source.Iterator->Failed())
+      return End(*source.Iterator);
+
+    if (listNum > 1) {
+      if (!item == more)
+        return Fail("list " + to_string(listNum) + " has a different length than list 1");
+    }
+    else
+      more = item.operator bool();
+
+    if (more)
+      elementArgs.push_back(move(item));
+    ++listNum;
+  }
+
+  if (!more)
+    return Null;
+
+  string elementName = "element " + to_string(++ItemNum);
+  if (Fn) {
+    if (!Interp.EvaluatePartial(element))
+      return Fail("Failed to evaluate arg: " + elementName);
+    return Return(move(element));
+  }
+
+  for (auto &item : elementArgs) {
+    if (!Interp.EvaluatePartial(item))
+      return Fail("Failed to evaluate arg: " + elementName);
+  }
+  return Return(ExpressionPtr { Factory.Alloc<Quote>(move(element)) });
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "../Interpreter.h"
+
+// A list or lazy sequence being read, together with the expression that owns
+// its values
+struct SequenceSource {
+  ExpressionPtr Expr;
+  IteratorPtr   Iterator;
+};
+
+// Iterators of a lazy pipeline. Each one pulls values from its source only
+// when the consumer asks for the next one, and may move from the values its
+// source returns. An error ends the sequence and is reported in the name of
+// the builtin that built the iterator.
+class SequenceIterator: public IIterator {
+  public:
+    explicit SequenceIterator(EvaluationContext &ctx, ExpressionPtr &&fn);
+    virtual int64_t GetLength() override;
+    virtual bool Failed() const override;
+
+    static bool GetSource(EvaluationContext &ctx, ExpressionPtr &&expr, SequenceSource &source);
+    static bool Return(EvaluationContext &ctx, IteratorPtr &&iterator);
+    static ExpressionPtr RefTo(ExpressionFactory &factory, ExpressionPtr &value);
+
+  protected:
+    Interpreter       &Interp;
+    SourceContext     SourceContext_;
+    ExpressionFactory Factory;
+    std::string       FnName;
+    ExpressionPtr     Fn;
+    ExpressionPtr     Curr;
+    size_t            ItemNum;
+    bool              Failed_;
+
+    ExpressionPtr& Return(ExpressionPtr &&value);
+    ExpressionPtr& End(const IIterator &source);
+    ExpressionPtr& Fail(const std::string &what);
+    bool Call(ExpressionPtr &call);
+    bool Test(ExpressionPtr &item, bool &result);
+};
+
+class RangeIterator: public SequenceIterator {
+  public:
+    explicit RangeIterator(EvaluationContext &ctx, int64_t start, int64_t end, int64_t step);
+    virtual ExpressionPtr& Next() override;
+    virtual int64_t GetLength() override;
+
+  private:
+    int64_t Value;
+    int64_t Last;
+    int64_t Step;
+};
+
+class MapIterator: public SequenceIterator {
+  public:
+    explicit MapIterator(EvaluationContext &ctx, ExpressionPtr &&fn, SequenceSource &&source);
+    virtual ExpressionPtr& Next() override;
+    virtual int64_t GetLength() override;
+
+  private:
+    SequenceSource Source;
+};
+
+// Values for which the predicate returns keep, so (any) and (all) can stop
+// at the first value that decides them
+class FilterIterator: public SequenceIterator {
+  public:
+    explicit FilterIterator(EvaluationContext &ctx, ExpressionPtr &&fn, SequenceSource &&source, bool keep);
+    virtual ExpressionPtr& Next() override;
+    size_t GetItemsRead() const;
+
+  private:
+    SequenceSource Source;
+    bool           Keep;
+};
+
+class TakeIterator: public SequenceIterator {
+  public:
+    explicit TakeIterator(EvaluationContext &ctx, int64_t count, SequenceSource &&source);
+    explicit TakeIterator(EvaluationContext &ctx, ExpressionPtr &&fn, SequenceSource &&source);
+    virtual ExpressionPtr& Next() override;
+
+  private:
+    SequenceSource Source;
+    int64_t        Count;
+};
+
+class SkipIterator: public SequenceIterator {
+  public:
+    explicit SkipIterator(EvaluationContext &ctx, int64_t count, SequenceSource &&source);
+    explicit SkipIterator(EvaluationContext &ctx, ExpressionPtr &&fn, SequenceSource &&source);
+    virtual ExpressionPtr& Next() override;
+
+  private:
+    SequenceSource Source;
+    int64_t        Count;
+    bool           Skipped;
+};
+
+// Calls fn with the nth value of every source, or makes a list of them when
+// there is no fn
+class ZipIterator: public SequenceIterator {
+  public:
+    explicit ZipIterator(EvaluationContext &ctx, ExpressionPtr &&fn, std::vector<SequenceSource> &&sources);
+    virtual ExpressionPtr& Next() override;
+
+  private:
+    std::vector<SequenceSource> Sources;
+};
@@ -9,8 +9,10 @@
 #include <cstdarg>
 #include <csignal>
 #include <cmath>
+#include <type_traits>
 
 #include "StdLib.h"
+#include "Sequence.h"
 #include "../Interpreter.h"
 
 #include "../NumConverter.h"
@@ -138,7 +140,7 @@ bool StdLib::Load(Interpreter &interpreter) {
   );
 
   // IO
-  initializer_list<ExampleDef> ioExample {
+  initializer_list<ExampleText> ioExample {
     {"(file.writelines \"ioExample.txt\" (\"line1\" \"line2\"))", "true"},
     {"(file.readlines \"ioExample.txt\")", "(\"line1\" \"line2\")"},
     {"(file.delete \"ioExample.txt\")", "true"},
@@ -180,7 +182,7 @@ bool StdLib::Load(Interpreter &interpreter) {
 
   // Assignment Operators
 
-  FuncDef setDef { FuncDef::Args({&Symbol::TypeInstance, &Sexp::TypeInstance}), FuncDef::OneArg(Literal::TypeInstance) };  
+  FuncDef setDef { FuncDef::Args({&Symbol::TypeInstance, &Sexp::TypeInstance}), FuncDef::OneArg(Literal::TypeInstance), FuncDef::MutatesArgs };  
   symbols.PutSymbolFunction(
     "set", 
     {"(set symbol value) -> value"},
@@ -199,13 +201,13 @@ bool StdLib::Load(Interpreter &interpreter) {
   ); 
 
     
-  string setWithOpDoc = "perform operation on current symbol and return new value. value can be: int, float, str, list";
+  const char *setWithOpDoc = "perform operation on current symbol and return new value. value can be: int, float, str, list";
   symbols.PutSymbolFunction(
     "+=",
     {"(+= symbol value) -> value"},
     setWithOpDoc,
     {{"(= foo 2)", "2"}, {"(+= foo 3)", "5"}},
-    StdLib::Set, 
+    StdLib::SetAdd, 
     setDef.Clone()
   ); 
   symbols.PutSymbolFunction(
@@ -213,7 +215,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     {"(-= symbol value) -> value"},
     setWithOpDoc,
     {{"(= foo 2)", "2"}, {"(-= foo 3)", "-1"}},
-    StdLib::Set,
+    StdLib::SetSub,
     setDef.Clone()
   ); 
   symbols.PutSymbolFunction(
@@ -281,13 +283,13 @@ bool StdLib::Load(Interpreter &interpreter) {
     setDef.Clone()
   ); 
   
-  FuncDef incrDef { FuncDef::OneArg(Symbol::TypeInstance), FuncDef::OneArg(Literal::TypeInstance) };
+  FuncDef incrDef { FuncDef::OneArg(Symbol::TypeInstance), FuncDef::OneArg(Literal::TypeInstance), FuncDef::MutatesArgs };
   symbols.PutSymbolFunction(
     "++",
     {"(++ symbol) -> value"},
     "increment symbol and return new value",
     {{"(= foo 2)", "2"}, {"(++ foo)", "3"}},
-    StdLib::Set,
+    StdLib::SetAdd,
     incrDef.Clone()
   ); 
   symbols.PutSymbolFunction(
@@ -295,7 +297,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     {"(-- symbol) -> value"},
     "decrement symbol and return new value",
     {{"(= foo 2)", "2"}, {"(-- foo)", "1"}},
-    StdLib::Set, 
+    StdLib::SetSub, 
     incrDef.Clone()
   ); 
 
@@ -305,7 +307,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     "make symbol undefined",
     {},
     StdLib::UnSet,
-    FuncDef { FuncDef::OneArg(Symbol::TypeInstance), FuncDef::OneArg(Literal::TypeInstance) }
+    FuncDef { FuncDef::OneArg(Symbol::TypeInstance), FuncDef::OneArg(Literal::TypeInstance), FuncDef::MutatesArgs }
   );
 
   // Generic
@@ -313,8 +315,8 @@ bool StdLib::Load(Interpreter &interpreter) {
   symbols.PutSymbolFunction(
     "length",
     {"(length iterable) -> int"},
-    "return the length of iterable (str, list)",
-    {{"(length \"abc\")", "3"}, {"(length (42 53 64))", "3"}},
+    "return the length of iterable (str, list, dict)",
+    {{"(length \"abc\")", "3"}, {"(length (42 53 64))", "3"}, {"(length (dict 1 2))", "1"}},
     StdLib::Length, 
     FuncDef { FuncDef::OneArg(Literal::TypeInstance), FuncDef::OneArg(Int::TypeInstance) }
   );
@@ -329,7 +331,7 @@ bool StdLib::Load(Interpreter &interpreter) {
   symbols.PutSymbolFunction(
     "empty?",
     {"(empty? iterable) -> bool"},
-    "return whether iterable (list, str) is empty",
+    "return whether iterable (list, str, dict) is empty",
     {{"(empty? \"abc\")", "false"}},
     StdLib::EmptyQ,
     FuncDef { FuncDef::OneArg(Literal::TypeInstance), FuncDef::OneArg(Bool::TypeInstance) }
@@ -400,7 +402,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     FuncDef { FuncDef::AtleastOneArg(Literal::TypeInstance), FuncDef::OneArg(Literal::TypeInstance) }
   );
 
-  FuncDef foreachDef { FuncDef::ManyArgs(Sexp::TypeInstance, 2, ArgDef::ANY_ARGS), FuncDef::OneArg(Literal::TypeInstance) };
+  FuncDef foreachDef { FuncDef::ManyArgs(Sexp::TypeInstance, 2, ArgDef::ANY_ARGS), FuncDef::OneArg(Literal::TypeInstance), FuncDef::MutatesArgs };
   symbols.PutSymbolFunction(
     "foreach",
     {"(foreach item iterable .. expressions) -> value", "(foreach item in iterable .. expressions) -> value",
@@ -1066,7 +1068,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     "add item to front of existing list (in place)",
     {{"(set a '(4))", "(4)"}, {"(push-front! a 3)", "nil"}, {"a", "(3 4)"}},
     StdLib::Push,
-    FuncDef { FuncDef::Args({&Symbol::TypeInstance, &Literal::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance) }
+    FuncDef { FuncDef::Args({&Symbol::TypeInstance, &Literal::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance), FuncDef::MutatesArgs }
   );
   symbols.PutSymbolFunction(
     "push-back", 
@@ -1082,7 +1084,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     "add item to back of existing list (in place)",
     {{"(set a '(4))", "(4)"}, {"(push-back! a 3)", "nil"}, {"a", "(4 3)"}},
     StdLib::Push,
-    FuncDef { FuncDef::Args({&Symbol::TypeInstance, &Literal::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance) }
+    FuncDef { FuncDef::Args({&Symbol::TypeInstance, &Literal::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance), FuncDef::MutatesArgs }
   );
   symbols.PutSymbolFunction(
     "pop-front", 
@@ -1098,7 +1100,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     "remove item from front of existing list (in place)",
     {{"(set a '(3 4))", ""}, {"(pop-front! a)", "()"}, {"a", "(4)"}},
     StdLib::Pop,
-    FuncDef { FuncDef::Args({&Symbol::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance) }
+    FuncDef { FuncDef::Args({&Symbol::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance), FuncDef::MutatesArgs }
   );
   symbols.PutSymbolFunction(
     "pop-back", 
@@ -1114,7 +1116,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     "remove item from back of existing list (in place)",
     {{"(set a '(3 4))", ""}, {"(pop-back! a)", "()"}, {"a", "(3)"}},
     StdLib::Pop,
-    FuncDef { FuncDef::Args({&Symbol::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance) }
+    FuncDef { FuncDef::Args({&Symbol::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance), FuncDef::MutatesArgs }
   );
   symbols.PutSymbolFunction(
     "range", 
@@ -1132,6 +1134,105 @@ bool StdLib::Load(Interpreter &interpreter) {
     StdLib::Range, 
     FuncDef { FuncDef::ManyArgs(Int::TypeInstance, 2), FuncDef::OneArg(Quote::TypeInstance) }
   );
+  symbols.PutSymbolFunction(
+    "sort", 
+    {"(sort list) -> list", "(sort less list) -> list"},
+    "returns a new list with the items in order of (<), or of the less function. Equal items keep their order",
+    {{"(sort (3 1 2))", "(1 2 3)"}, {"(sort > (3 1 2))", "(3 2 1)"}},
+    StdLib::Sort,
+    FuncDef { FuncDef::ManyArgs(Sexp::TypeInstance, 1, 2), FuncDef::OneArg(Quote::TypeInstance) }
+  );
+  symbols.PutSymbolFunction(
+    "sort!", 
+    {"(sort! list) -> nil", "(sort! less list) -> nil"},
+    "sort existing list (in place)",
+    {{"(set a '(3 1 2))", "(3 1 2)"}, {"(sort! a)", "nil"}, {"a", "(1 2 3)"}},
+    StdLib::SortInPlace,
+    FuncDef { FuncDef::ManyArgs(Sexp::TypeInstance, 1, 2), FuncDef::OneArg(Quote::TypeInstance), FuncDef::MutatesArgs }
+  );
+  symbols.PutSymbolFunction(
+    "sort-by", 
+    {"(sort-by key list) -> list"},
+    "returns a new list with the items in order of (<) applied to (key item)",
+    {{"(sort-by length (\"ccc\" \"a\" \"bb\"))", "(\"a\" \"bb\" \"ccc\")"}},
+    StdLib::SortBy,
+    FuncDef { FuncDef::Args({&Function::TypeInstance, &Sexp::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance) }
+  );
+
+  // Dicts
+
+  symbols.PutSymbolFunction(
+    "dict",
+    {"(dict .. key value) -> dict"},
+    "construct a dict from pairs of keys and values. keys are bools, ints, floats or strs",
+    {{"(dict \"a\" 1 \"b\" 2)", "{\"a\" 1 \"b\" 2}"}},
+    StdLib::DictFunc,
+    FuncDef { FuncDef::AnyArgs(Literal::TypeInstance), FuncDef::OneArg(Dict::TypeInstance) }
+  );
+  symbols.PutSymbolFunction(
+    "dict-get",
+    {"(dict-get dict key) -> value", "(dict-get dict key default) -> value"},
+    "get the value of key, or default if dict does not contain key",
+    {{"(dict-get (dict \"a\" 1) \"a\")", "1"}, {"(dict-get (dict \"a\" 1) \"b\" 0)", "0"}},
+    StdLib::DictGet,
+    FuncDef { FuncDef::ManyArgs(Literal::TypeInstance, 2, 3), FuncDef::OneArg(Literal::TypeInstance) }
+  );
+  symbols.PutSymbolFunction(
+    "dict-put",
+    {"(dict-put dict key value) -> dict"},
+    "returns a new dict with key set to value",
+    {{"(dict-put (dict \"a\" 1) \"b\" 2)", "{\"a\" 1 \"b\" 2}"}},
+    StdLib::DictPut,
+    FuncDef { FuncDef::Args({&Dict::TypeInstance, &Literal::TypeInstance, &Literal::TypeInstance}), FuncDef::OneArg(Dict::TypeInstance) }
+  );
+  symbols.PutSymbolFunction(
+    "dict-put!",
+    {"(dict-put! dict key value) -> nil"},
+    "set key to value in existing dict (in place)",
+    {{"(set d (dict))", "{}"}, {"(dict-put! d \"a\" 1)", "nil"}, {"d", "{\"a\" 1}"}},
+    StdLib::DictPutInPlace,
+    FuncDef { FuncDef::Args({&Symbol::TypeInstance, &Literal::TypeInstance, &Literal::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance), FuncDef::MutatesArgs }
+  );
+  symbols.PutSymbolFunction(
+    "dict-remove",
+    {"(dict-remove dict key) -> dict"},
+    "returns a new dict without key",
+    {{"(dict-remove (dict \"a\" 1 \"b\" 2) \"a\")", "{\"b\" 2}"}},
+    StdLib::DictRemove,
+    FuncDef { FuncDef::Args({&Dict::TypeInstance, &Literal::TypeInstance}), FuncDef::OneArg(Dict::TypeInstance) }
+  );
+  symbols.PutSymbolFunction(
+    "dict-remove!",
+    {"(dict-remove! dict key) -> nil"},
+    "remove key from existing dict (in place)",
+    {{"(set d (dict \"a\" 1))", "{\"a\" 1}"}, {"(dict-remove! d \"a\")", "nil"}, {"d", "{}"}},
+    StdLib::DictRemoveInPlace,
+    FuncDef { FuncDef::Args({&Symbol::TypeInstance, &Literal::TypeInstance}), FuncDef::OneArg(Quote::TypeInstance), FuncDef::MutatesArgs }
+  );
+  symbols.PutSymbolFunction(
+    "dict-keys",
+    {"(dict-keys dict) -> list"},
+    "list of the keys in dict",
+    {{"(dict-keys (dict \"a\" 1 \"b\" 2))", "(\"a\" \"b\")"}},
+    StdLib::DictKeys,
+    FuncDef { FuncDef::OneArg(Dict::TypeInstance), FuncDef::OneArg(Quote::TypeInstance) }
+  );
+  symbols.PutSymbolFunction(
+    "dict-values",
+    {"(dict-values dict) -> list"},
+    "list of the values in dict",
+    {{"(dict-values (dict \"a\" 1 \"b\" 2))", "(1 2)"}},
+    StdLib::DictValues,
+    FuncDef { FuncDef::OneArg(Dict::TypeInstance), FuncDef::OneArg(Quote::TypeInstance) }
+  );
+  symbols.PutSymbolFunction(
+    "dict-contains?",
+    {"(dict-contains? dict key) -> bool"},
+    "does dict contain key?",
+    {{"(dict-contains? (dict \"a\" 1) \"a\")", "true"}},
+    StdLib::DictContains,
+    FuncDef { FuncDef::Args({&Dict::TypeInstance, &Literal::TypeInstance}), FuncDef::OneArg(Bool::TypeInstance) }
+  );
 
   // Logical
 
@@ -1261,7 +1362,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     "unquote (evaluate) expression",
     {{"(unquote (quote (+ 3 4)))", "7"}},
     StdLib::Unquote, 
-    FuncDef { FuncDef::OneArg(Sexp::TypeInstance), FuncDef::OneArg(Quote::TypeInstance) }
+    FuncDef { FuncDef::OneArg(Sexp::TypeInstance), FuncDef::OneArg(Quote::TypeInstance), FuncDef::MutatesArgs }
   );
 
   symbols.PutSymbolFunction(
@@ -1320,7 +1421,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     "create anonymous function",
     {{"(lambda (x) (+ x 10))", "<Function>"}},
     StdLib::Lambda, 
-    FuncDef { FuncDef::ManyArgs(Sexp::TypeInstance, 2), FuncDef::OneArg(Function::TypeInstance) }
+    FuncDef { FuncDef::ManyArgs(Sexp::TypeInstance, 2), FuncDef::OneArg(Function::TypeInstance), FuncDef::MutatesArgs }
   );
   symbols.PutSymbolFunction(
     "fn", 
@@ -1328,7 +1429,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     "alias for (lambda)",
     {},
     StdLib::Lambda, 
-    FuncDef { FuncDef::ManyArgs(Sexp::TypeInstance, 2), FuncDef::OneArg(Function::TypeInstance) }
+    FuncDef { FuncDef::ManyArgs(Sexp::TypeInstance, 2), FuncDef::OneArg(Function::TypeInstance), FuncDef::MutatesArgs }
   );
   symbols.PutSymbolFunction(
     "def", 
@@ -1336,7 +1437,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     "define named function",
     {{"(def add (a b) (+ a b))", "<Function:add>"}},
     StdLib::Def, 
-    FuncDef { FuncDef::ManyArgs(Sexp::TypeInstance, 3, ArgDef::ANY_ARGS), FuncDef::OneArg(Function::TypeInstance) }
+    FuncDef { FuncDef::ManyArgs(Sexp::TypeInstance, 3, ArgDef::ANY_ARGS), FuncDef::OneArg(Function::TypeInstance), FuncDef::MutatesArgs }
   );
   symbols.PutSymbolFunction(
     "apply", 
@@ -1344,7 +1445,7 @@ bool StdLib::Load(Interpreter &interpreter) {
     "evaluate fn with arglist",
     {{"(apply + (1 2 3))", "6"}},
     StdLib::Apply, 
-    FuncDef { FuncDef::Args({ &Function::TypeInstance, &Sexp::TypeInstance }), FuncDef::OneArg(Literal::TypeInstance) }
+    FuncDef { FuncDef::Args({ &Function::TypeInstance, &Sexp::TypeInstance }), FuncDef::OneArg(Literal::TypeInstance), FuncDef::MutatesArgs }
   );
   symbols.PutSymbolFunction(
     "error", 
@@ -1430,6 +1531,14 @@ bool StdLib::Load(Interpreter &interpreter) {
     StdLib::TypeQFunc, 
     FuncDef { FuncDef::OneArg(Literal::TypeInstance), FuncDef::OneArg(Bool::TypeInstance) }
   );
+  symbols.PutSymbolFunction(
+    "dict?", 
+    {"(dict? value) -> bool"},
+    "is value a dict?",
+    {{"(dict? 42)", "false"}},
+    StdLib::TypeQFunc, 
+    FuncDef { FuncDef::OneArg(Literal::TypeInstance), FuncDef::OneArg(Bool::TypeInstance) }
+  );
   symbols.PutSymbolFunction(
     "fn?", 
     {"(fn? value) -> bool"},
@@ -1545,6 +1654,19 @@ bool StdLib::Load(Interpreter &interpreter) {
   return true;
 }
 
+// For an interpreter restored from a snapshot that has the library loaded,
+// only the environment can differ
+bool StdLib::Attach(Interpreter &interpreter) {
+  auto *thisModule = interpreter.GetModule("StdLib");
+  if (!thisModule)
+    return false;
+
+  SourceContext_ = SourceContext(thisModule, 0);
+  auto symbols = interpreter.GetDynamicSymbols(SourceContext_);
+  LoadEnvironment(symbols, interpreter.GetEnvironment());
+  return true;
+}
+
 void StdLib::UnLoad(Interpreter &interpreter) {
   //TODO
 }
@@ -1684,7 +1806,7 @@ bool StdLib::Exit(EvaluationContext &ctx) {
 
 bool StdLib::Symbols(EvaluationContext &ctx) {
   if (auto sexp = ctx.New<Sexp>()) {
-    ctx.Interp.GetDynamicSymbols(ctx.GetSourceContext()).ForEach([&ctx, &sexp](const std::string &symName, ExpressionPtr &expr) {
+    ctx.Interp.GetDynamicSymbols(ctx.GetSourceContext()).ForEachSorted([&ctx, &sexp](const std::string &symName, ExpressionPtr &expr) {
       sexp.Val.Args.emplace_back(ctx.Alloc<Str>(symName));
     });
     return ctx.ReturnNew<Quote>(move(sexp.Expr));
@@ -1719,17 +1841,19 @@ bool LookupSymbol(EvaluationContext &ctx, ExpressionPtr &currArg, string &symNam
 
 bool StdLib::Help(EvaluationContext &ctx) {
   string defaultSexp = ctx.Interp.GetSettings().GetDefaultSexp();
+  auto &docs = ctx.Interp.GetFunctionDocs();
   stringstream ss;
   bool fullHelp = false;
-  Interpreter::SymbolFunctor functor = [&ss, &defaultSexp, &fullHelp](const string &symbolName, ExpressionPtr &expr) {
+  Interpreter::SymbolFunctor functor = [&ss, &defaultSexp, &docs, &fullHelp](const string &symbolName, ExpressionPtr &expr) {
     if (symbolName != defaultSexp) {
       if (auto fn = TypeHelper::GetValue<Function>(expr)) {
-        for (auto &sig : fn->Signatures)
+        auto &doc = docs.Find(fn->DocName);
+        for (auto &sig : doc.Signatures)
           ss << sig << endl;
         if (fullHelp) {
-          if (!fn->Doc.empty())
-            ss << fn->Doc << endl;
-          for (auto &ex : fn->Examples) {
+          if (!doc.Doc.empty())
+            ss << doc.Doc << endl;
+          for (auto &ex : doc.Examples) {
             ss << "Example: " << ex.Code << " => " << ex.ExpectedValue << endl;
           }
           ss << endl;
@@ -1741,7 +1865,7 @@ bool StdLib::Help(EvaluationContext &ctx) {
   auto symbols = ctx.Interp.GetDynamicSymbols(ctx.GetSourceContext());
   if (ctx.Args.empty()) {
     fullHelp = false;
-    symbols.ForEach(functor);
+    symbols.ForEachSorted(functor);
   }
   else {
     fullHelp = true;
@@ -1768,15 +1892,15 @@ bool HelpSubFunction(EvaluationContext &ctx, F functor) {
   ExpressionPtr symValue;
   if (LookupSymbol(ctx, ctx.Args.front(), symName, symValue)) {
     if (auto fn = TypeHelper::GetValue<Function>(symValue))
-      return ctx.Return(functor(*fn));
+      return ctx.Return(functor(ctx.Interp.GetFunctionDocs().Find(fn->DocName)));
   }
   return false;
 }
 
 bool StdLib::HelpSignatures(EvaluationContext &ctx) {
-  return HelpSubFunction(ctx, [&ctx](Function &fn) { 
+  return HelpSubFunction(ctx, [&ctx](const FunctionDoc &doc) { 
     if (auto list = ctx.New<Sexp>()) {
-      for (auto &sig : fn.Signatures)
+      for (auto &sig : doc.Signatures)
         list.Val.Args.emplace_back(ctx.Alloc<Str>(sig));
       return ctx.Alloc<Quote>(move(list.Expr)); 
     }
@@ -1785,15 +1909,15 @@ bool StdLib::HelpSignatures(EvaluationContext &ctx) {
 }
 
 bool StdLib::HelpDoc(EvaluationContext &ctx) {
-  return HelpSubFunction(ctx, [&ctx](Function &fn) { 
-    return ctx.Alloc<Str>(fn.Doc); 
+  return HelpSubFunction(ctx, [&ctx](const FunctionDoc &doc) { 
+    return ctx.Alloc<Str>(doc.Doc); 
   });
 }
 
 bool StdLib::HelpExamples(EvaluationContext &ctx) {
-  return HelpSubFunction(ctx, [&ctx](Function &fn) { 
+  return HelpSubFunction(ctx, [&ctx](const FunctionDoc &doc) { 
     if (auto list = ctx.New<Sexp>()) {
-      for (auto &example : fn.Examples) {
+      for (auto &example : doc.Examples) {
         if (auto ex = ctx.New<Sexp>()) {
           ex.Val.Args.emplace_back(ctx.Alloc<Str>(example.Code));
           ex.Val.Args.emplace_back(ctx.Alloc<Str>(example.ExpectedValue));
@@ -1861,6 +1985,55 @@ bool StdLib::Set(EvaluationContext &ctx) {
     return false;
 }
 
+static const Atom AddSymbol { "+" };
+static const Atom SubSymbol { "-" };
+static const Atom IncrSymbol { "incr" };
+static const Atom DecrSymbol { "decr" };
+
+// Ints and floats are updated where the symbol keeps them. Other values, or an
+// operator that has been rebound, go through Set and the operator function.
+template <class I, class F>
+bool StdLib::SetNumber(EvaluationContext &ctx, const Atom &opName, I iFn, F fFn) {
+  if (!TypeHelper::SimpleIsA<Symbol>(ctx.Args.front()))
+    return Set(ctx);
+  if (ctx.Args.size() > 1 && !ctx.Evaluate(ctx.Args[1], "value"))
+    return false;
+
+  auto &symToSet = static_cast<Symbol&>(*ctx.Args.front());
+  Expression *operand = ctx.Args.size() > 1 ? ctx.Args[1].get() : nullptr;
+  Expression *value = nullptr;
+  if (ctx.Interp.GetCurrentStackFrame().GetSymbol(symToSet, value) && value && ctx.Interp.IsBuiltin(opName)) {
+    if (auto ref = dynamic_cast<Ref*>(value))
+      value = ref->Value.get();
+    if (auto ref = dynamic_cast<Ref*>(operand))
+      operand = ref->Value.get();
+    const TypeInfo *operandType = ctx.Args.size() == 1 ? &Int::TypeInstance : operand ? &operand->Type() : nullptr;
+    if (value && &value->Type() == &Int::TypeInstance && operandType == &Int::TypeInstance) {
+      auto &num = static_cast<Int&>(*value).Value;
+      num = iFn(num, operand ? static_cast<Int&>(*operand).Value : 1);
+      return ctx.ReturnNew<Int>(num);
+    }
+    else if (value && &value->Type() == &Float::TypeInstance && operandType == &Float::TypeInstance) {
+      auto &num = static_cast<Float&>(*value).Value;
+      num = fFn(num, static_cast<Float&>(*operand).Value);
+      return ctx.ReturnNew<Float>(num);
+    }
+  }
+  return Set(ctx);
+}
+
+bool StdLib::SetAdd(EvaluationContext &ctx) {
+  return SetNumber(ctx, ctx.Args.size() > 1 ? AddSymbol : IncrSymbol,
+    [](int64_t a, int64_t b) { return a + b; },
+    [](double a, double b) { return a + b; });
+}
+
+bool StdLib::SetSub(EvaluationContext &ctx) {
+  return SetNumber(ctx, ctx.Args.size() > 1 ? SubSymbol : DecrSymbol,
+    [](int64_t a, int64_t b) { return a - b; },
+    [](double a, double b) { return a - b; });
+}
+
 bool StdLib::UnSet(EvaluationContext &ctx) {
   ExpressionPtr sym = move(ctx.Args.front());
   ctx.Args.pop_front();
@@ -2041,6 +2214,15 @@ bool StdLib::At(EvaluationContext &ctx) {
         return ctx.Error("index " + to_string(idx) + " is out of bounds");
       }
     }
+    else if (auto *list = ctx.GetList(itArg)) {
+      int64_t length = static_cast<int64_t>(list->Args.size());
+      if (idx < 0)
+        idx += length;
+      if (idx >= 0 && idx < length)
+        return ctx.Return(list->Args[static_cast<size_t>(idx)]->Clone());
+      else
+        return ctx.Error("index " + to_string(idx) + " is out of bounds");
+    }
     else if (auto *iterable = dynamic_cast<IIterable*>(itArg.get())) {
       if (IteratorPtr iterator = iterable->GetIterator()) {
         if (idx < 0) {
@@ -2094,19 +2276,21 @@ bool StdLib::Add(EvaluationContext &ctx) {
 bool StdLib::Length(EvaluationContext &ctx) {
   return SequenceFn(ctx, 
     [&ctx](string &value)  { return ctx.Alloc<Int>(value.size()); },
-    [&ctx](ArgList &value) { return ctx.Alloc<Int>(value.size()); }
+    [&ctx](ArgList &value) { return ctx.Alloc<Int>(value.size()); },
+    [&ctx](Dict &value)    { return ctx.Alloc<Int>(value.size()); }
   );
 }
 
 bool StdLib::EmptyQ(EvaluationContext &ctx) {
   return SequenceFn(ctx, 
     [&ctx](string &value)  { return ctx.Alloc<Bool>(value.empty()); },
-    [&ctx](ArgList &value) { return ctx.Alloc<Bool>(value.empty()); }
+    [&ctx](ArgList &value) { return ctx.Alloc<Bool>(value.empty()); },
+    [&ctx](Dict &value)    { return ctx.Alloc<Bool>(value.empty()); }
   );
 }
 
-template <class S, class L>
-bool StdLib::SequenceFn(EvaluationContext &ctx, S strFn, L listFn) {
+template <class S, class L, class D>
+bool StdLib::SequenceFn(EvaluationContext &ctx, S strFn, L listFn, D dictFn) {
   ExpressionPtr arg = move(ctx.Args.front());
   ctx.Args.clear();
   if (ctx.Evaluate(arg, 1)) {
@@ -2118,7 +2302,9 @@ bool StdLib::SequenceFn(EvaluationContext &ctx, S strFn, L listFn) {
           return ctx.Return(listFn(listSexp->Args));
       }
     }
-    return ctx.TypeError("str/list", arg);
+    else if (auto dict = TypeHelper::GetValue<Dict>(arg))
+      return ctx.Return(dictFn(*dict));
+    return ctx.TypeError("str/list/dict", arg);
   }
   else
     return false;
@@ -2152,6 +2338,21 @@ bool StdLib::Min(EvaluationContext &ctx) {
   return GenericNumFunc(ctx, StdLib::MinInt, StdLib::MinFloat);
 }
 
+// Loop bodies are evaluated from ctx.Args in the selected engine. compiled
+// keeps the VM's code for each statement across iterations.
+static bool EvaluateLoopBody(EvaluationContext &ctx, size_t firstStatement, vector<CodeBlockPtr> &compiled, ExpressionPtr &result) {
+  const ArgList &body = ctx.Args;
+  compiled.resize(body.size());
+  for (size_t statementIdx = firstStatement; statementIdx < body.size(); ++statementIdx) {
+    if (!ctx.Interp.EvaluateStatement(*body[statementIdx], compiled[statementIdx], result))
+      return ctx.EvaluateError("body" + to_string(statementIdx - firstStatement + 1));
+  }
+  return true;
+}
+
+static const Atom InSymbol { "in" };
+static const Atom ColonSymbol { ":" };
+
 // (foreach e lst (display e))
 // (foreach e in lst (display e))
 // (foreach lst display)
@@ -2164,14 +2365,14 @@ bool StdLib::Foreach(EvaluationContext &ctx) {
   if (auto firstSym = ctx.GetRequiredValue<Symbol>(firstArg)) {
     Symbol* currElementSym = nullptr; 
     ExpressionPtr iterableValueOrSym;
-    Function *fn = nullptr;
+    ExpressionPtr fn;
     auto nRemainingArgs = ctx.Args.size();
     if (nRemainingArgs == 0) {
       iterableValueOrSym = move(firstArg);
       if (ctx.Evaluate(secondArg, "fn")) {
-        fn = ctx.GetRequiredValue<Function>(secondArg);
-        if (!fn)
+        if (!ctx.GetRequiredValue<Function>(secondArg))
           return false;
+        fn = move(secondArg);
       }
       else
         return false;
@@ -2179,7 +2380,7 @@ bool StdLib::Foreach(EvaluationContext &ctx) {
     else {
       if (nRemainingArgs > 1) {
         if (auto optionalInSym = TypeHelper::GetValue<Symbol>(secondArg)) {
-          if (optionalInSym->Value == "in" || optionalInSym->Value == ":") {
+          if (optionalInSym->Value == InSymbol || optionalInSym->Value == ColonSymbol) {
             secondArg = move(ctx.Args.front());
             ctx.Args.pop_front();
           }
@@ -2195,7 +2396,7 @@ bool StdLib::Foreach(EvaluationContext &ctx) {
         return ctx.UnknownSymbolError(iterableSym->Value);
     }
     else if (auto sexp = TypeHelper::GetValue<Sexp>(iterableValueOrSym)) {
-      if (ctx.Evaluate(iterableValueOrSym, "iterable expression")) 
+      if (ctx.EvaluateLazy(iterableValueOrSym, "iterable expression")) 
         iterableArg = iterableValueOrSym.get();
       else
         return false;
@@ -2209,39 +2410,30 @@ bool StdLib::Foreach(EvaluationContext &ctx) {
     return false;
 }
 
-bool StdLib::ForeachIterate(EvaluationContext &ctx, Expression *iterableArg, Symbol *currElementSym, Function *fn) {
+// The loop variable is bound once and pointed at each item in turn
+bool StdLib::ForeachIterate(EvaluationContext &ctx, Expression *iterableArg, Symbol *currElementSym, ExpressionPtr &fn) {
+  ctx.IsTail = false;
   if (auto *iterable = dynamic_cast<IIterable*>(iterableArg)) {
     if (IteratorPtr iterator = iterable->GetIterator()) {
-      ArgList bodyCopy;
-      ArgListHelper::CopyTo(ctx.Args, bodyCopy);
-      bool more = false;
-      do {
-        ExpressionPtr& curr = iterator->Next();
-        more = curr.operator bool();
-        if (more) {
-          if (currElementSym) {
-            Scope scope(ctx.Interp.GetCurrentStackFrame().GetLocalSymbols(), ctx.GetSourceContext());
-            scope.PutSymbol(currElementSym->Value, ExpressionPtr { ctx.Alloc<Ref>(curr) }); 
-            ctx.Args.clear();
-            ArgListHelper::CopyTo(bodyCopy, ctx.Args);
-            if (!Begin(ctx))
-              return false;
-          }
-          else {
-            if (auto fnEval = ctx.New<Sexp>()) {
-              fnEval.Val.Args.push_back(fn->Clone());
-              fnEval.Val.Args.emplace_back(ctx.Alloc<Ref>(curr));
-              if (ctx.Evaluate(fnEval.Expr, "function evaluation"))
-                ctx.Return(fnEval.Expr);
-              else
-                return false;
-            }
-            else
-              return false;
-          }
+      LocalScope scope(ctx.Interp.GetCurrentStackFrame(), ctx.GetSourceContext());
+      ExpressionPtr result;
+      vector<CodeBlockPtr> compiledBody;
+      while (ExpressionPtr &curr = iterator->Next()) {
+        if (currElementSym) {
+          scope.RebindSymbol(currElementSym->Value, ExpressionPtr { ctx.Alloc<Ref>(curr) });
+          if (!EvaluateLoopBody(ctx, 0, compiledBody, result))
+            return false;
         }
-      } while (more);
-      return true;
+        else {
+          ArgList fnArgs;
+          fnArgs.emplace_back(ctx.Alloc<Ref>(curr));
+          if (!ctx.Interp.CallFunction(fn, fnArgs, result))
+            return ctx.EvaluateError("function evaluation");
+        }
+      }
+      if (iterator->Failed())
+        return false;
+      return result ? ctx.Return(result) : true;
     }
   }
   return ctx.Error("argument is not iterable");
@@ -2913,104 +3105,62 @@ bool StdLib::List(EvaluationContext &ctx) {
     return false;
 }
 
-// TODO: Refactor
 bool StdLib::TransformList(EvaluationContext &ctx, ListTransforms transform) {
   ExpressionPtr fnExpr { move(ctx.Args.front()) };
   ctx.Args.pop_front();
+  if (!ctx.GetRequiredValue<Function>(fnExpr))
+    return false;
 
-  ExpressionPtr listExpr { move(ctx.Args.front()) };
+  SequenceSource source;
+  if (!SequenceIterator::GetSource(ctx, move(ctx.Args.front()), source))
+    return false;
   ctx.Args.pop_front();
 
-  ExpressionPtr resultExpr { };
-  if (transform == ListTransforms::Map ||
-      transform == ListTransforms::Filter ||
-      transform == ListTransforms::Take ||
-      transform == ListTransforms::Skip)
-    resultExpr.reset(ctx.Alloc<Sexp>());
-  else if (transform == ListTransforms::Any)
-    resultExpr.reset(ctx.Alloc<Bool>(false));
-  else if (transform == ListTransforms::All)
-    resultExpr.reset(ctx.Alloc<Bool>(true));
-
-  auto resultList = static_cast<Sexp*>(resultExpr.get());
-
-  int i = -1;
-  if (auto fn = ctx.GetRequiredValue<Function>(fnExpr)) {
-    if (auto list = ctx.GetRequiredListValue(listExpr)) {
-      if ((transform == ListTransforms::Reduce ||
-           transform == ListTransforms::Any ||
-           transform == ListTransforms::All)
-          && list->Args.empty())
+  switch (transform) {
+    case ListTransforms::Map:
+      return SequenceIterator::Return(ctx, IteratorPtr { new MapIterator(ctx, move(fnExpr), move(source)) });
+    case ListTransforms::Filter:
+      return SequenceIterator::Return(ctx, IteratorPtr { new FilterIterator(ctx, move(fnExpr), move(source), true) });
+    case ListTransforms::Take:
+      return SequenceIterator::Return(ctx, IteratorPtr { new TakeIterator(ctx, move(fnExpr), move(source)) });
+    case ListTransforms::Skip:
+      return SequenceIterator::Return(ctx, IteratorPtr { new SkipIterator(ctx, move(fnExpr), move(source)) });
+    case ListTransforms::Any:
+    case ListTransforms::All: {
+      bool isAny = transform == ListTransforms::Any;
+      FilterIterator deciding(ctx, move(fnExpr), move(source), isAny);
+      bool found = deciding.Next().operator bool();
+      if (deciding.Failed())
+        return false;
+      else if (!found && deciding.GetItemsRead() == 0)
         return ctx.Error("empty list not allowed");
+      return ctx.ReturnNew<Bool>(isAny ? found : !found);
+    }
+    case ListTransforms::Reduce:
+      break;
+  }
 
-      while (!list->Args.empty()) {
-        ++i;
-        ExpressionPtr item = move(list->Args.front());
-        list->Args.pop_front();
-
-        auto eval = ctx.New<Sexp>();
-        if (!eval)
-          return false;
-
-        eval.Val.Args.push_back(fn->Clone());
-
-        if (transform == ListTransforms::Reduce) {
-          if (resultExpr)
-            eval.Val.Args.push_back(resultExpr->Clone());
-          else {
-            resultExpr = item->Clone();
-            continue;
-          }
-        }
+  IIterator &items = *source.Iterator;
+  ExpressionPtr result = move(items.Next());
+  if (!result)
+    return items.Failed() ? false : ctx.Error("empty list not allowed");
 
-        eval.Val.Args.push_back(item->Clone());
-        if (!ctx.EvaluateNoError(eval.Expr))
-          return ctx.Error("Failed to call " +  fn->ToString() + " on item " + to_string(i));
-
-        if (transform == ListTransforms::Map)
-          resultList->Args.push_back(move(eval.Expr));
-        else if (transform == ListTransforms::Filter ||
-                 transform == ListTransforms::Any ||
-                 transform == ListTransforms::All ||
-                 transform == ListTransforms::Take ||
-                 transform == ListTransforms::Skip) {
-          if (auto predResult = ctx.GetRequiredValue<Bool>(eval.Expr)) {
-            if (transform == ListTransforms::Filter || transform == ListTransforms::Take) {
-              if (predResult->Value)
-                resultList->Args.push_back(item->Clone());
-              else if (transform == ListTransforms::Take) 
-                return ctx.ReturnNew<Quote>(move(resultExpr));
-            }
-            else if (transform == ListTransforms::Skip) {
-              if (!predResult->Value) {
-                resultList->Args.push_back(item->Clone());
-                ArgListHelper::CopyTo(list->Args, resultList->Args);
-                return ctx.ReturnNew<Quote>(move(resultExpr));
-              }
-            }
-            else if (transform == ListTransforms::Any) {
-              if (predResult->Value) 
-                return ctx.ReturnNew<Bool>(true);
-            }
-            else if (transform == ListTransforms::All) {
-              if (!predResult->Value)
-                return ctx.ReturnNew<Bool>(false);
-            }
-          }
-          else
-            return false;
-        }
-        else if (transform == ListTransforms::Reduce)
-          resultExpr = move(eval.Expr);
-      }
-    }
-    else 
+  int i = 0;
+  while (ExpressionPtr &item = items.Next()) {
+    auto eval = ctx.New<Sexp>();
+    if (!eval)
       return false;
+
+    eval.Val.Args.push_back(SequenceIterator::RefTo(ctx.Factory, fnExpr));
+    eval.Val.Args.push_back(move(result));
+    eval.Val.Args.push_back(move(item));
+    if (!ctx.EvaluateNoError(eval.Expr))
+      return ctx.Error("Failed to call " +  fnExpr->ToString() + " on item " + to_string(++i));
+    result = move(eval.Expr);
   }
-  else
+  if (items.Failed())
     return false;
-
-  return ctx.ReturnNew<Quote>(move(resultExpr));
+  return ctx.ReturnNew<Quote>(move(result));
 }
 
 bool StdLib::Map(EvaluationContext &ctx) {
@@ -3043,27 +3193,13 @@ bool StdLib::TakeSkip(EvaluationContext &ctx, bool isTake) {
       if (count.Value < 0)
         return ctx.Error("count cannot be < 0");
 
-      ExpressionPtr listExpr = move(ctx.Args.front());
-      if (auto list = ctx.GetRequiredListValue(listExpr)) {
-        if (auto newList = ctx.New<Sexp>()) {
-          if (isTake) {
-            while (!list->Args.empty() && count.Value--) {
-              newList.Val.Args.push_back(move(list->Args.front()));
-              list->Args.pop_front();
-            }
-          }
-          else {
-            while (!list->Args.empty() && count.Value--)
-              list->Args.pop_front();
-            ArgListHelper::CopyTo(list->Args, newList.Val.Args);
-          }
-          return ctx.ReturnNew<Quote>(move(newList.Expr));
-        }
-        else
-          return false;
-      }
-      else
+      SequenceSource source;
+      if (!SequenceIterator::GetSource(ctx, move(ctx.Args.front()), source))
         return false;
+      if (isTake)
+        return SequenceIterator::Return(ctx, IteratorPtr { new TakeIterator(ctx, count.Value, move(source)) });
+      else
+        return SequenceIterator::Return(ctx, IteratorPtr { new SkipIterator(ctx, count.Value, move(source)) });
     }
     else if (TypeHelper::IsA<Function>(ctx.Args.front()))
       return TransformList(ctx, isTake ? ListTransforms::Take : ListTransforms::Skip);
@@ -3083,83 +3219,43 @@ bool StdLib::Skip(EvaluationContext &ctx) {
 }
 
 bool StdLib::Zip(EvaluationContext &ctx) {
-  auto result = ctx.New<Sexp>();
-  if (!result)
-    return false;
-  
-  int ctxArgNum = 1;
-  bool evalArg = true;
   ExpressionPtr fnArg;
-  if (ctx.Evaluate(ctx.Args.front(), ctxArgNum)) {
+  if (ctx.Evaluate(ctx.Args.front(), 1)) {
     if (TypeHelper::IsA<Function>(ctx.Args.front())) {
       fnArg = move(ctx.Args.front());
       ctx.Args.pop_front();
     }
-    else {
-      fnArg.reset(ctx.Alloc<Symbol>("list"));
-      evalArg = false; // don't eval first arg twice
-    }
   }
   else
     return false;
   
-  vector<Sexp*> lists;
+  vector<SequenceSource> sources;
   for (auto &listArg : ctx.Args) {
-    if (evalArg) {
-      if (!ctx.Evaluate(listArg, ctxArgNum++))
-        return false;
-    }
-    evalArg = true;
-
-    if (auto listValue = ctx.GetRequiredListValue(listArg))
-      lists.push_back(listValue);
-    else
+    sources.emplace_back();
+    if (!SequenceIterator::GetSource(ctx, move(listArg), sources.back()))
       return false;
   }
 
-  if (lists.empty())
+  if (sources.empty())
     return ctx.Error("expected at least one list");
 
-  int elementNum = 1;
-  bool more = true;
-  while (more) {
-    auto eval = ctx.New<Sexp>();
-    if (!eval)
-      return false;
-
-    eval.Val.Args.push_back(fnArg->Clone());
-
-    int listNum = 1;
-    for (auto &list : lists) {
-      if (listNum > 1) {
-        if (list->Args.empty() == more)
-          return ctx.Error("list " + to_string(listNum) + " has a different length than list 1");
-      }
-      else
-        more = !list->Args.empty();
-
-      if (more) {
-        eval.Val.Args.push_back(move(list->Args.front()));
-        list->Args.pop_front();
-      }
-      ++listNum;
-    }
-
-    if (more) {
-      if (ctx.Evaluate(eval.Expr, "element " + to_string(elementNum++)))
-        result.Val.Args.emplace_back(move(eval.Expr));
-      else
-        return false;
-    }
+  // Lengths known up front are checked before any element is handed out, the
+  // rest only once one of the sources runs out
+  int64_t firstLength = sources.front().Iterator->GetLength();
+  for (size_t listNum = 2; listNum <= sources.size(); ++listNum) {
+    int64_t length = sources[listNum - 1].Iterator->GetLength();
+    if (firstLength != IIterator::LENGTH_UNKNOWN && length != IIterator::LENGTH_UNKNOWN && length != firstLength)
+      return ctx.Error("list " + to_string(listNum) + " has a different length than list 1");
   }
 
-  return ctx.ReturnNew<Quote>(move(result.Expr));
+  return SequenceIterator::Return(ctx, IteratorPtr { new ZipIterator(ctx, move(fnArg), move(sources)) });
 }
 
-// const symbols!!
+static const Atom NilSymbol { "nil" };
+
 Sexp* GetSexpFromListExpr(EvaluationContext &ctx, ExpressionPtr &listExpr) {
   if (auto *sym = ctx.GetRequiredValue<Symbol>(listExpr)) {
-    if (sym->Value != "nil") {
+    if (sym->Value != NilSymbol) {
       Expression *value = nullptr;
       if (ctx.GetSymbol(sym->Value, value) && value) {
         if (auto *quotedValue = dynamic_cast<Quote*>(value)) {
@@ -3296,10 +3392,7 @@ bool StdLib::Tail(EvaluationContext &ctx) {
     else {
       list->Args.pop_front();
       if (auto newList = ctx.New<Sexp>()) {
-        while (!list->Args.empty()) {
-          newList.Val.Args.push_back(move(list->Args.front()));
-          list->Args.pop_front();
-        }
+        newList.Val.Args = move(list->Args);
         return ctx.ReturnNew<Quote>(move(newList.Expr));
       }
       else
@@ -3361,13 +3454,7 @@ bool StdLib::Range(EvaluationContext &ctx) {
           return ctx.Error("start cannot be less than end when using a negative step");
       }
 
-      if (auto list = ctx.New<Sexp>()) {
-        for (int64_t i = start; positiveStep ? (i <= end) : (i >= end); i += step)
-          list.Val.Args.emplace_back(ctx.Alloc<Int>(i));
-        return ctx.ReturnNew<Quote>(move(list.Expr));
-      }
-      else
-        return false;
+      return SequenceIterator::Return(ctx, IteratorPtr { new RangeIterator(ctx, start, end, step) });
     }
     else
       return false;
@@ -3376,6 +3463,367 @@ bool StdLib::Range(EvaluationContext &ctx) {
     return false;
 }
 
+// Sorting
+
+// The values are moved out of the keys and sorted side by side, rather than
+// reached through every item on each comparison
+template <class T, class It, class GetKey>
+static void StableSortByValue(It first, It last, GetKey key) {
+  using Item = typename iterator_traits<It>::value_type;
+  using IndexedValue = pair<decltype(T::Value), size_t>;
+  vector<IndexedValue> values;
+  values.reserve(last - first);
+  size_t idx = 0;
+  for (auto curr = first; curr != last; ++curr, ++idx)
+    values.emplace_back(move(static_cast<T&>(*key(*curr)).Value), idx);
+
+  stable_sort(begin(values), end(values), [](const IndexedValue &lhs, const IndexedValue &rhs) {
+    return lhs.first < rhs.first;
+  });
+
+  vector<Item> sorted;
+  sorted.reserve(values.size());
+  for (auto &value : values) {
+    Item &item = first[value.second];
+    static_cast<T&>(*key(item)).Value = move(value.first);
+    sorted.push_back(move(item));
+  }
+  move(begin(sorted), end(sorted), first);
+}
+
+// Orders items the way (<) does, so their keys all have to be of one type
+template <class It, class GetKey>
+static bool SortByValue(EvaluationContext &ctx, It first, It last, GetKey key) {
+  if (first == last)
+    return true;
+
+  auto &type = key(*first)->Type();
+  for (auto curr = first; curr != last; ++curr) {
+    if (&key(*curr)->Type() != &type)
+      return ctx.TypeError(type, key(*curr));
+  }
+
+  if (&type == &Bool::TypeInstance)
+    StableSortByValue<Bool>(first, last, key);
+  else if (&type == &Int::TypeInstance)
+    StableSortByValue<Int>(first, last, key);
+  else if (&type == &Float::TypeInstance)
+    StableSortByValue<Float>(first, last, key);
+  else if (&type == &Str::TypeInstance)
+    StableSortByValue<Str>(first, last, key);
+  else
+    return ctx.TypeError("bool/int/float/str", key(*first));
+  return true;
+}
+
+// Items can be handed to less by ref when it can't keep or change them, which
+// builtins declare
+static bool CanPassItemsByRef(ExpressionPtr &lessFn) {
+  if (auto *compiled = dynamic_cast<CompiledFunction*>(TypeHelper::GetValue<Function>(lessFn)))
+    return !compiled->Def.HasFlag(FuncDef::MutatesArgs);
+  return false;
+}
+
+// Stable bottom-up merge sort. Each merge only reads inside its two runs, so
+// a less that isn't a strict weak ordering leaves the items in some order
+// rather than running off the ends like std::stable_sort can.
+template <class Less>
+static void MergeSort(ArgList &items, Less less) {
+  size_t nItems = items.size();
+  vector<ExpressionPtr> from, to(nItems);
+  from.reserve(nItems);
+  for (auto &item : items)
+    from.push_back(move(item));
+
+  for (size_t width = 1; width < nItems; width *= 2) {
+    for (size_t lo = 0; lo < nItems; lo += 2 * width) {
+      size_t mid = min(lo + width, nItems),
+             hi  = min(lo + 2 * width, nItems),
+             l   = lo,
+             r   = mid,
+             out = lo;
+      while (l < mid && r < hi)
+        to[out++] = move(less(from[r], from[l]) ? from[r++] : from[l++]);
+      while (l < mid)
+        to[out++] = move(from[l++]);
+      while (r < hi)
+        to[out++] = move(from[r++]);
+    }
+    swap(from, to);
+  }
+  move(begin(from), end(from), begin(items));
+}
+
+// less is called on refs to the items when it can't keep them, otherwise on
+// copies. Once a call fails the remaining comparisons are skipped.
+static bool SortByFunction(EvaluationContext &ctx, ExpressionPtr &lessFn, ArgList &items) {
+  bool byRef = CanPassItemsByRef(lessFn);
+  bool failed = false;
+  MergeSort(items, [&ctx, &lessFn, byRef, &failed](const ExpressionPtr &lhs, const ExpressionPtr &rhs) {
+    if (failed)
+      return false;
+
+    ArgList args;
+    if (byRef) {
+      args.emplace_back(ctx.Alloc<Ref>(const_cast<ExpressionPtr&>(lhs)));
+      args.emplace_back(ctx.Alloc<Ref>(const_cast<ExpressionPtr&>(rhs)));
+    }
+    else {
+      args.push_back(lhs->Clone());
+      args.push_back(rhs->Clone());
+    }
+    ExpressionPtr result;
+    if (ctx.Interp.CallFunction(lessFn, args, result)) {
+      if (auto value = TypeHelper::GetValue<Bool>(result))
+        return value->Value;
+      ctx.TypeError(Bool::TypeInstance, result);
+    }
+    failed = true;
+    return false;
+  });
+  return !failed;
+}
+
+static ExpressionPtr& ItemKey(ExpressionPtr &item) {
+  return item;
+}
+
+// sort! is given the name of the list, sort a copy
+static bool SortList(EvaluationContext &ctx, bool inplace) {
+  ExpressionPtr lessFn;
+  if (ctx.Args.size() == 2) {
+    lessFn = move(ctx.Args.front());
+    ctx.Args.pop_front();
+    if (!ctx.Evaluate(lessFn, 1) || !ctx.GetRequiredValue<Function>(lessFn))
+      return false;
+  }
+
+  ExpressionPtr listExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+  Sexp *list = inplace ? GetSexpFromListExpr(ctx, listExpr) : ctx.GetRequiredListValue(listExpr);
+  if (!list)
+    return false;
+
+  // A comparator looking at the list sees it empty rather than part way
+  // sorted, and may have replaced it by the time the items go back
+  ArgList items { move(list->Args) };
+  bool sorted = lessFn ? SortByFunction(ctx, lessFn, items) : SortByValue(ctx, begin(items), end(items), ItemKey);
+  if (inplace && !(list = GetSexpFromListExpr(ctx, listExpr)))
+    return false;
+  list->Args = move(items);
+
+  if (!sorted)
+    return false;
+  return inplace ? ctx.ReturnNil() : ctx.Return(listExpr);
+}
+
+bool StdLib::Sort(EvaluationContext &ctx) {
+  return SortList(ctx, false);
+}
+
+bool StdLib::SortInPlace(EvaluationContext &ctx) {
+  return SortList(ctx, true);
+}
+
+// The key function is called once per item
+bool StdLib::SortBy(EvaluationContext &ctx) {
+  using KeyedItem = pair<ExpressionPtr, ExpressionPtr>;
+  ExpressionPtr keyFn = move(ctx.Args.front());
+  ctx.Args.pop_front();
+  ExpressionPtr listExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+  Sexp *list = ctx.GetRequiredListValue(listExpr);
+  if (!list)
+    return false;
+
+  vector<KeyedItem> keyed;
+  keyed.reserve(list->Args.size());
+  for (auto &item : list->Args) {
+    ArgList args;
+    args.push_back(item->Clone());
+    ExpressionPtr key;
+    if (!ctx.Interp.CallFunction(keyFn, args, key))
+      return false;
+    if (auto ref = dynamic_cast<Ref*>(key.get()))
+      key = ref->Value->Clone();
+    keyed.emplace_back(move(key), move(item));
+  }
+
+  auto getKey = [](KeyedItem &item) -> ExpressionPtr& { return item.first; };
+  if (!SortByValue(ctx, begin(keyed), end(keyed), getKey))
+    return false;
+  for (size_t i = 0; i < keyed.size(); ++i)
+    list->Args[i] = move(keyed[i].second);
+  return ctx.Return(listExpr);
+}
+
+// Dicts
+
+// A dict keeps values of its own, so a ref is replaced by a copy of its value
+static ExpressionPtr DictValue(ExpressionPtr &&expr) {
+  if (auto ref = dynamic_cast<Ref*>(expr.get()))
+    return ref->Value->Clone();
+  else
+    return move(expr);
+}
+
+static bool GetDictKey(EvaluationContext &ctx, ExpressionPtr &keyExpr) {
+  keyExpr = DictValue(move(keyExpr));
+  if (Dict::IsKey(*keyExpr))
+    return true;
+  else
+    return ctx.TypeError("bool/int/float/str", keyExpr);
+}
+
+static Dict* GetDictFromSymbol(EvaluationContext &ctx, ExpressionPtr &dictExpr) {
+  if (auto *sym = ctx.GetRequiredValue<Symbol>(dictExpr)) {
+    Expression *value = nullptr;
+    if (ctx.GetSymbol(sym->Value, value) && value) {
+      if (auto *dict = dynamic_cast<Dict*>(value))
+        return dict;
+      ctx.TypeError(Dict::TypeInstance, dictExpr);
+    }
+    else
+      ctx.UnknownSymbolError(sym->Value);
+  }
+  return nullptr;
+}
+
+// The in place variants are given the name of the dict, the others a copy
+template <class F>
+static bool PerformDictOp(EvaluationContext &ctx, ExpressionPtr &dictExpr, bool inplace, F fn) {
+  Dict *dict = nullptr;
+  if (inplace)
+    dict = GetDictFromSymbol(ctx, dictExpr);
+  else {
+    dictExpr = DictValue(move(dictExpr));
+    dict = ctx.GetRequiredValue<Dict>(dictExpr);
+  }
+
+  if (!dict)
+    return false;
+  fn(*dict);
+  return inplace ? ctx.ReturnNil() : ctx.Return(dictExpr);
+}
+
+bool StdLib::DictFunc(EvaluationContext &ctx) {
+  if (ctx.Args.size() % 2 != 0)
+    return ctx.Error("expected pairs of keys and values");
+
+  if (auto dict = ctx.New<Dict>()) {
+    while (!ctx.Args.empty()) {
+      ExpressionPtr keyExpr = move(ctx.Args.front());
+      ctx.Args.pop_front();
+      ExpressionPtr valueExpr = move(ctx.Args.front());
+      ctx.Args.pop_front();
+      if (!GetDictKey(ctx, keyExpr))
+        return false;
+      dict.Val.Put(move(keyExpr), DictValue(move(valueExpr)));
+    }
+    return ctx.Return(dict.Expr);
+  }
+  else
+    return false;
+}
+
+bool StdLib::DictGet(EvaluationContext &ctx) {
+  ExpressionPtr dictExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+  ExpressionPtr keyExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+
+  auto *dict = ctx.GetRequiredValue<Dict>(dictExpr);
+  if (!dict || !GetDictKey(ctx, keyExpr))
+    return false;
+
+  if (auto *value = dict->Find(*keyExpr))
+    return ctx.Return(value->Clone());
+  else if (!ctx.Args.empty())
+    return ctx.Return(DictValue(move(ctx.Args.front())));
+  else
+    return ctx.Error("key " + keyExpr->ToString() + " not found");
+}
+
+static bool PutInDict(EvaluationContext &ctx, bool inplace) {
+  ExpressionPtr dictExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+  ExpressionPtr keyExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+  ExpressionPtr valueExpr = DictValue(move(ctx.Args.front()));
+  ctx.Args.pop_front();
+
+  if (!GetDictKey(ctx, keyExpr))
+    return false;
+  return PerformDictOp(ctx, dictExpr, inplace, [&keyExpr, &valueExpr](Dict &dict) {
+    dict.Put(move(keyExpr), move(valueExpr));
+  });
+}
+
+bool StdLib::DictPut(EvaluationContext &ctx) {
+  return PutInDict(ctx, false);
+}
+
+bool StdLib::DictPutInPlace(EvaluationContext &ctx) {
+  return PutInDict(ctx, true);
+}
+
+static bool RemoveFromDict(EvaluationContext &ctx, bool inplace) {
+  ExpressionPtr dictExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+  ExpressionPtr keyExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+
+  if (!GetDictKey(ctx, keyExpr))
+    return false;
+  return PerformDictOp(ctx, dictExpr, inplace, [&keyExpr](Dict &dict) {
+    dict.Remove(*keyExpr);
+  });
+}
+
+bool StdLib::DictRemove(EvaluationContext &ctx) {
+  return RemoveFromDict(ctx, false);
+}
+
+bool StdLib::DictRemoveInPlace(EvaluationContext &ctx) {
+  return RemoveFromDict(ctx, true);
+}
+
+template <class F>
+static bool DictToList(EvaluationContext &ctx, F getItem) {
+  auto *dict = ctx.GetRequiredValue<Dict>(ctx.Args.front());
+  if (!dict)
+    return false;
+
+  if (auto list = ctx.New<Sexp>()) {
+    for (size_t i = 0; i < dict->size(); ++i)
+      list.Val.Args.push_back(getItem(*dict, i)->Clone());
+    return ctx.ReturnNew<Quote>(move(list.Expr));
+  }
+  else
+    return false;
+}
+
+bool StdLib::DictKeys(EvaluationContext &ctx) {
+  return DictToList(ctx, [](const Dict &dict, size_t i) -> const ExpressionPtr& { return dict.KeyAt(i); });
+}
+
+bool StdLib::DictValues(EvaluationContext &ctx) {
+  return DictToList(ctx, [](const Dict &dict, size_t i) -> const ExpressionPtr& { return dict.ValueAt(i); });
+}
+
+bool StdLib::DictContains(EvaluationContext &ctx) {
+  ExpressionPtr dictExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+  ExpressionPtr keyExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+
+  auto *dict = ctx.GetRequiredValue<Dict>(dictExpr);
+  if (dict && GetDictKey(ctx, keyExpr))
+    return ctx.ReturnNew<Bool>(dict->Find(*keyExpr) != nullptr);
+  else
+    return false;
+}
+
 // Logical
 
 bool StdLib::BinaryLogicalFunc(EvaluationContext &ctx, bool isAnd) {
@@ -3555,7 +4003,7 @@ bool StdLib::Cond(EvaluationContext &ctx) {
         if (ctx.Evaluate(boolExpr, "condition")) {
           if (auto boolResult = ctx.GetRequiredValue<Bool>(boolExpr)) {
             if (boolResult->Value) {
-              if (ctx.Evaluate(statementExpr, "statement"))
+              if (ctx.EvaluateTail(statementExpr, "statement"))
                 return ctx.Return(statementExpr);
               else
                 return false;
@@ -3660,37 +4108,21 @@ bool StdLib::Switch(EvaluationContext &ctx) {
 
 bool StdLib::While(EvaluationContext &ctx) {
   ExpressionPtr lastStatementResult = List::GetNil(ctx.GetSourceContext());
-  ArgList loopArgs;
+  const Expression &condExpr = *static_cast<const ArgList&>(ctx.Args).front();
+  ExpressionPtr condResult;
+  vector<CodeBlockPtr> compiled(ctx.Args.size());
   while (true) {
-    loopArgs.clear();
-    ArgListHelper::CopyTo(ctx.Args, loopArgs);
-    ExpressionPtr condExpr = move(loopArgs.front());
-    loopArgs.pop_front();
-    if (ctx.Evaluate(condExpr, "condition")) {
-      if (auto condResult = ctx.GetRequiredValue<Bool>(condExpr)) {
-        if (condResult->Value) {
-          int bodyStatementNum = 1;
-          while (!loopArgs.empty()) {
-            ExpressionPtr currBodyStatement = move(loopArgs.front());
-            loopArgs.pop_front();
-            if (ctx.Evaluate(currBodyStatement, "body" + to_string(bodyStatementNum)))
-              lastStatementResult = move(currBodyStatement);
-            else
-              return false;
-            ++bodyStatementNum;
-          }
-        }
-        else 
-          return ctx.Return(lastStatementResult);
-      }
-      else
+    if (!ctx.Interp.EvaluateStatement(condExpr, compiled.front(), condResult))
+      return ctx.EvaluateError("condition");
+    if (auto cond = ctx.GetRequiredValue<Bool>(condResult)) {
+      if (!cond->Value)
+        return ctx.Return(lastStatementResult);
+      if (!EvaluateLoopBody(ctx, 1, compiled, lastStatementResult))
         return false;
     }
     else
       return false;
   }
-
-  return false;
 }
 
 bool StdLib::If(EvaluationContext &ctx) {
@@ -3716,7 +4148,7 @@ bool StdLib::If(EvaluationContext &ctx) {
       else 
         branchExpr = List::GetNil(ctx.GetSourceContext());
 
-      if (ctx.Evaluate(branchExpr, "branch"))
+      if (ctx.EvaluateTail(branchExpr, "branch"))
         return ctx.Return(branchExpr);
       else
         return false; 
@@ -3730,7 +4162,7 @@ bool StdLib::If(EvaluationContext &ctx) {
 
 // TODO: Go through all the code and harden, perform additional argument checking
 bool StdLib::Let(EvaluationContext &ctx) {
-  Scope scope(ctx.Interp.GetCurrentStackFrame().GetLocalSymbols(), ctx.GetSourceContext());
+  LocalScope scope(ctx.Interp.GetCurrentStackFrame(), ctx.GetSourceContext());
   ExpressionPtr varsExpr = move(ctx.Args.front());
   ctx.Args.pop_front();
   if (auto vars = ctx.GetRequiredValue<Sexp>(varsExpr)) {
@@ -3749,7 +4181,7 @@ bool StdLib::Let(EvaluationContext &ctx) {
               if (!scope.IsScopedSymbol(varName->Value))
                 scope.PutSymbol(varName->Value, varValueExpr);
               else
-                return ctx.Error("Duplicate binding for " + varName->Value);
+                return ctx.Error("Duplicate binding for " + varName->Value.Name());
             }
             else
               return false; 
@@ -3775,7 +4207,8 @@ bool StdLib::Begin(EvaluationContext &ctx) {
     currCodeExpr = move(ctx.Args.front());
     ctx.Args.pop_front();
 
-    if (!ctx.Evaluate(currCodeExpr, "body"))
+    bool evaluated = ctx.Args.empty() ? ctx.EvaluateTail(currCodeExpr, "body") : ctx.Evaluate(currCodeExpr, "body");
+    if (!evaluated)
       return false;
   }
   return ctx.Return(currCodeExpr);
@@ -3800,10 +4233,7 @@ bool StdLib::Lambda(EvaluationContext &ctx) {
       move(anonFuncArgs)
     );
     if (func) {
-      auto &locals = ctx.Interp.GetCurrentStackFrame().GetLocalSymbols();
-      locals.ForEach([&func](const string &name, ExpressionPtr &value) {
-        func.Val.Closure.emplace(name, value->Clone());
-      });
+      LambdaCapture(ctx, func.Val);
       return ctx.Return(func.Expr);
     }
     else
@@ -3813,6 +4243,30 @@ bool StdLib::Lambda(EvaluationContext &ctx) {
     return false;
 }
 
+// Only the locals the body names are captured. A list among them may hold
+// code naming other locals, so that and a body that evaluates data capture
+// every local.
+void StdLib::LambdaCapture(EvaluationContext &ctx, InterpretedFunction &func) {
+  auto &frame = ctx.Interp.GetCurrentStackFrame();
+  bool captureAll = func.EvaluatesData;
+  if (!captureAll && func.FreeSymbols) {
+    for (auto &name : *func.FreeSymbols) {
+      Expression *value = nullptr;
+      if (frame.GetLocalSymbol(name, value) && value) {
+        if (ctx.GetList(func.Closure.emplace(name, value->Clone()).first->second))
+          captureAll = true;
+      }
+    }
+  }
+
+  if (captureAll) {
+    frame.ForEachLocal([&func](const Atom &name, ExpressionPtr &value) {
+      if (func.Closure.find(name) == func.Closure.end())
+        func.Closure.emplace(name, value->Clone());
+    });
+  }
+}
+
 bool StdLib::LambdaPrepareFormals(EvaluationContext &ctx, ExpressionPtr &formalsExpr, ArgList &anonFuncArgs, int &nArgs) {
   if (auto formalsList = ctx.GetRequiredValue<Sexp>(formalsExpr, "formals list")) {
     for (auto &formal : formalsList->Args) {
@@ -3829,17 +4283,23 @@ bool StdLib::LambdaPrepareFormals(EvaluationContext &ctx, ExpressionPtr &formals
   return true;
 }
 
+static const Atom LambdaSymbol { "lambda" };
+static const Atom BeginSymbol { "begin" };
+static const Atom SetSymbol { "set" };
+
 bool StdLib::Def(EvaluationContext &ctx) {
   ExpressionPtr symbolExpr { move(ctx.Args.front()) };
   ctx.Args.pop_front();
   if (auto *symbol = ctx.GetRequiredValue<Symbol>(symbolExpr)) {
     if (auto lambda = ctx.New<Sexp>()) {
-      lambda.Val.Args.emplace_back(ctx.Alloc<Symbol>("lambda"));
+      lambda.Val.Args.emplace_back(ctx.Alloc<Symbol>(LambdaSymbol));
       lambda.Val.Args.push_back(move(ctx.Args.front()));
       ctx.Args.pop_front();
 
-      if (auto begin = ctx.New<Sexp>()) {
-        begin.Val.Args.emplace_back(ctx.Alloc<Symbol>("begin"));
+      // The body takes the line of the def, so profiles can point back to it
+      ExpressionFactory bodyFactory { ctx.Expr_->GetSourceContext() };
+      if (auto begin = bodyFactory.New<Sexp>()) {
+        begin.Val.Args.emplace_back(ctx.Alloc<Symbol>(BeginSymbol));
         while (!ctx.Args.empty()) {
           begin.Val.Args.push_back(move(ctx.Args.front()));
           ctx.Args.pop_front();
@@ -3848,7 +4308,7 @@ bool StdLib::Def(EvaluationContext &ctx) {
 
         if (ctx.Evaluate(lambda.Expr, "lambdaExpr")) {
           if (auto set = ctx.New<Sexp>()) {
-            set.Val.Args.emplace_back(ctx.Alloc<Symbol>("set"));
+            set.Val.Args.emplace_back(ctx.Alloc<Symbol>(SetSymbol));
             set.Val.Args.emplace_back(ctx.Alloc<Symbol>(symbol->Value));
             set.Val.Args.push_back(move(lambda.Expr)); 
             if (ctx.Evaluate(set.Expr, "setExpr"))
@@ -3905,6 +4365,27 @@ bool StdLib::Error(EvaluationContext &ctx) {
     return false;
 }
 
+static const Atom ErrorMsgSymbol { "$error.msg" };
+static const Atom ErrorStackSymbol { "$error.stack" };
+static const Atom UnquoteSymbol { "unquote" };
+
+// $error.stack is only visible to the catch expression itself, so its
+// formatting can be skipped unless the expression names it or unquotes code
+// that might
+static bool MayReadErrorStack(const Expression &expr) {
+  if (auto sym = dynamic_cast<const Symbol*>(&expr))
+    return sym->Value == ErrorStackSymbol || sym->Value == UnquoteSymbol;
+  else if (auto sexp = dynamic_cast<const Sexp*>(&expr)) {
+    for (auto &arg : sexp->Args) {
+      if (arg && MayReadErrorStack(*arg))
+        return true;
+    }
+  }
+  else if (auto quote = dynamic_cast<const Quote*>(&expr))
+    return quote->Value && MayReadErrorStack(*quote->Value);
+  return false;
+}
+
 bool StdLib::Try(EvaluationContext &ctx) {
   ExpressionPtr expr { move(ctx.Args.front()) };
   ctx.Args.pop_front();
@@ -3913,14 +4394,16 @@ bool StdLib::Try(EvaluationContext &ctx) {
   if (ctx.EvaluateNoError(expr))
     return ctx.Return(expr);
   else {
-    auto errors = ctx.Interp.GetErrors();
-    Scope scope(ctx.Interp.GetCurrentStackFrame().GetLocalSymbols(), ctx.GetSourceContext());
-    scope.PutSymbol("$error.msg", ExpressionPtr { ctx.Alloc<Str>(errors.empty() ? "<unknown>" : errors.front().What) });
+    auto &errors = ctx.Interp.GetErrors();
+    LocalScope scope(ctx.Interp.GetCurrentStackFrame(), ctx.GetSourceContext());
+    scope.PutSymbol(ErrorMsgSymbol, ExpressionPtr { ctx.Alloc<Str>(errors.empty() ? "<unknown>" : errors.front().What) });
 
     if (auto stack = ctx.New<Sexp>()) {
-      for (auto &frame : ctx.Interp.GetErrorStackTrace())
-        stack.Val.Args.emplace_back(ctx.Alloc<Str>(frame));
-      scope.PutSymbol("$error.stack", ExpressionPtr { ctx.Alloc<Quote>(move(stack.Expr)) });
+      if (MayReadErrorStack(*catchExpr)) {
+        for (auto &frame : ctx.Interp.GetErrorStackTrace())
+          stack.Val.Args.emplace_back(ctx.Alloc<Str>(frame));
+      }
+      scope.PutSymbol(ErrorStackSymbol, ExpressionPtr { ctx.Alloc<Quote>(move(stack.Expr)) });
       ctx.Interp.ClearErrors();
       if (ctx.Evaluate(catchExpr, "catch"))
         return ctx.Return(catchExpr);
@@ -4058,6 +4541,8 @@ bool StdLib::TypeFunc(EvaluationContext &ctx) {
     return ctx.Error("unknown type");
 }
 
+static const Atom TypeSymbol { "type" };
+
 bool StdLib::TypeQFunc(EvaluationContext &ctx) {
   string thisFuncName  = ctx.GetThisFunctionName();
   if (!thisFuncName.empty()) {
@@ -4074,7 +4559,7 @@ bool StdLib::TypeQFunc(EvaluationContext &ctx) {
       else {
         bool isAtomFunc = thisFuncName == "atom";
         if (auto type = ctx.New<Sexp>()) {
-          type.Val.Args.emplace_back(ctx.Alloc<Symbol>("type"));
+          type.Val.Args.emplace_back(ctx.Alloc<Symbol>(TypeSymbol));
           type.Val.Args.push_back(ctx.Args.front()->Clone());
           ctx.Args.clear();
           ctx.Args.emplace_back(ctx.Alloc<Symbol>(isAtomFunc ? List::TypeInstance.Name() : thisFuncName));
@@ -4096,40 +4581,52 @@ bool StdLib::UnaryFunction(EvaluationContext &ctx, F fn) {
 
 template <class T, class R, class F>
 bool StdLib::UnaryFunction(EvaluationContext &ctx, F fn) {
-  ExpressionPtr numExpr = ctx.Args.front()->Clone();
-  if (auto num = ctx.GetRequiredValue<T>(numExpr))
+  ExpressionPtr numExpr = move(ctx.Args.front());
+  ctx.Args.pop_front();
+  if (auto num = ctx.GetRequiredValue<T>(numExpr)) {
+    // An evaluated argument that isn't a Ref is a temporary owned by this
+    // call, so a result of the same type can be stored in it
+    if (std::is_same<T, R>::value && TypeHelper::SimpleIsA<T>(numExpr)) {
+      num->Value = fn(num->Value);
+      return ctx.Return(numExpr);
+    }
     return ctx.ReturnNew<R>(fn(num->Value));
+  }
   return false;
 }
 
 template<class T, class F>
 bool StdLib::BinaryFunction(EvaluationContext &ctx, F fn) {
-  bool first = true;
-  T result { ctx.GetSourceContext(), 0 };
+  ExpressionPtr result;
+  T *resultNum = nullptr;
   int argNum = 1;
   while (!ctx.Args.empty()) {
-    bool ok = false;
-    if (ctx.Evaluate(ctx.Args.front(), argNum)) {
-      if (auto num = TypeHelper::GetValue<T>(ctx.Args.front())) {
-        if (first)
-          result.Value = num->Value;
-        else
-          result.Value = fn(result.Value, num->Value);
-        ok = true;
-      }
-    }
-    else
+    auto &arg = ctx.Args.front();
+    if (!ctx.Evaluate(arg, argNum))
       return false;
 
-    if (!ok)
-      return ctx.TypeError<T>(ctx.Args.front());
+    auto num = TypeHelper::GetValue<T>(arg);
+    if (!num)
+      return ctx.TypeError<T>(arg);
+
+    if (resultNum)
+      resultNum->Value = fn(resultNum->Value, num->Value);
+    else if (TypeHelper::SimpleIsA<T>(arg)) {
+      result = move(arg);
+      resultNum = static_cast<T*>(result.get());
+    }
+    else {
+      result.reset(ctx.Alloc<T>(num->Value));
+      resultNum = static_cast<T*>(result.get());
+    }
 
-    first = false;
     ctx.Args.pop_front();
     ++argNum;
   }
 
-  return ctx.Return(result.Clone());
+  if (!result)
+    result.reset(ctx.Alloc<T>(0));
+  return ctx.Return(result);
 }
 
 template <class B, class I, class F, class S>
@@ -4159,22 +4656,24 @@ bool StdLib::BinaryPredicate(EvaluationContext &ctx, B bFn, I iFn, F fFn, S sFn)
 template <class T, class F, class R>
 bool StdLib::PredicateHelper(EvaluationContext &ctx, F fn, R defaultResult) {
   R result(ctx.GetSourceContext(), defaultResult.Value);
-  ExpressionPtr firstArg = move(ctx.Args.front());
+  ExpressionPtr lastArg = move(ctx.Args.front());
   ctx.Args.pop_front();
-  if (auto last = ctx.GetRequiredValue<T>(firstArg)) {
+  if (auto last = ctx.GetRequiredValue<T>(lastArg)) {
     int argNum = 1;
     while (!ctx.Args.empty()) {
-      if (ctx.Evaluate(ctx.Args.front(), argNum)) {
-        auto curr = TypeHelper::GetValue<T>(ctx.Args.front());
-        if (curr) {
-          R tmp(ctx.GetSourceContext(), fn(result, *last, *curr));
-          result = tmp;
-        }
+      ExpressionPtr currArg = move(ctx.Args.front());
+      ctx.Args.pop_front();
+      if (ctx.Evaluate(currArg, argNum)) {
+        auto curr = TypeHelper::GetValue<T>(currArg);
+        if (curr)
+          result.Value = fn(result, *last, *curr);
         else
-          return ctx.TypeError<T>(ctx.Args.front());
+          return ctx.TypeError<T>(currArg);
 
-        *last = *curr;
-        ctx.Args.pop_front();
+        // the previous operand is kept by pointer, it may be a Ref to a
+        // value that must not be written to
+        lastArg = move(currArg);
+        last = curr;
       }
       else
         return false; 
@@ -4185,5 +4684,5 @@ bool StdLib::PredicateHelper(EvaluationContext &ctx, F fn, R defaultResult) {
   else
     return false;
 
-  return ctx.Return(result.Clone());
+  return ctx.ReturnNew<R>(result.Value);
 }
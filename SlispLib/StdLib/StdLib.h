@@ -8,6 +8,7 @@
 class StdLib: public Library {
   public:
     virtual bool Load(Interpreter &interpreter) override;
+    virtual bool Attach(Interpreter &interpreter) override;
     virtual void UnLoad(Interpreter &interpreter) override;
     virtual void SetInteractiveMode(Interpreter &interpreter, bool enabled) override;
 
@@ -38,6 +39,8 @@ class StdLib: public Library {
 
     // Assignment operators
     static bool Set(EvaluationContext &ctx);
+    static bool SetAdd(EvaluationContext &ctx);
+    static bool SetSub(EvaluationContext &ctx);
     static bool UnSet(EvaluationContext &ctx);
 
     // Generic
@@ -153,6 +156,20 @@ class StdLib: public Library {
     static bool Push(EvaluationContext &ctx);
     static bool Pop(EvaluationContext &ctx);
     static bool Range(EvaluationContext &ctx);
+    static bool Sort(EvaluationContext &ctx);
+    static bool SortInPlace(EvaluationContext &ctx);
+    static bool SortBy(EvaluationContext &ctx);
+
+    // Dicts
+    static bool DictFunc(EvaluationContext &ctx);
+    static bool DictGet(EvaluationContext &ctx);
+    static bool DictPut(EvaluationContext &ctx);
+    static bool DictPutInPlace(EvaluationContext &ctx);
+    static bool DictRemove(EvaluationContext &ctx);
+    static bool DictRemoveInPlace(EvaluationContext &ctx);
+    static bool DictKeys(EvaluationContext &ctx);
+    static bool DictValues(EvaluationContext &ctx);
+    static bool DictContains(EvaluationContext &ctx);
 
     // Logical
     static bool And(EvaluationContext &ctx);
@@ -197,9 +214,9 @@ class StdLib: public Library {
     // Helpers
     static bool TakeSkip(EvaluationContext &ctx, bool isTake);
     static bool Render(EvaluationContext &ctx, bool isDisplay);
-    static bool ForeachIterate(EvaluationContext &ctx, Expression *iterableArg, Symbol *currElementSym, Function *fn);
-    template <class S, class L>
-    static bool SequenceFn(EvaluationContext &ctx, S strFn, L listFn);
+    static bool ForeachIterate(EvaluationContext &ctx, Expression *iterableArg, Symbol *currElementSym, ExpressionPtr &fn);
+    template <class S, class L, class D>
+    static bool SequenceFn(EvaluationContext &ctx, S strFn, L listFn, D dictFn);
 
     static bool EvaluateListSexp(EvaluationContext &ctx); 
 
@@ -225,9 +242,13 @@ class StdLib: public Library {
     template <class I, class F>
     static bool GenericNumFunc(EvaluationContext &ctx, I iFn, F fFn);
 
+    template <class I, class F>
+    static bool SetNumber(EvaluationContext &ctx, const Atom &opName, I iFn, F fFn);
+
     template <class T>
     static bool CheckDivideByZero(EvaluationContext &ctx);
 
+    static void LambdaCapture(EvaluationContext &ctx, InterpretedFunction &func);
     static bool LambdaPrepareFormals(EvaluationContext &ctx, ExpressionPtr &formalsExpr, ArgList &anonFuncArgs, int &nArgs);
 
     enum class ListTransforms {
@@ -1,7 +1,6 @@
 #include <string>
 #include <iostream>
 #include <cctype>
-#include <functional>
 
 #include "Token.h"
 #include "NumConverter.h"
@@ -11,43 +10,44 @@ using namespace std;
 
 //=============================================================================
 
-void Tokenizer::SetLine(const string& line) {
-  Stream.str(line);
-  Stream.clear();
+Tokenizer::Tokenizer():
+  CurrToken(),
+  Line(""),
+  Length(0),
+  Pos(0)
+{
+}
+
+void Tokenizer::SetLine(const char *line, size_t length) {
+  Line = line;
+  Length = length;
+  Pos = 0;
 }
 
 ITokenizer& Tokenizer::operator++() {
-  if (!Stream.eof()) {
-    char currChar = '\0';
-    TokenizeNone();
-    SkipWhitespace(currChar);
-    if (!Stream.eof() && currChar != '\0') {
-      if (currChar == '#') {
-        Stream.str("");
-        Stream.clear();
-      }
-      else {
-        if (isdigit(currChar))
-          TokenizeNumber(currChar);
-        else if (SymbolPredicate(currChar))
-          TokenizeSymbol(currChar);
-        else if (currChar == '"')
-          TokenizeString(currChar);
-        else if (currChar == '(')
-          TokenizeParenOpen(currChar);
-        else if (currChar == ')')
-          TokenizeParenClose(currChar);
-        else if (currChar == '\'')
-          TokenizeQuote(currChar);
-        else
-          TokenizeUnknown(currChar);
-      }
-    }
+  TokenizeNone();
+  SkipWhitespace();
+  if (!AtEnd()) {
+    char currChar = Line[Pos];
+    if (currChar == '#')
+      Pos = Length;
+    else if (currChar == '\0')
+      ++Pos;
+    else if (isdigit(currChar))
+      TokenizeNumber();
+    else if (SymbolPredicate(currChar))
+      TokenizeSymbol();
+    else if (currChar == '"')
+      TokenizeString();
+    else if (currChar == '(')
+      TokenizeSingle(TokenTypes::PARENOPEN);
+    else if (currChar == ')')
+      TokenizeSingle(TokenTypes::PARENCLOSE);
+    else if (currChar == '\'')
+      TokenizeSingle(TokenTypes::QUOTE);
     else
-      TokenizeNone();
+      TokenizeUnknown();
   }
-  else
-    TokenizeNone();
 
   return *this;
 }
@@ -56,11 +56,13 @@ Token& Tokenizer::operator*() {
   return CurrToken;
 }
 
-void Tokenizer::SkipWhitespace(char &currChar) {
-  do {
-    Stream.get(currChar);
-  }
-  while (!Stream.eof() && isspace(currChar));
+bool Tokenizer::AtEnd() const {
+  return Pos >= Length;
+}
+
+void Tokenizer::SkipWhitespace() {
+  while (!AtEnd() && isspace(Line[Pos]))
+    ++Pos;
 }
 
 bool IsBinaryDigit(char c) {
@@ -83,12 +85,12 @@ bool IsHexDigit(char c) {
   return isxdigit(c);
 }
 
-void Tokenizer::TokenizeNumber(char &currChar) {
-  TokenizeSequence(TokenTypes::NUMBER, currChar, IsNumber);
+void Tokenizer::TokenizeNumber() {
+  TokenizeSequence(TokenTypes::NUMBER, Pos, IsNumber);
   int base = NumConverter::GetNumberBase(CurrToken.Value);
   auto curr = std::begin(CurrToken.Value);
   auto end = std::end(CurrToken.Value);
-  function<bool(int)> pred = IsDigit; 
+  bool (*pred)(char) = IsDigit; 
   if (base != 10) {
     curr += 2;
     pred = base == 16 ? IsHexDigit : IsBinaryDigit;
@@ -108,8 +110,8 @@ void Tokenizer::TokenizeNumber(char &currChar) {
     CurrToken.Type = TokenTypes::UNKNOWN;
 }
 
-void Tokenizer::TokenizeSymbol(char &currChar) {
-  TokenizeSequence(TokenTypes::SYMBOL, currChar, SymbolPredicate);
+void Tokenizer::TokenizeSymbol() {
+  TokenizeSequence(TokenTypes::SYMBOL, Pos, SymbolPredicate);
 
   size_t len = CurrToken.Value.length();
   if (len > 1 && CurrToken.Value[0] == '-') {
@@ -141,8 +143,9 @@ enum StrState {
   HexSecondOctet,
 };
 
-void Tokenizer::TokenizeString(char &currChar) {
-  Stream.get(currChar);
+// The value is what is between the quotes, escapes are left as written
+void Tokenizer::TokenizeString() {
+  ++Pos;
   StrState state = StrState::Character;
   bool invalid = false;
   auto pred = [&state, &invalid](char c) { 
@@ -173,56 +176,46 @@ void Tokenizer::TokenizeString(char &currChar) {
     }
     return c != '"';
   };
-  TokenizeSequence(TokenTypes::STRING, currChar, pred, [this, &invalid](char& c) { Stream.get(c); });
+  TokenizeSequence(TokenTypes::STRING, Pos, pred);
   if (invalid) 
     CurrToken.Type = TokenTypes::UNKNOWN;
 }
 
-void Tokenizer::TokenizeParenOpen(char &currChar) {
-  CurrToken.Value = currChar;
-  CurrToken.Type = TokenTypes::PARENOPEN;
-}
-
-void Tokenizer::TokenizeParenClose(char &currChar) {
-  CurrToken.Value = currChar;
-  CurrToken.Type = TokenTypes::PARENCLOSE;
-}
-
-void Tokenizer::TokenizeQuote(char &currChar) {
-  CurrToken.Value = currChar;
-  CurrToken.Type = TokenTypes::QUOTE;
+void Tokenizer::TokenizeSingle(TokenTypes tokenType) {
+  CurrToken.Value.assign(1, Line[Pos++]);
+  CurrToken.Type = tokenType;
 }
 
-void Tokenizer::TokenizeUnknown(char &currChar) {
-  auto pred = [](char c) { return !isspace(c); };
-  TokenizeSequence(TokenTypes::UNKNOWN, currChar, pred);
+// Runs to the next whitespace, adding to what was read of the token so far
+void Tokenizer::TokenizeUnknown() {
+  size_t start = Pos;
+  while (!AtEnd() && !isspace(Line[Pos]))
+    ++Pos;
+  CurrToken.Value.append(Line + start, Pos - start);
+  CurrToken.Type = TokenTypes::UNKNOWN;
 }
 
 void Tokenizer::TokenizeNone() {
-  CurrToken.Value = "";
+  CurrToken.Value.clear();
   CurrToken.Type = TokenTypes::NONE;
 }
 
+// Reads characters from start while pred holds. A string's closing quote is
+// skipped, anything else but whitespace or ')' right after the token makes
+// it unknown.
 template <class F>
-void Tokenizer::TokenizeSequence(TokenTypes tokenType, char &currChar, F pred) {
-  TokenizeSequence(tokenType, currChar, pred, [](char &c) { });
-}
-
-template <class F, class G>
-void Tokenizer::TokenizeSequence(TokenTypes tokenType, char &currChar, F pred, G postSeqFn) {
-  while (!Stream.eof() && pred(currChar)) {
-    CurrToken.Value += currChar;
-    Stream.get(currChar);
-  }
+void Tokenizer::TokenizeSequence(TokenTypes tokenType, size_t start, F pred) {
+  while (!AtEnd() && pred(Line[Pos]))
+    ++Pos;
+  CurrToken.Value.assign(Line + start, Pos - start);
 
-  postSeqFn(currChar);
+  if (tokenType == TokenTypes::STRING && !AtEnd())
+    ++Pos;
 
-  if (!Stream.eof() && !isspace(currChar) && currChar != ')')
-    TokenizeUnknown(currChar);
-  else {
-    Stream.unget();
+  if (!AtEnd() && !isspace(Line[Pos]) && Line[Pos] != ')')
+    TokenizeUnknown();
+  else
     CurrToken.Type = tokenType;
-  }
 }
 
 bool Tokenizer::SymbolPredicate(char c) {
@@ -1,39 +1,50 @@
 #pragma once
 
 #include <string>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 
 #include "Token.h"
 
 class ITokenizer {
   public:
     virtual ~ITokenizer() {}
-    virtual void SetLine(const std::string& line) = 0;
+    virtual void SetLine(const char *line, size_t length) = 0;
+
+    // The line is read in place, so it has to outlive the tokens read from it
+    void SetLine(const std::string &line) { SetLine(line.data(), line.size()); }
+    void SetLine(std::string &&line) = delete;
+    void SetLine(const char *line) { SetLine(line, std::strlen(line)); }
     virtual ITokenizer& operator++() = 0;
     virtual Token& operator*() = 0;
 };
 
+// Scans the line in place, from the buffer it was read into. Token values
+// are copied out of it into a buffer that is reused from one token to the
+// next.
 class Tokenizer: public ITokenizer {
   public:
-    virtual void SetLine(const std::string& line) override;
+    using ITokenizer::SetLine;
+
+    explicit Tokenizer();
+    virtual void SetLine(const char *line, size_t length) override;
     virtual ITokenizer& operator++() override;
     virtual Token& operator*() override;
 
   private:
-    void SkipWhitespace(char &currChar);
-    void TokenizeNumber(char &currChar);
-    void TokenizeSymbol(char &currChar);
-    void TokenizeString(char &currChar);
-    void TokenizeParenOpen(char &currChar);
-    void TokenizeParenClose(char &currChar);
-    void TokenizeQuote(char &currChar);
-    void TokenizeUnknown(char &currChar);
+    bool AtEnd() const;
+    void SkipWhitespace();
+    void TokenizeNumber();
+    void TokenizeSymbol();
+    void TokenizeString();
+    void TokenizeSingle(TokenTypes tokenType);
+    void TokenizeUnknown();
     void TokenizeNone();
-    template <class F> void TokenizeSequence(TokenTypes tokenType, char &currChar, F pred);
-    template <class F, class G> void TokenizeSequence(TokenTypes tokenType, char &currChar, F pred, G postSeqFn);
+    template <class F> void TokenizeSequence(TokenTypes tokenType, size_t start, F pred);
 
-    Token CurrToken;
-    std::stringstream Stream;
+    Token       CurrToken;
+    const char  *Line;
+    size_t      Length;
+    size_t      Pos;
     static bool SymbolPredicate(char c);
 };
\ No newline at end of file
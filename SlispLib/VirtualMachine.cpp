@@ -0,0 +1,211 @@
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "VirtualMachine.h"
+#include "Interpreter.h"
+
+using namespace std;
+
+//=============================================================================
+
+VirtualMachine::VirtualMachine(Interpreter &interp):
+  Interp { interp },
+  Stack { }
+{
+}
+
+bool VirtualMachine::Run(const CodeBlock &block, ExpressionPtr &result) {
+  return Run(block, CodeBlock::MAIN_ENTRY, result, false);
+}
+
+// Runs the body of an interpreted function, calls in tail position are left
+// for the interpreter to run once the function's frame is gone
+bool VirtualMachine::RunBody(const CodeBlock &block, ExpressionPtr &result) {
+  return Run(block, CodeBlock::MAIN_ENTRY, result, true);
+}
+
+bool VirtualMachine::Run(const CodeBlock &block, uint32_t entry, ExpressionPtr &result, bool isBody) {
+  size_t base = Stack.size();
+  if (Execute(block, entry, result, isBody))
+    return true;
+  else {
+    Stack.erase(begin(Stack) + base, end(Stack));
+    return false;
+  }
+}
+
+bool VirtualMachine::Execute(const CodeBlock &block, uint32_t entry, ExpressionPtr &result, bool isBody) {
+  auto &code = block.Code;
+  uint32_t pc = entry;
+  while (true) {
+    auto &instr = code[pc++];
+    switch (instr.Op) {
+      case OpCode::PushConst:
+        Stack.push_back(block.Constants[instr.Arg]->Clone());
+        break;
+
+      case OpCode::LoadSymbol: {
+        ExpressionPtr value;
+        if (!Interp.EvaluateSymbol(static_cast<Symbol&>(*block.Constants[instr.Arg]), value))
+          return false;
+        Stack.push_back(move(value));
+        break;
+      }
+
+      case OpCode::Evaluate: {
+        ExpressionPtr value = block.Constants[instr.Arg]->Clone();
+        if (!Interp.EvaluatePartial(value))
+          return false;
+        Stack.push_back(move(value));
+        break;
+      }
+
+      case OpCode::Call: {
+        ExpressionPtr value;
+        if (!Call(block, block.CallSites[instr.Arg], value, isBody && IsReturn(code, pc)))
+          return false;
+        Stack.push_back(move(value));
+        break;
+      }
+
+      case OpCode::Intrinsic: {
+        auto &site = block.CallSites[instr.Arg];
+        if (!IsIntrinsic(site)) {
+          ExpressionPtr value = site.Form->Clone();
+          if (!Interp.EvaluatePartial(value))
+            return false;
+          Stack.push_back(move(value));
+          pc = site.End;
+        }
+        break;
+      }
+
+      case OpCode::Branch: {
+        auto &site = block.CallSites[instr.Arg];
+        ExpressionPtr cond = move(Stack.back());
+        Stack.pop_back();
+        if (auto condValue = TypeHelper::GetValue<Bool>(cond)) {
+          if (!condValue->Value)
+            pc = site.Else;
+        }
+        else
+          return Interp.ConditionTypeError(*site.Form, cond);
+        break;
+      }
+
+      case OpCode::Jump:
+        pc = instr.Arg;
+        break;
+
+      case OpCode::Pop:
+        Stack.pop_back();
+        break;
+
+      case OpCode::Return:
+        result = move(Stack.back());
+        Stack.pop_back();
+        return true;
+    }
+  }
+}
+
+// Blocks that load a single constant or symbol, as most arguments do, are run
+// without going through the stack
+bool VirtualMachine::RunArg(const CodeBlock &block, uint32_t entry, ExpressionPtr &value) {
+  auto &instr = block.Code[entry];
+  if (block.Code[entry + 1].Op == OpCode::Return) {
+    if (instr.Op == OpCode::PushConst) {
+      value = block.Constants[instr.Arg]->Clone();
+      return true;
+    }
+    else if (instr.Op == OpCode::LoadSymbol)
+      return Interp.EvaluateSymbol(static_cast<Symbol&>(*block.Constants[instr.Arg]), value);
+  }
+  return Run(block, entry, value, false);
+}
+
+bool VirtualMachine::Call(const CodeBlock &block, const CallSite &site, ExpressionPtr &result, bool isTail) {
+  ExpressionPtr head;
+  if (!RunArg(block, site.Head, head))
+    return false;
+
+  while (TypeHelper::SimpleIsA<Symbol>(head)) {
+    if (!Interp.EvaluatePartial(head))
+      return false;
+  }
+
+  auto func = TypeHelper::GetValue<Function>(head);
+  if (func && func->Def.GetSignature().IsArgCountValid(site.Args.size()))
+    return CallFunction(block, site, *func, head, result, isTail);
+
+  auto evaluateArg = [this, &block, &site](size_t argIdx, ExpressionPtr &value) {
+    return RunArg(block, site.Args[argIdx], value);
+  };
+  return Interp.EvaluateCall(*site.Form, head, evaluateArg, result, isTail);
+}
+
+// The number of arguments at the call site is known to match func, so each
+// argument is evaluated or copied as its type in the signature says and the
+// function is called directly. Arguments of the wrong type are left to the
+// interpreter's checks, which report the error.
+bool VirtualMachine::CallFunction(const CodeBlock &block, const CallSite &site, Function &func, ExpressionPtr &head, ExpressionPtr &result, bool isTail) {
+  auto &signature = func.Def.GetSignature();
+  ExpressionPtr callExpr { new Sexp { site.Form->GetSourceContext() } };
+  static_cast<Sexp&>(*callExpr).Args.push_back(move(head));
+
+  ArgList args;
+  bool typesMatch = true;
+  auto formArg = next(begin(site.Form->Args));
+  for (size_t argIdx = 0; argIdx < site.Args.size(); ++argIdx, ++formArg) {
+    auto *expectedType = signature.GetType(argIdx);
+    if (!typesMatch || !expectedType || TypeHelper::TypeMatches(*expectedType, (*formArg)->Type())) {
+      args.push_back((*formArg)->Clone());
+      continue;
+    }
+
+    ExpressionPtr value;
+    if (!RunArg(block, site.Args[argIdx], value))
+      return Interp.HasErrors() ? false : Interp.InvalidArgumentsError(func, "Argument " + to_string(argIdx + 1) + ": Failed to evaluate");
+    typesMatch = TypeHelper::TypeMatches(*expectedType, value);
+    args.push_back(move(value));
+  }
+
+  bool called;
+  if (!typesMatch)
+    called = CallChecked(callExpr, func, args, isTail);
+  else if (auto compiledFunction = dynamic_cast<CompiledFunction*>(&func))
+    called = Interp.ReduceSexpCompiledFunction(callExpr, *compiledFunction, args, isTail, false);
+  else if (auto interpretedFunction = dynamic_cast<InterpretedFunction*>(&func)) {
+    called = isTail ? CallChecked(callExpr, func, args, isTail)
+                    : Interp.ReduceSexpInterpretedFunction(callExpr, *interpretedFunction, args);
+  }
+  else
+    called = CallChecked(callExpr, func, args, isTail);
+
+  if (called)
+    result = move(callExpr);
+  return called;
+}
+
+// Goes through the interpreter's argument checks, with args already evaluated
+bool VirtualMachine::CallChecked(ExpressionPtr &callExpr, Function &func, ArgList &args, bool isTail) {
+  auto &callArgs = static_cast<Sexp&>(*callExpr).Args;
+  while (!args.empty()) {
+    callArgs.push_back(move(args.front()));
+    args.pop_front();
+  }
+  auto evaluated = [](ExpressionPtr &) { return true; };
+  return Interp.ReduceSexpFunction(callExpr, func, evaluated, isTail, false);
+}
+
+// Whether the value pushed before pc becomes the result of the block
+bool VirtualMachine::IsReturn(const vector<Instruction> &code, uint32_t pc) {
+  while (code[pc].Op == OpCode::Jump)
+    pc = code[pc].Arg;
+  return code[pc].Op == OpCode::Return;
+}
+
+bool VirtualMachine::IsIntrinsic(const CallSite &site) {
+  return Interp.IsBuiltin(static_cast<const Symbol&>(*site.Form->Args.front()).Value);
+}
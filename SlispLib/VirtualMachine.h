@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vector>
+
+#include "Expression.h"
+#include "Compiler.h"
+
+class Interpreter;
+struct Function;
+
+class VirtualMachine {
+  public:
+    explicit VirtualMachine(Interpreter &interp);
+    bool Run(const CodeBlock &block, ExpressionPtr &result);
+    bool RunBody(const CodeBlock &block, ExpressionPtr &result);
+
+  private:
+    Interpreter                &Interp;
+    std::vector<ExpressionPtr> Stack;
+
+    bool Run(const CodeBlock &block, uint32_t entry, ExpressionPtr &result, bool isBody);
+    bool Execute(const CodeBlock &block, uint32_t entry, ExpressionPtr &result, bool isBody);
+    bool RunArg(const CodeBlock &block, uint32_t entry, ExpressionPtr &value);
+    bool Call(const CodeBlock &block, const CallSite &site, ExpressionPtr &result, bool isTail);
+    bool CallFunction(const CodeBlock &block, const CallSite &site, Function &func, ExpressionPtr &head, ExpressionPtr &result, bool isTail);
+    bool CallChecked(ExpressionPtr &callExpr, Function &func, ArgList &args, bool isTail);
+    static bool IsReturn(const std::vector<Instruction> &code, uint32_t pc);
+    bool IsIntrinsic(const CallSite &site);
+};
@@ -28,7 +28,7 @@ class TestTokenizer: public ITokenizer {
     std::list<Token> Tokens;
     Token CurrToken;
 
-    virtual void SetLine(const std::string& line) override {}
+    virtual void SetLine(const char *line, size_t length) override {}
 
     virtual ITokenizer& operator++() override {
       if (Tokens.empty())
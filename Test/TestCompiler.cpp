@@ -0,0 +1,195 @@
+#include <sstream>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+#include "Compiler.h"
+#include "Controller.h"
+#include "BaseTest.h"
+
+using namespace std;
+
+class CompilerTest: public BaseTest {
+  protected:
+    Compiler Compiler_;
+
+    vector<OpCode> GetOpCodes(const CodeBlock &block, uint32_t entry = CodeBlock::MAIN_ENTRY) {
+      vector<OpCode> ops;
+      for (size_t addr = entry; addr < block.Code.size(); ++addr) {
+        ops.push_back(block.Code[addr].Op);
+        if (block.Code[addr].Op == OpCode::Return)
+          break;
+      }
+      return ops;
+    }
+
+    ExpressionPtr Sym(const string &name) {
+      return ExpressionPtr { Factory.Alloc<Symbol>(name) };
+    }
+
+    ExpressionPtr IntExpr(int64_t value) {
+      return ExpressionPtr { Factory.Alloc<Int>(value) };
+    }
+
+    ExpressionPtr SexpExpr(initializer_list<ExpressionPtr> &&args) {
+      return ExpressionPtr { Factory.Alloc<Sexp>(move(args)) };
+    }
+};
+
+TEST_F(CompilerTest, TestLiteral) {
+  auto block = Compiler_.Compile(*IntExpr(42));
+  vector<OpCode> expected { OpCode::PushConst, OpCode::Return };
+  ASSERT_EQ(expected, GetOpCodes(*block));
+  ASSERT_EQ(*IntExpr(42), *block->Constants[0]);
+}
+
+TEST_F(CompilerTest, TestSymbol) {
+  auto block = Compiler_.Compile(*Sym("a"));
+  vector<OpCode> expected { OpCode::LoadSymbol, OpCode::Return };
+  ASSERT_EQ(expected, GetOpCodes(*block));
+  ASSERT_EQ(*Sym("a"), *block->Constants[0]);
+}
+
+TEST_F(CompilerTest, TestCall) {
+  auto block = Compiler_.Compile(*SexpExpr({Sym("+"), IntExpr(1), Sym("a")}));
+  vector<OpCode> expected { OpCode::Call, OpCode::Return };
+  ASSERT_EQ(expected, GetOpCodes(*block));
+  ASSERT_EQ(static_cast<size_t>(1), block->CallSites.size());
+
+  auto &site = block->CallSites[0];
+  ASSERT_EQ(*block->Source, *site.Form);
+  ASSERT_EQ(static_cast<size_t>(2), site.Args.size());
+
+  vector<OpCode> loadSymbol { OpCode::LoadSymbol, OpCode::Return };
+  vector<OpCode> pushConst { OpCode::PushConst, OpCode::Return };
+  ASSERT_EQ(loadSymbol, GetOpCodes(*block, site.Head));
+  ASSERT_EQ(pushConst, GetOpCodes(*block, site.Args[0]));
+  ASSERT_EQ(loadSymbol, GetOpCodes(*block, site.Args[1]));
+}
+
+TEST_F(CompilerTest, TestIf) {
+  auto block = Compiler_.Compile(*SexpExpr({Sym("if"), Sym("c"), IntExpr(1), IntExpr(2)}));
+  vector<OpCode> expected {
+    OpCode::Intrinsic,
+    OpCode::LoadSymbol,
+    OpCode::Branch,
+    OpCode::PushConst,
+    OpCode::Jump,
+    OpCode::PushConst,
+    OpCode::Return
+  };
+  ASSERT_EQ(expected, GetOpCodes(*block));
+
+  auto &site = block->CallSites[0];
+  ASSERT_EQ(static_cast<uint32_t>(5), site.Else);
+  ASSERT_EQ(static_cast<uint32_t>(6), site.End);
+  ASSERT_EQ(site.End, block->Code[4].Arg);
+}
+
+TEST_F(CompilerTest, TestIfNoElse) {
+  auto block = Compiler_.Compile(*SexpExpr({Sym("if"), Sym("c"), IntExpr(1)}));
+  auto &elseInstr = block->Code[block->CallSites[0].Else];
+  ASSERT_EQ(OpCode::PushConst, elseInstr.Op);
+  ASSERT_EQ("()", block->Constants[elseInstr.Arg]->ToString());
+}
+
+TEST_F(CompilerTest, TestBegin) {
+  auto block = Compiler_.Compile(*SexpExpr({Sym("begin"), IntExpr(1), Sym("a"), IntExpr(3)}));
+  vector<OpCode> expected {
+    OpCode::Intrinsic,
+    OpCode::PushConst,
+    OpCode::Pop,
+    OpCode::LoadSymbol,
+    OpCode::Pop,
+    OpCode::PushConst,
+    OpCode::Return
+  };
+  ASSERT_EQ(expected, GetOpCodes(*block));
+  ASSERT_EQ(static_cast<uint32_t>(6), block->CallSites[0].End);
+}
+
+TEST_F(CompilerTest, TestIntrinsicArity) {
+  auto block = Compiler_.Compile(*SexpExpr({Sym("if"), Sym("c")}));
+  vector<OpCode> expected { OpCode::Call, OpCode::Return };
+  ASSERT_EQ(expected, GetOpCodes(*block));
+
+  block = Compiler_.Compile(*SexpExpr({Sym("begin")}));
+  ASSERT_EQ(expected, GetOpCodes(*block));
+}
+
+TEST_F(CompilerTest, TestNestedIfSize) {
+  ExpressionPtr expr = IntExpr(0);
+  for (int i = 0; i < 32; ++i)
+    expr = SexpExpr({Sym("if"), Sym("c"), IntExpr(i), move(expr)});
+  auto block = Compiler_.Compile(*expr);
+  ASSERT_GT(static_cast<size_t>(32 * 8), block->Code.size());
+}
+
+TEST_F(CompilerTest, TestDisassemble) {
+  auto block = Compiler_.Compile(*SexpExpr({Sym("+"), IntExpr(1), IntExpr(2)}));
+  stringstream out;
+  block->Disassemble(out);
+  ASSERT_NE(string::npos, out.str().find("call (+ 1 2)"));
+  ASSERT_NE(string::npos, out.str().find("load +"));
+}
+
+//=============================================================================
+
+// Engines that evaluate function bodies without modifying them
+class EngineTest: public ::testing::TestWithParam<const char*> {
+  protected:
+    Controller Controller_;
+    stringstream Out;
+
+    explicit EngineTest():
+      Controller_(2, vector<const char*> { "slisp.exe", GetParam() }.data())
+    {
+      Controller_.SetOutput(Out);
+    }
+
+    bool RunSuccess(const string &code, const string &expectedResult) {
+      Out.str("");
+      Out.clear();
+      Controller_.Run(code);
+      return Out.str().find(expectedResult) != string::npos;
+    }
+
+    bool RunFail(const string &code) {
+      return RunSuccess(code, "Error");
+    }
+};
+
+TEST_P(EngineTest, TestFunctions) {
+  ASSERT_TRUE(RunSuccess("(def fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))", "Function"));
+  ASSERT_TRUE(RunSuccess("(fib 15)", "610"));
+  ASSERT_TRUE(RunSuccess("(def f (a b) (begin (set c (+ a b)) (* c 2)))", "Function"));
+  ASSERT_TRUE(RunSuccess("(f 1 2)", "6"));
+  ASSERT_TRUE(RunSuccess("((fn (x) (if (> x 0) \"pos\")) 1)", "\"pos\""));
+  ASSERT_TRUE(RunSuccess("((fn (x) (if (> x 0) \"pos\")) 0)", "()"));
+}
+
+TEST_P(EngineTest, TestLazyArgs) {
+  ASSERT_TRUE(RunSuccess("(def f (n) (begin (set i 0) (while (< i n) (++ i)) i))", "Function"));
+  ASSERT_TRUE(RunSuccess("(f 10)", "10"));
+  ASSERT_TRUE(RunSuccess("(def g (l) (map (fn (x) (* x x)) l))", "Function"));
+  ASSERT_TRUE(RunSuccess("(g (1 2 3))", "(1 4 9)"));
+  ASSERT_TRUE(RunSuccess("(def h (x) (quote x))", "Function"));
+  ASSERT_TRUE(RunSuccess("(h 3)", "x"));
+}
+
+TEST_P(EngineTest, TestIntrinsicRebound) {
+  ASSERT_TRUE(RunSuccess("(def f (x) (if x 1 2))", "Function"));
+  ASSERT_TRUE(RunSuccess("(f false)", "2"));
+  ASSERT_TRUE(RunSuccess("(set if (fn (a b c) 42))", "Function"));
+  ASSERT_TRUE(RunSuccess("(f false)", "42"));
+}
+
+TEST_P(EngineTest, TestErrors) {
+  ASSERT_TRUE(RunSuccess("(def f (x) (if x 1 2))", "Function"));
+  ASSERT_TRUE(RunSuccess("(f 3)", "if: Expecting: bool. Got: int"));
+  ASSERT_TRUE(RunSuccess("(def g (x) (+ x undefinedSymbol))", "Function"));
+  ASSERT_TRUE(RunSuccess("(g 1)", "Unknown symbol: undefinedSymbol"));
+  ASSERT_TRUE(RunFail("(def h () (+ 1 \"a\"))(h)"));
+}
+
+INSTANTIATE_TEST_CASE_P(Engines, EngineTest, ::testing::Values("--engine=immutable", "--engine=vm"));
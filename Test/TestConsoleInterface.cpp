@@ -125,3 +125,66 @@ TEST(ConsoleInterface, TestSetInputOutput) {
   ASSERT_TRUE(line.empty());
   ASSERT_FALSE(console.HasMore());
 }
+
+TEST(ConsoleInterface, TestReadBuffer) {
+  stringstream out;
+  ConsoleInterface console(cin, out);
+  string source = "first line\n\nthird\n";
+  console.SetInput(source.data(), source.size());
+
+  const char *line;
+  size_t length;
+  ASSERT_TRUE(console.ReadInputLine(line, length));
+  ASSERT_EQ("first line", string(line, length));
+  ASSERT_EQ(source.data(), line);
+  ASSERT_TRUE(console.HasMore());
+  ASSERT_TRUE(console.ReadContinuedInputLine(line, length));
+  ASSERT_EQ((size_t)0, length);
+  ASSERT_TRUE(console.ReadInputLine(line, length));
+  ASSERT_EQ("third", string(line, length));
+  ASSERT_TRUE(console.HasMore());
+  ASSERT_TRUE(console.ReadInputLine(line, length));
+  ASSERT_EQ((size_t)0, length);
+  ASSERT_FALSE(console.HasMore());
+
+  source = "no newline";
+  console.SetInput(source.data(), source.size());
+  ASSERT_TRUE(console.HasMore());
+  string copy;
+  ASSERT_TRUE(console.ReadInputLine(copy));
+  ASSERT_EQ("no newline", copy);
+  ASSERT_FALSE(console.HasMore());
+
+  console.SetInput(source.data(), 0);
+  ASSERT_TRUE(console.ReadInputLine(line, length));
+  ASSERT_EQ((size_t)0, length);
+  ASSERT_FALSE(console.HasMore());
+}
+
+TEST(ConsoleInterface, TestInputSource) {
+  stringstream in,
+                    out;
+  ConsoleInterface  console(in, out);
+  in << "from stream" << endl;
+
+  string source = "one\ntwo";
+  console.SetInput(source.data(), source.size());
+  string line;
+  ASSERT_TRUE(console.ReadInputLine(line));
+  ASSERT_EQ("one", line);
+
+  auto saved = console.GetInputSource();
+  string other = "other";
+  console.SetInput(other.data(), other.size());
+  ASSERT_TRUE(console.ReadInputLine(line));
+  ASSERT_EQ("other", line);
+
+  console.SetInputSource(saved);
+  ASSERT_TRUE(console.ReadInputLine(line));
+  ASSERT_EQ("two", line);
+  ASSERT_FALSE(console.HasMore());
+
+  console.SetInput(in);
+  ASSERT_TRUE(console.ReadInputLine(line));
+  ASSERT_EQ("from stream", line);
+}
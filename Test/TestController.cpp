@@ -54,6 +54,84 @@ TEST(ControllerArgs, TestParse) {
     EXPECT_NO_FATAL_FAILURE(ParseTest(ArgTests[i])) << "Test #" << i;
 }
 
+TEST(ControllerArgs, TestParseEngine) {
+  {
+    vector<const char*> cmdArgs { "slisp", "(+ 3 4)" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(EngineTypes::TreeWalker, args.Engine);
+  }
+  {
+    vector<const char*> cmdArgs { "slisp", "--engine=vm", "script.slisp", "arg1" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(EngineTypes::VM, args.Engine);
+    EXPECT_EQ(ControllerArgs::RunFile, args.Flags);
+    EXPECT_EQ("script.slisp", args.Run);
+    EXPECT_EQ(vector<string> { "arg1" }, args.ScriptArgs);
+  }
+  {
+    vector<const char*> cmdArgs { "slisp", "--engine=vm", "-i", "(+ 3 4)" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(EngineTypes::VM, args.Engine);
+    EXPECT_EQ(ControllerArgs::RunCode | ControllerArgs::REPL, args.Flags);
+  }
+  {
+    vector<const char*> cmdArgs { "slisp", "--engine=vm" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(EngineTypes::VM, args.Engine);
+    EXPECT_EQ(ControllerArgs::REPL, args.Flags);
+  }
+  {
+    vector<const char*> cmdArgs { "slisp", "--engine=vm", "--engine=tree", "(+ 3 4)" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(EngineTypes::TreeWalker, args.Engine);
+  }
+  {
+    vector<const char*> cmdArgs { "slisp", "--engine=immutable", "(+ 3 4)" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(EngineTypes::ImmutableTreeWalker, args.Engine);
+  }
+  {
+    vector<const char*> cmdArgs { "slisp", "--engine=bogus", "(+ 3 4)" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(ControllerArgs::Error, args.Flags);
+  }
+}
+
+TEST(ControllerArgs, TestParseModuleCache) {
+  {
+    vector<const char*> cmdArgs { "slisp", "--module-cache=cache", "script.slisp" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(ControllerArgs::RunFile, args.Flags);
+    EXPECT_EQ("cache", args.ModuleCacheDir);
+  }
+  {
+    vector<const char*> cmdArgs { "slisp", "--module-cache=", "script.slisp" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(ControllerArgs::Error, args.Flags);
+  }
+}
+
+TEST(ControllerArgs, TestParseProfile) {
+  {
+    vector<const char*> cmdArgs { "slisp", "--profile=out.txt", "script.slisp" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(ControllerArgs::RunFile, args.Flags);
+    EXPECT_EQ("out.txt", args.ProfilePath);
+  }
+  {
+    vector<const char*> cmdArgs { "slisp", "--profile=", "script.slisp" };
+    ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+    EXPECT_EQ(ControllerArgs::Error, args.Flags);
+  }
+}
+
+TEST(ControllerArgs, TestParseAllocStats) {
+  vector<const char*> cmdArgs { "slisp", "--alloc-stats", "--engine=vm", "(+ 3 4)" };
+  ControllerArgs args(static_cast<int>(cmdArgs.size()), cmdArgs.data());
+  EXPECT_EQ(ControllerArgs::AllocStats | ControllerArgs::RunCode, args.Flags);
+  EXPECT_EQ(EngineTypes::VM, args.Engine);
+}
+
 class ControllerTest: public testing::Test {
 protected:
   Environment& GetEnvironment(Controller &controller) {
@@ -239,3 +317,123 @@ TEST_F(ControllerTest, TestOutputFile) {
   ASSERT_NO_FATAL_FAILURE(TestOutFile(controller, "TestOutputFile1.txt", "(+ 2 3)", "5"));
   ASSERT_NO_FATAL_FAILURE(TestOutFile(controller, "TestOutputFile2.txt", "(+ 4 6)", "10"));
 }
+
+TEST_F(ControllerTest, TestRunArgs_AllocStats) {
+  vector<const char*> args { "slisp.exe", "--alloc-stats" };
+  stringstream out;
+  Controller controller(static_cast<int>(args.size()), args.data());
+  controller.SetOutput(out);
+  controller.Run("(+ 2 3)");
+  ASSERT_NE(out.str().find("5"), string::npos);
+  ASSERT_NE(out.str().find("Allocated "), string::npos);
+  ASSERT_NE(out.str().find(" bytes"), string::npos);
+}
+
+TEST_F(ControllerTest, TestRunArgs_Profile) {
+  vector<const char*> args { "slisp", "--profile=TestProfile.txt", "Test/TestProfile.slisp" };
+  stringstream out;
+  Controller controller(static_cast<int>(args.size()), args.data());
+  controller.SetOutput(out);
+  controller.Run();
+  ASSERT_NE(out.str().find("676700"), string::npos);
+  ASSERT_NE(out.str().find("self ms"), string::npos);
+  ASSERT_NE(out.str().find("       200"), string::npos);
+  ASSERT_NE(out.str().find("square (Test/TestProfile.slisp:1)"), string::npos);
+
+  fstream profile;
+  profile.open("TestProfile.txt", ios_base::in);
+  ASSERT_TRUE(profile.is_open());
+  string line;
+  size_t nLines = 0;
+  while (getline(profile, line)) {
+    size_t countPos = line.rfind(' ');
+    ASSERT_NE(string::npos, countPos);
+    ASSERT_GT(stoll(line.substr(countPos + 1)), 0);
+    if (line.find("square (") != string::npos)
+      ASSERT_NE(line.find("sum-squares (Test/TestProfile.slisp:2)"), string::npos);
+    ++nLines;
+  }
+  ASSERT_GT(nLines, static_cast<size_t>(0));
+  profile.close();
+  remove("TestProfile.txt");
+}
+
+TEST_F(ControllerTest, TestModuleCache) {
+  vector<const char*> args { "slisp", "--module-cache=." };
+  fstream in;
+  in.open("Test/TestIncludeA.slisp", ios_base::in | ios_base::binary);
+  ASSERT_TRUE(in.is_open());
+  stringstream source;
+  source << in.rdbuf();
+  string cachePath = ModuleCache(".").GetPath(source.str());
+  remove(cachePath.c_str());
+
+  auto runIncludes = [&args]() {
+    stringstream out;
+    Controller controller(static_cast<int>(args.size()), args.data());
+    controller.SetOutput(out);
+    EXPECT_TRUE(controller.RunFile("Test/TestIncludeB.slisp"));
+    controller.Run("(+ (fivefn) (sixfn))");
+    return out.str();
+  };
+
+  ASSERT_NE(runIncludes().find("11"), string::npos);
+  fstream cached;
+  cached.open(cachePath, ios_base::in | ios_base::binary);
+  ASSERT_TRUE(cached.is_open());
+  stringstream cachedData;
+  cachedData << cached.rdbuf();
+  cached.close();
+  ASSERT_NE(runIncludes().find("11"), string::npos);
+
+  fstream truncated;
+  truncated.open(cachePath, ios_base::out | ios_base::binary);
+  truncated << cachedData.str().substr(0, cachedData.str().size() - 4);
+  truncated.close();
+  ASSERT_NE(runIncludes().find("11"), string::npos);
+
+  in.close();
+  remove(cachePath.c_str());
+  in.open("Test/TestIncludeB.slisp", ios_base::in | ios_base::binary);
+  source.str("");
+  source << in.rdbuf();
+  remove(ModuleCache(".").GetPath(source.str()).c_str());
+}
+
+TEST_F(ControllerTest, TestSnapshot) {
+  unique_ptr<Controller> base { new Controller() };
+  stringstream baseOut;
+  base->SetOutput(baseOut);
+  ASSERT_TRUE(base->RunFile("Test/TestIncludeA.slisp"));
+  base->Run("(set nums '(1 2 3))");
+  base->Run("(set first car)");
+  base->Run("(infix-register max)");
+  InterpreterSnapshot snapshot = base->TakeSnapshot();
+  base->Run("(set nums '(4 5 6))");
+  base.reset();
+
+  stringstream out;
+  auto run = [&out](Controller &controller, const string &code) {
+    out.str("");
+    controller.Run(code);
+    return out.str();
+  };
+
+  vector<const char*> args { "slisp", "(length sys.args)", "2", "3" };
+  {
+    Controller restored(static_cast<int>(args.size()), args.data(), snapshot);
+    restored.SetOutput(out);
+    ASSERT_EQ("5\n", run(restored, "(fivefn)"));
+    ASSERT_EQ("1\n", run(restored, "(first nums)"));
+    ASSERT_EQ("7\n", run(restored, "(3 max 7)"));
+    ASSERT_EQ("2\n", run(restored, "(length sys.args)"));
+    ASSERT_TRUE(restored.RunFile("Test/TestIncludeB.slisp"));
+    ASSERT_EQ("6\n", run(restored, "(sixfn)"));
+    ASSERT_EQ("(7 8 9)\n", run(restored, "(set nums '(7 8 9))"));
+  }
+
+  Controller again(0, nullptr, snapshot);
+  again.SetOutput(out);
+  ASSERT_EQ("(1 2 3)\n", run(again, "nums"));
+  ASSERT_NE(string::npos, run(again, "(sixfn)").find("Unknown symbol: sixfn"));
+}
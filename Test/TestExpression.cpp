@@ -1,5 +1,8 @@
+#include <thread>
+#include <vector>
 #include "gtest/gtest.h"
 #include "Expression.h"
+#include "ExpressionAllocator.h"
 #include "BaseTest.h"
 
 using namespace std;
@@ -59,6 +62,239 @@ TEST_F(ExpressionTest, TestSymbol) {
   RunExpressionTest(*Factory.Alloc<Symbol>(""), *Factory.Alloc<Symbol>(""), *Factory.Alloc<Symbol>("a"));
 }
 
+TEST_F(ExpressionTest, TestAtom) {
+  string name = "foo";
+  Atom foo { name },
+       fooAgain { "foo" },
+       bar { "bar" };
+  ASSERT_EQ(foo, fooAgain);
+  ASSERT_EQ(&foo.Name(), &fooAgain.Name());
+  ASSERT_NE(foo, bar);
+  ASSERT_LT(bar, foo);
+  ASSERT_EQ(foo.Hash(), fooAgain.Hash());
+  ASSERT_EQ("foo", foo.Name());
+  ASSERT_TRUE(Atom().empty());
+
+  auto &sym = *Factory.Alloc<Symbol>("foo");
+  ASSERT_EQ(&foo.Name(), &sym.Value.Name());
+  ASSERT_EQ(Atom(), Atom(""));
+}
+
+TEST_F(ExpressionTest, TestAtomThreads) {
+  const int N_THREADS = 4;
+  const int N_NAMES = 1000;
+  vector<vector<Atom>> interned(N_THREADS);
+  vector<thread> threads;
+  for (int threadIdx = 0; threadIdx < N_THREADS; ++threadIdx) {
+    threads.emplace_back([&interned, threadIdx]() {
+      for (int i = 0; i < N_NAMES; ++i)
+        interned[threadIdx].emplace_back("atom-thread-" + to_string(i));
+    });
+  }
+  for (auto &t : threads)
+    t.join();
+
+  for (int threadIdx = 1; threadIdx < N_THREADS; ++threadIdx) {
+    for (int i = 0; i < N_NAMES; ++i)
+      ASSERT_EQ(&interned[0][i].Name(), &interned[threadIdx][i].Name());
+  }
+}
+
+TEST_F(ExpressionTest, TestArgList) {
+  auto toString = [](const ArgList &args) {
+    string result;
+    for (auto &arg : args)
+      result += arg->ToString();
+    return result;
+  };
+
+  ArgList args;
+  ASSERT_TRUE(args.empty());
+  for (int i = 0; i < 10; ++i)
+    args.push_back(ExpressionPtr { Factory.Alloc<Int>(i) });
+  for (int i = 0; i < 10; ++i)
+    args.push_front(ExpressionPtr { Factory.Alloc<Int>(i) });
+  ASSERT_EQ(static_cast<size_t>(20), args.size());
+  ASSERT_EQ("98765432100123456789", toString(args));
+  ASSERT_EQ(*Factory.Alloc<Int>(0), *args[9]);
+
+  args.pop_front();
+  args.pop_back();
+  ASSERT_EQ("876543210012345678", toString(args));
+
+  auto pos = args.insert(begin(args) + 1, ExpressionPtr { Factory.Alloc<Int>(9) });
+  ASSERT_EQ(begin(args) + 1, pos);
+  pos = args.erase(begin(args) + 2, begin(args) + 10);
+  ASSERT_EQ("89012345678", toString(args));
+  ASSERT_EQ(*Factory.Alloc<Int>(0), **pos);
+
+  ArgList moved { move(args) };
+  ASSERT_TRUE(args.empty());
+  ASSERT_EQ("89012345678", toString(moved));
+  moved.clear();
+  ASSERT_TRUE(moved.empty());
+
+  ArgList small;
+  small.emplace_back(Factory.Alloc<Int>(1));
+  small.push_front(ExpressionPtr { Factory.Alloc<Int>(0) });
+  args = move(small);
+  ASSERT_EQ("01", toString(args));
+  while (!args.empty())
+    args.pop_front();
+  ASSERT_EQ("", toString(args));
+}
+
+TEST_F(ExpressionTest, TestArgListSharing) {
+  ArgList args;
+  for (int i = 0; i < 8; ++i)
+    args.push_back(ExpressionPtr { Factory.Alloc<Int>(i) });
+
+  ArgList copy;
+  copy.CopyFrom(args);
+  ASSERT_TRUE(args.IsShared());
+  ASSERT_EQ(static_cast<const ArgList&>(args).begin(), static_cast<const ArgList&>(copy).begin());
+
+  copy.pop_front();
+  ASSERT_TRUE(copy.IsShared());
+  ASSERT_EQ(static_cast<size_t>(8), args.size());
+  ASSERT_EQ(*Factory.Alloc<Int>(1), *copy.front());
+  ASSERT_FALSE(copy.IsShared());
+  ASSERT_FALSE(args.IsShared());
+
+  copy.push_back(ExpressionPtr { Factory.Alloc<Int>(8) });
+  ASSERT_EQ(static_cast<size_t>(8), args.size());
+  ASSERT_EQ(*Factory.Alloc<Int>(7), *args.back());
+
+  ArgList pinned;
+  pinned.CopyFrom(args);
+  pinned.Pin();
+  ArgList unshared;
+  unshared.CopyFrom(pinned);
+  ASSERT_FALSE(pinned.IsShared());
+  ASSERT_TRUE(ArgListHelper::AreEqual(pinned, unshared));
+
+  pinned.Unpin();
+  ArgList shared;
+  shared.CopyFrom(pinned);
+  ASSERT_TRUE(pinned.IsShared());
+
+  Sexp sexp { SourceContext(), move(shared) };
+  {
+    SexpIterator it { sexp };
+    ArgList whileIterating;
+    whileIterating.CopyFrom(sexp.Args);
+    ASSERT_FALSE(sexp.Args.IsShared());
+  }
+  ArgList afterIterating;
+  afterIterating.CopyFrom(sexp.Args);
+  ASSERT_TRUE(sexp.Args.IsShared());
+}
+
+TEST_F(ExpressionTest, TestAllocator) {
+  AllocationStats before = ExpressionAllocator::GetStats();
+  Expression *first = Factory.Alloc<Int>(1);
+  delete first;
+  Expression *second = Factory.Alloc<Int>(2);
+  ASSERT_EQ(first, second);
+  delete second;
+
+  AllocationStats allocated = ExpressionAllocator::GetStats() - before;
+  ASSERT_EQ(static_cast<uint64_t>(2), allocated.Objects);
+  ASSERT_EQ(static_cast<uint64_t>(2 * sizeof(Int)), allocated.Bytes);
+
+  void *large = ExpressionAllocator::Allocate(4096);
+  ASSERT_NE(nullptr, large);
+  ExpressionAllocator::Free(large, 4096);
+
+  // Slabs are only given back once no block is in use, which static
+  // expressions of other tests may prevent here
+  Expression *live = Factory.Alloc<Int>(3);
+  ASSERT_FALSE(ExpressionAllocator::ReleaseSlabs());
+  delete live;
+  ExpressionAllocator::ReleaseSlabs();
+  Expression *afterRelease = Factory.Alloc<Int>(4);
+  ASSERT_NE(nullptr, afterRelease);
+  delete afterRelease;
+}
+
+TEST_F(ExpressionTest, TestAllocatorPerThread) {
+  AllocationStats before = ExpressionAllocator::GetStats();
+  AllocationStats onThread { 0, 0 };
+  thread worker([&onThread]() {
+    ExpressionFactory factory(NullSourceContext);
+    Expression *expr = factory.Alloc<Int>(1);
+    delete expr;
+    onThread = ExpressionAllocator::GetStats();
+  });
+  worker.join();
+
+  ASSERT_EQ(static_cast<uint64_t>(1), onThread.Objects);
+  ASSERT_EQ(static_cast<uint64_t>(0), (ExpressionAllocator::GetStats() - before).Objects);
+}
+
+TEST_F(ExpressionTest, TestSequenceClone) {
+  auto readAll = [](IIterator &iterator) {
+    string values;
+    while (ExpressionPtr &value = iterator.Next())
+      values += value->ToString() + " ";
+    return values;
+  };
+
+  Sexp values { NullSourceContext, { ExpressionPtr { Factory.Alloc<Int>(1) }, ExpressionPtr { Factory.Alloc<Int>(2) }, ExpressionPtr { Factory.Alloc<Int>(3) } } };
+  Sequence sequence { NullSourceContext, values.GetIterator() };
+  ASSERT_EQ(Int(NullSourceContext, 1), *sequence.Iterator->Next());
+
+  ExpressionPtr copy = sequence.Clone();
+  auto &copiedSequence = static_cast<Sequence&>(*copy);
+  ASSERT_EQ(2, copiedSequence.Iterator->GetLength());
+  ASSERT_EQ("2 3 ", readAll(*copiedSequence.Iterator));
+  ASSERT_EQ("2 3 ", readAll(*sequence.Iterator));
+  ASSERT_FALSE(sequence.Iterator->Failed());
+}
+
+TEST_F(ExpressionTest, TestTypeTag) {
+  ASSERT_EQ(TypeTag::Bool, Bool::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Int, Int::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Float, Float::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Str, Str::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Quote, Quote::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Symbol, Symbol::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Sexp, Sexp::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Ref, Ref::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Sequence, Sequence::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Dict, Dict::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Other, Literal::TypeInstance.Tag());
+  ASSERT_EQ(TypeTag::Other, List::TypeInstance.Tag());
+
+  ExpressionPtr num { Factory.Alloc<Int>(42) };
+  ASSERT_EQ(TypeTag::Int, num->Type().Tag());
+}
+
+TEST_F(ExpressionTest, TestDict) {
+  Dict dict { NullSourceContext };
+  dict.Put(ExpressionPtr { Factory.Alloc<Str>("a") }, ExpressionPtr { Factory.Alloc<Int>(1) });
+  dict.Put(ExpressionPtr { Factory.Alloc<Int>(2) }, ExpressionPtr { Factory.Alloc<Int>(3) });
+  ASSERT_EQ(static_cast<size_t>(2), dict.size());
+  ASSERT_EQ("{\"a\" 1 2 3}", dict.ToString());
+
+  Str a { NullSourceContext, "a" };
+  Int two { NullSourceContext, 2 };
+  Float twoFloat { NullSourceContext, 2 };
+  ASSERT_EQ(Int(NullSourceContext, 1), *dict.Find(a));
+  ASSERT_EQ(Int(NullSourceContext, 3), *dict.Find(two));
+  ASSERT_EQ(nullptr, dict.Find(twoFloat));
+
+  ExpressionPtr copyExpr = dict.Clone();
+  Dict &copy = static_cast<Dict&>(*copyExpr);
+  ASSERT_EQ(dict, copy);
+  ASSERT_TRUE(copy.Remove(a));
+  ASSERT_FALSE(copy.Remove(a));
+  ASSERT_NE(dict, copy);
+  ASSERT_EQ(static_cast<size_t>(2), dict.size());
+  ASSERT_EQ("{2 3}", copy.ToString());
+  ASSERT_EQ(Int(NullSourceContext, 3), *copy.Find(two));
+}
+
 TEST_F(ExpressionTest, TestQuote) {
   Quote qThree { NullSourceContext, ExpressionPtr { Factory.Alloc<Int>(3) } };
   Quote qFoo { NullSourceContext, ExpressionPtr { Factory.Alloc<Str>("Foo") } };
@@ -200,3 +200,59 @@ TEST(FuncDef, TestFuncDef_Args) {
     }
   }
 }
+
+TEST(FuncDef, TestFuncDef_Signature) {
+  FuncDef varArgs(FuncDef::ManyArgs(Int::TypeInstance, 1, 3), FuncDef::NoArgs());
+  auto &varSignature = varArgs.GetSignature();
+  ASSERT_EQ(1u, varSignature.MinArgs);
+  ASSERT_EQ(3u, varSignature.MaxArgs);
+  ASSERT_EQ(&Int::TypeInstance, varSignature.GetType(2));
+  ASSERT_FALSE(varSignature.IsArgCountValid(0));
+  ASSERT_TRUE(varSignature.IsArgCountValid(3));
+  ASSERT_EQ("Expected between 1 and 3 args, got 4", varSignature.ArgCountError(4));
+
+  FuncDef listArgs(FuncDef::Args({ &Int::TypeInstance, &Str::TypeInstance }), FuncDef::NoArgs());
+  listArgs.Name = "f";
+  FuncDef copy(listArgs);
+  auto &listSignature = copy.GetSignature();
+  ASSERT_EQ(2u, listSignature.MinArgs);
+  ASSERT_EQ(&Str::TypeInstance, listSignature.GetType(1));
+
+  ExpressionPtr call { new Sexp(NullSourceContext) };
+  auto &args = static_cast<Sexp&>(*call).Args;
+  args.push_back(ExpressionPtr { new CompiledFunction(NullSourceContext, FuncDef(listArgs), TestSlispFn) });
+  args.push_back(ExpressionPtr { new Int(NullSourceContext, 1) });
+  args.push_back(ExpressionPtr { new Int(NullSourceContext, 2) });
+  string error;
+  ASSERT_FALSE(listArgs.ValidateArgs(TestEvaluator, call, error));
+  ASSERT_EQ("f: Wrong input args: Argument 2: Failed to evaluate", error);
+  ASSERT_FALSE(listArgs.ValidateArgs([](ExpressionPtr &) { return true; }, call, error));
+  ASSERT_EQ("f: Wrong input args: Argument 2: Expected str, got int", error);
+
+  args.back() = ExpressionPtr { new Str(NullSourceContext, "two") };
+  error.clear();
+  ASSERT_TRUE(listArgs.ValidateArgs(TestEvaluator, call, error));
+  ASSERT_TRUE(error.empty());
+
+  ArgList values;
+  values.push_back(ExpressionPtr { new Int(NullSourceContext, 1) });
+  ASSERT_FALSE(listSignature.Matches(values));
+  values.push_back(ExpressionPtr { new Int(NullSourceContext, 2) });
+  ASSERT_FALSE(listSignature.Matches(values));
+  values.back() = ExpressionPtr { new Str(NullSourceContext, "two") };
+  ASSERT_TRUE(listSignature.Matches(values));
+
+  FuncDef anyArgs(FuncDef::AnyArgs(), FuncDef::NoArgs());
+  ASSERT_EQ(0u, anyArgs.GetSignature().MinArgs);
+  ASSERT_TRUE(anyArgs.GetSignature().IsArgCountValid(100));
+}
+
+TEST(FuncDef, TestFuncDef_Flags) {
+  FuncDef standard(FuncDef::OneArg(Int::TypeInstance), FuncDef::NoArgs());
+  ASSERT_FALSE(standard.HasFlag(FuncDef::MutatesArgs));
+
+  FuncDef mutating(FuncDef::OneArg(Int::TypeInstance), FuncDef::NoArgs(), FuncDef::MutatesArgs);
+  ASSERT_TRUE(mutating.HasFlag(FuncDef::MutatesArgs));
+  ASSERT_TRUE(FuncDef(mutating).HasFlag(FuncDef::MutatesArgs));
+  ASSERT_TRUE(mutating != standard);
+}
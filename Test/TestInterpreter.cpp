@@ -91,6 +91,34 @@ TEST_F(SymbolTableTest, TestPutSymbolFunction) {
   ASSERT_TRUE(table.GetSymbol("f3", temp));
 }
 
+TEST_F(SymbolTableTest, TestPutSymbolFunctionDocs) {
+  SymbolTableType store;
+  FunctionDocs docs;
+  SymbolTable table(store, NullSourceContext, &docs);
+  auto slispFn = [](EvaluationContext&) { return true; };
+  table.PutSymbolFunction(
+    "f1",
+    {"(f1) -> nil"},
+    "does nothing",
+    {{"(f1)", "nil"}},
+    slispFn,
+    FuncDef { FuncDef::NoArgs(), FuncDef::NoArgs() }
+  );
+  ASSERT_EQ(static_cast<size_t>(1), docs.GetCount());
+  ASSERT_EQ(static_cast<size_t>(0), docs.GetMaterializedCount());
+
+  Expression *value;
+  ASSERT_TRUE(table.GetSymbol("f1", value));
+  auto &doc = docs.Find(static_cast<Function&>(*value).DocName);
+  ASSERT_EQ(static_cast<size_t>(1), docs.GetMaterializedCount());
+  ASSERT_EQ(vector<string> { "(f1) -> nil" }, doc.Signatures);
+  ASSERT_EQ("does nothing", doc.Doc);
+  ASSERT_EQ(static_cast<size_t>(1), doc.Examples.size());
+  ASSERT_EQ("nil", doc.Examples[0].ExpectedValue);
+  ASSERT_EQ(&doc, &docs.Find("f1"));
+  ASSERT_TRUE(docs.Find("f2").Signatures.empty());
+}
+
 TEST_F(SymbolTableTest, TestPutSymbol_Empty) {
   SymbolTableType store;
   SymbolTable table(store, NullSourceContext);
@@ -430,6 +458,57 @@ TEST_F(StackFrameTest, TestShadowing) {
   }
 }
 
+TEST_F(StackFrameTest, TestSlots) {
+  ArgList formals;
+  formals.emplace_back(Factory.Alloc<Symbol>("a"));
+  ExpressionPtr code { Factory.Alloc<Sexp>(ArgList {}) };
+  auto &body = static_cast<Sexp&>(*code);
+  body.Args.emplace_back(Factory.Alloc<Symbol>("let"));
+  body.Args.emplace_back(Factory.Alloc<Sexp>(ArgList {}));
+  auto &vars = static_cast<Sexp&>(*body.Args.back());
+  vars.Args.emplace_back(Factory.Alloc<Sexp>(ArgList {}));
+  static_cast<Sexp&>(*vars.Args.back()).Args.emplace_back(Factory.Alloc<Symbol>("b"));
+  static_cast<Sexp&>(*vars.Args.back()).Args.emplace_back(Factory.Alloc<Int>(1));
+  body.Args.emplace_back(Factory.Alloc<Symbol>("a"));
+
+  InterpretedFunction func(NullSourceContext, FuncDef { FuncDef::NoArgs(), FuncDef::NoArgs() }, move(code), move(formals));
+  ASSERT_TRUE(func.Slots != nullptr);
+  vector<Atom> expectedSlots { "a", "b" };
+  ASSERT_EQ(expectedSlots, *func.Slots);
+  ASSERT_TRUE(func.FreeSymbols != nullptr);
+  vector<Atom> expectedFreeSymbols { "let" };
+  ASSERT_EQ(expectedFreeSymbols, *func.FreeSymbols);
+  auto &aRef = static_cast<const Symbol&>(*static_cast<const Sexp&>(*func.Code).Args.back());
+  ASSERT_EQ(static_cast<size_t>(0), aRef.Slot);
+
+  ExpressionPtr temp;
+  StackFrame frame(Interpreter_, func);
+  ASSERT_FALSE(frame.GetSymbol("b", temp));
+  frame.PutLocalSymbol("a", ExpressionPtr { Factory.Alloc<Int>(42) });
+  ASSERT_EQ(0, frame.GetLocalSymbols().GetCount());
+  ASSERT_TRUE(frame.GetSymbol(aRef, temp));
+  ASSERT_EQ(*Factory.Alloc<Int>(42), *temp);
+  {
+    LocalScope scope(frame, NullSourceContext);
+    scope.PutSymbol("a", ExpressionPtr { Factory.Alloc<Int>(1) });
+    scope.PutSymbol("b", ExpressionPtr { Factory.Alloc<Int>(2) });
+    scope.PutSymbol("c", ExpressionPtr { Factory.Alloc<Int>(3) });
+    ASSERT_TRUE(scope.IsScopedSymbol("b"));
+    ASSERT_EQ(1, frame.GetLocalSymbols().GetCount());
+    ASSERT_TRUE(frame.GetSymbol("a", temp));
+    ASSERT_EQ(*Factory.Alloc<Int>(1), *temp);
+    ASSERT_TRUE(frame.GetSymbol("b", temp));
+    ASSERT_EQ(*Factory.Alloc<Int>(2), *temp);
+  }
+  ASSERT_EQ(0, frame.GetLocalSymbols().GetCount());
+  ASSERT_TRUE(frame.GetSymbol("a", temp));
+  ASSERT_EQ(*Factory.Alloc<Int>(42), *temp);
+  ASSERT_FALSE(frame.GetSymbol("b", temp));
+
+  frame.DeleteSymbol("a");
+  ASSERT_FALSE(frame.GetSymbol("a", temp));
+}
+
 TEST_F(InterpreterTest, TestDefaultSexp) {
   auto defaultSexp = Interpreter_.GetSettings().GetDefaultSexp();
   ASSERT_FALSE(defaultSexp.empty());
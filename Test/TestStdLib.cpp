@@ -6,6 +6,8 @@
 
 using namespace std;
 
+extern const char *TestEngineArg;
+
 class StdLibTest: public ::testing::Test {
   protected:
     static const vector<const char*> CmdArgs; 
@@ -15,11 +17,23 @@ class StdLibTest: public ::testing::Test {
     int NOutputLines;
     
     explicit StdLibTest():
-      Controller_(static_cast<int>(CmdArgs.size()), CmdArgs.data())
+      StdLibTest(GetCmdArgs())
+    {
+    }
+
+    explicit StdLibTest(const vector<const char*> &cmdArgs):
+      Controller_(static_cast<int>(cmdArgs.size()), cmdArgs.data())
     {
       Controller_.SetOutput(Out);
     }
 
+    static vector<const char*> GetCmdArgs() {
+      vector<const char*> cmdArgs = CmdArgs;
+      if (TestEngineArg)
+        cmdArgs.insert(cmdArgs.begin() + 1, TestEngineArg);
+      return cmdArgs;
+    }
+
     void Reset() {
       Out.str("");
       Out.clear();
@@ -309,6 +323,13 @@ TEST_F(StdLibInterpreterTest, TestHelpExamples) {
   ASSERT_TRUE(RunSuccess("(help.examples \"*\")", "((\"(* 2 3)\" \"6\"))"));
 }
 
+TEST_F(StdLibInterpreterTest, TestHelpAlias) {
+  ASSERT_TRUE(RunSuccess("(set times *)", "<Function:*>"));
+  ASSERT_TRUE(RunSuccess("(help.doc times)", "multiply"));
+  ASSERT_TRUE(RunSuccess("(def double (x) (* 2 x))", "<Function>"));
+  ASSERT_TRUE(RunSuccess("(help.signatures double)", "()"));
+}
+
 class StdLibIOTest: public StdLibTest {
 protected:
   void BasicExistsDeleteTest();
@@ -489,6 +510,26 @@ TEST_F(StdLibAssignmentTest, TestSetWithOpIncrementDecrement) {
   ASSERT_TRUE(RunSuccess("-- a", "42"));
 }
 
+TEST_F(StdLibAssignmentTest, TestSetWithOpInPlace) {
+  ASSERT_TRUE(RunSuccess("(def count-to (n) (let ((i 0) (total 0)) (while (< i n) (+= total i) (++ i)) (-= total 1) (-- total)))", "<Function>"));
+  ASSERT_TRUE(RunSuccess("(count-to 10)", "43"));
+  ASSERT_TRUE(RunSuccess("(def make-counter () (let ((c 0)) (fn () (++ c))))", "<Function>"));
+  ASSERT_TRUE(RunSuccess("(set counter (make-counter))", "<Function>"));
+  ASSERT_TRUE(RunSuccess("(counter)", "1"));
+  ASSERT_TRUE(RunSuccess("(counter)", "2"));
+  ASSERT_TRUE(RunSuccess("(set f 1.5)", "1.5"));
+  ASSERT_TRUE(RunSuccess("(+= f 2.0)", "3.5"));
+  ASSERT_TRUE(RunSuccess("(-= f 0.5)", "3"));
+  ASSERT_TRUE(RunFail("(+= f 1)"));
+  ASSERT_TRUE(RunFail("(++ f)"));
+  ASSERT_TRUE(RunSuccess("(set s \"a\")", "\"a\""));
+  ASSERT_TRUE(RunSuccess("(+= s \"b\")", "\"ab\""));
+  ASSERT_TRUE(RunFail("(++ undefined)"));
+  ASSERT_TRUE(RunSuccess("(set a 1)", "1"));
+  ASSERT_TRUE(RunSuccess("(def incr (n) 100)", "<Function>"));
+  ASSERT_TRUE(RunSuccess("(++ a)", "100"));
+}
+
 class StdLibNumericalTest: public StdLibTest {
   protected:
     decltype(Int::Value) MinValue,
@@ -558,6 +599,17 @@ TEST_F(StdLibNumericalTest, TestAdd) {
   ASSERT_TRUE(RunSuccess(temp.str(), to_string(MinValue)));
 }
 
+TEST_F(StdLibNumericalTest, TestOperandsNotModified) {
+  ASSERT_TRUE(RunSuccess("(set l (1 2 3))", "(1 2 3)"));
+  ASSERT_TRUE(RunSuccess("(foreach x l (+ x 5))", "8"));
+  ASSERT_TRUE(RunSuccess("(foreach x l (incr x))", "4"));
+  ASSERT_TRUE(RunSuccess("(foreach x l (< x 5))", "true"));
+  ASSERT_TRUE(RunSuccess("l", "(1 2 3)"));
+  ASSERT_TRUE(RunSuccess("(set n 1)", "1"));
+  ASSERT_TRUE(RunSuccess("(+ n n n)", "3"));
+  ASSERT_TRUE(RunSuccess("n", "1"));
+}
+
 TEST_F(StdLibNumericalTest, TestSub) {
   ASSERT_NO_FATAL_FAILURE(TestBadNumericArgs("-"));
   ASSERT_NO_FATAL_FAILURE(TestIdentity("-"));
@@ -1763,6 +1815,73 @@ TEST_F(StdLibListTest, TestPushBackBang) {
   ASSERT_TRUE(RunSuccess("a", "(())"));
 }
 
+TEST_F(StdLibListTest, TestCopiesAreIndependent) {
+  ASSERT_TRUE(RunSuccess("(set a (1 2 3 4 5 6))", "(1 2 3 4 5 6)"));
+  ASSERT_TRUE(RunSuccess("(set b a)", "(1 2 3 4 5 6)"));
+  ASSERT_TRUE(RunSuccess("(push-back! b 7)", "()"));
+  ASSERT_TRUE(RunSuccess("(pop-front! b)", "()"));
+  ASSERT_TRUE(RunSuccess("b", "(2 3 4 5 6 7)"));
+  ASSERT_TRUE(RunSuccess("a", "(1 2 3 4 5 6)"));
+
+  ASSERT_TRUE(RunSuccess("(foreach x a (begin (set c a) (set x 0)))", ""));
+  ASSERT_TRUE(RunSuccess("a", "(0 0 0 0 0 0)"));
+  ASSERT_TRUE(RunSuccess("c", "(0 0 0 0 0 6)"));
+  ASSERT_TRUE(RunSuccess("b", "(2 3 4 5 6 7)"));
+
+  ASSERT_TRUE(RunSuccess("(set a ((1 2 3 4 5 6) (7 8 9 10 11 12)))", "((1 2 3 4 5 6) (7 8 9 10 11 12))"));
+  ASSERT_TRUE(RunSuccess("(set b (head a))", "(1 2 3 4 5 6)"));
+  ASSERT_TRUE(RunSuccess("(push-front! b 0)", "()"));
+  ASSERT_TRUE(RunSuccess("a", "((1 2 3 4 5 6) (7 8 9 10 11 12))"));
+}
+
+TEST_F(StdLibListTest, TestLazySequences) {
+  // only the values reached are produced
+  ASSERT_TRUE(RunSuccess("(take 3 (filter even? (range 1 1000000000000)))", "(2 4 6)"));
+  ASSERT_TRUE(RunSuccess("(take 2 (map (fn (x) (* x x)) (skip 10 (range 1 1000000000000))))", "(121 144)"));
+  ASSERT_TRUE(RunSuccess("(take (fn (x) (< x 8)) (zip + (range 0 999999999999) (range 1 1000000000000)))", "(1 3 5 7)"));
+  ASSERT_TRUE(RunSuccess("(any (fn (x) (> x 5)) (range 1 1000000000000))", "true"));
+  ASSERT_TRUE(RunSuccess("(all (fn (x) (< x 5)) (range 1 1000000000000))", "false"));
+  ASSERT_TRUE(RunSuccess("(reduce + (take 100 (range 1 1000000000000)))", "5050"));
+  ASSERT_TRUE(RunSuccess("(set sum 0)", "0"));
+  ASSERT_TRUE(RunSuccess("(foreach x (map incr (range 1 4)) (sum += x))", "14"));
+
+  // values stored or returned are lists
+  ASSERT_TRUE(RunSuccess("(set r (map incr (range 1 3)))", "(2 3 4)"));
+  ASSERT_TRUE(RunSuccess("(push-back! r 5)", "()"));
+  ASSERT_TRUE(RunSuccess("r", "(2 3 4 5)"));
+  ASSERT_TRUE(RunSuccess("(list? (take 2 (range 1 5)))", "true"));
+  ASSERT_TRUE(RunSuccess("(def f (n) (filter even? (range 1 n)))", "Function"));
+  ASSERT_TRUE(RunSuccess("(map incr (f 6))", "(3 5 7)"));
+
+  // errors raised while producing a value stop the pipeline
+  ASSERT_TRUE(RunFail("(take 2 (map (fn (x) (+ x \"a\")) (range 1 10)))"));
+  ASSERT_TRUE(RunFail("(take 2 (filter incr (range 1 10)))"));
+  ASSERT_TRUE(RunFail("(take 5 (zip + (range 1 10) (range 1 3)))"));
+  ASSERT_TRUE(RunFail("(foreach x (map (fn (x) (+ x \"a\")) (range 1 10)) x)"));
+  ASSERT_TRUE(RunFail("(take 2 (zip + (range 1 10) (range 1 3)))"));
+  ASSERT_TRUE(RunSuccess("(set sum 0)", "0"));
+  ASSERT_TRUE(RunFail("(foreach x (zip + (range 1 10) (range 1 3)) (sum += x))"));
+  ASSERT_TRUE(RunSuccess("sum", "0"));
+}
+
+TEST_F(StdLibListTest, TestLazySequencesLeaveSourcesIntact) {
+  ASSERT_TRUE(RunSuccess("(set l ((1 2 3) (4 5 6)))", "((1 2 3) (4 5 6))"));
+  ASSERT_TRUE(RunSuccess("(foreach x l (filter even? x))", "(4 6)"));
+  ASSERT_TRUE(RunSuccess("(foreach x l (map incr x))", "(5 6 7)"));
+  ASSERT_TRUE(RunSuccess("(foreach x l (take 2 x))", "(4 5)"));
+  ASSERT_TRUE(RunSuccess("(foreach x l (skip 1 x))", "(5 6)"));
+  ASSERT_TRUE(RunSuccess("(foreach x l (reduce + x))", "15"));
+  ASSERT_TRUE(RunSuccess("(foreach x l (zip x x))", "((4 4) (5 5) (6 6))"));
+  ASSERT_TRUE(RunSuccess("l", "((1 2 3) (4 5 6))"));
+
+  ASSERT_TRUE(RunSuccess("(set m (1 2 3 4))", "(1 2 3 4)"));
+  ASSERT_TRUE(RunSuccess("(filter even? m)", "(2 4)"));
+  ASSERT_TRUE(RunSuccess("(take 2 (map incr m))", "(2 3)"));
+  ASSERT_TRUE(RunSuccess("(def f (xs) (let ((ys (skip 2 xs))) xs))", "Function"));
+  ASSERT_TRUE(RunSuccess("(f m)", "(1 2 3 4)"));
+  ASSERT_TRUE(RunSuccess("m", "(1 2 3 4)"));
+}
+
 TEST_F(StdLibListTest, TestPopFront) {
   ASSERT_TRUE(RunFail("(pop-front)"));
   ASSERT_TRUE(RunFail("(pop-front 1)"));
@@ -1966,6 +2085,12 @@ TEST_F(StdLibListTest, TestForeach) {
 
   ASSERT_TRUE(RunSuccess("(for e : lst (e += 10))", "26"));
   ASSERT_TRUE(RunSuccess("lst", "(18 22 26)"));
+
+  ASSERT_TRUE(RunSuccess("e = 42", "42"));
+  ASSERT_TRUE(RunSuccess("(foreach e (1 2) (foreach e (3 4) (e += 1)))", "5"));
+  ASSERT_TRUE(RunSuccess("e", "42"));
+  ASSERT_TRUE(RunSuccess("(def f (x) (begin (foreach x (1 2 3) x) x))", "<Function>"));
+  ASSERT_TRUE(RunSuccess("(f 7)", "7"));
 }
 
 TEST_F(StdLibListTest, TestReverse) {
@@ -1987,6 +2112,184 @@ TEST_F(StdLibListTest, TestNth) {
   ASSERT_TRUE(RunSuccess("(nth (10 20 30) 1)", "20"));
 }
 
+TEST_F(StdLibListTest, TestSort) {
+  ASSERT_TRUE(RunFail("(sort)"));
+  ASSERT_TRUE(RunFail("(sort 1)"));
+  ASSERT_TRUE(RunFail("(sort (1 \"a\"))"));
+  ASSERT_TRUE(RunFail("(sort ((1) (2)))"));
+  ASSERT_TRUE(RunFail("(sort 1 (2 1))"));
+  ASSERT_TRUE(RunFail("(sort + (2 1))"));
+  ASSERT_TRUE(RunSuccess("(sort ())", "()"));
+  ASSERT_TRUE(RunSuccess("(sort (3 1 2))", "(1 2 3)"));
+  ASSERT_TRUE(RunSuccess("(sort (2.5 -1.0 0.5))", "(-1 0.5 2.5)"));
+  ASSERT_TRUE(RunSuccess("(sort (\"b\" \"c\" \"a\"))", "(\"a\" \"b\" \"c\")"));
+  ASSERT_TRUE(RunSuccess("(sort (true false true))", "(false true true)"));
+  ASSERT_TRUE(RunSuccess("(sort (range 5 1 -1))", "(1 2 3 4 5)"));
+  ASSERT_TRUE(RunSuccess("(sort > (3 1 2))", "(3 2 1)"));
+  ASSERT_TRUE(RunSuccess("(sort (fn (a b) (< (% a 10) (% b 10))) (31 12 21 11))", "(31 21 11 12)"));
+  ASSERT_TRUE(RunSuccess("(sort (fn (a b) (< (length a) (length b))) ((1 2) () (3)))", "(() (3) (1 2))"));
+  ASSERT_TRUE(RunSuccess("(sort (fn (a b) (begin (++ a) (++ b) (< a b))) (3 1 2))", "(1 2 3)"));
+  ASSERT_TRUE(RunSuccess("(set c 0)", "0"));
+  ASSERT_TRUE(RunSuccess("(length (sort (fn (a b) (begin (++ c) (== 0 (% c 3)))) (range 0 1000)))", "1001"));
+
+  ASSERT_TRUE(RunSuccess("(set lst (3 1 2))", "(3 1 2)"));
+  ASSERT_TRUE(RunSuccess("(sort lst)", "(1 2 3)"));
+  ASSERT_TRUE(RunSuccess("lst", "(3 1 2)"));
+}
+
+TEST_F(StdLibListTest, TestSortBy) {
+  ASSERT_TRUE(RunFail("(sort-by length)"));
+  ASSERT_TRUE(RunFail("(sort-by 1 (2 1))"));
+  ASSERT_TRUE(RunFail("(sort-by (fn (x) (if (> x 1) x \"a\")) (2 1))"));
+  ASSERT_TRUE(RunSuccess("(sort-by length ())", "()"));
+  ASSERT_TRUE(RunSuccess("(sort-by length (\"ccc\" \"a\" \"bb\"))", "(\"a\" \"bb\" \"ccc\")"));
+  ASSERT_TRUE(RunSuccess("(sort-by (fn (x) (% x 10)) (31 12 21 11))", "(31 21 11 12)"));
+  ASSERT_TRUE(RunSuccess("(sort-by head ((2 \"b\") (1 \"a\")))", "((1 \"a\") (2 \"b\"))"));
+}
+
+TEST_F(StdLibListTest, TestSortBang) {
+  ASSERT_TRUE(RunFail("(sort! (3 1 2))"));
+  ASSERT_TRUE(RunFail("(sort! nil)"));
+  ASSERT_TRUE(RunSuccess("(set a 42)", "42"));
+  ASSERT_TRUE(RunFail("(sort! a)"));
+
+  ASSERT_TRUE(RunSuccess("(set a (3 1 2))", "(3 1 2)"));
+  ASSERT_TRUE(RunSuccess("(sort! a)", "()"));
+  ASSERT_TRUE(RunSuccess("a", "(1 2 3)"));
+  ASSERT_TRUE(RunSuccess("(sort! > a)", "()"));
+  ASSERT_TRUE(RunSuccess("a", "(3 2 1)"));
+
+  ASSERT_TRUE(RunSuccess("(set a (3 \"a\" 2))", "(3 \"a\" 2)"));
+  ASSERT_TRUE(RunFail("(sort! a)"));
+  ASSERT_TRUE(RunSuccess("a", "(3 \"a\" 2)"));
+}
+
+class StdLibDictTest: public StdLibTest {
+};
+
+TEST_F(StdLibDictTest, TestDict) {
+  ASSERT_TRUE(RunSuccess("(dict)", "{}"));
+  ASSERT_TRUE(RunSuccess("(dict \"a\" 1 2 (3 4))", "{\"a\" 1 2 (3 4)}"));
+  ASSERT_TRUE(RunSuccess("(dict 1 \"a\" 1 \"b\")", "{1 \"b\"}"));
+  ASSERT_TRUE(RunSuccess("(dict 1 1 1.0 2 true 3)", "{1 1 1 2 true 3}"));
+  ASSERT_TRUE(RunFail("(dict 1)"));
+  ASSERT_TRUE(RunFail("(dict (1) 2)"));
+  ASSERT_TRUE(RunFail("(dict nil 2)"));
+
+  ASSERT_TRUE(RunSuccess("(== (dict 1 2 3 4) (dict 3 4 1 2))", "true"));
+  ASSERT_TRUE(RunSuccess("(== (dict 1 2 3 4) (dict 1 2 3 5))", "false"));
+  ASSERT_TRUE(RunSuccess("(== (dict 1 2) (dict 1 2 3 4))", "false"));
+}
+
+TEST_F(StdLibDictTest, TestDictGet) {
+  ASSERT_TRUE(RunSuccess("(set d (dict \"a\" 1 2 (3 4)))", "{\"a\" 1 2 (3 4)}"));
+  ASSERT_TRUE(RunSuccess("(dict-get d \"a\")", "1"));
+  ASSERT_TRUE(RunSuccess("(dict-get d 2)", "(3 4)"));
+  ASSERT_TRUE(RunFail("(dict-get d \"b\")"));
+  ASSERT_TRUE(RunSuccess("(dict-get d \"b\" 42)", "42"));
+  ASSERT_TRUE(RunSuccess("(dict-get d \"a\" 42)", "1"));
+  ASSERT_TRUE(RunFail("(dict-get d 2.0)"));
+  ASSERT_TRUE(RunFail("(dict-get d (1))"));
+  ASSERT_TRUE(RunFail("(dict-get (1 2) 1)"));
+  ASSERT_TRUE(RunFail("(dict-get d)"));
+  ASSERT_TRUE(RunSuccess("(dict-contains? d \"a\")", "true"));
+  ASSERT_TRUE(RunSuccess("(dict-contains? d \"b\")", "false"));
+}
+
+TEST_F(StdLibDictTest, TestDictPut) {
+  ASSERT_TRUE(RunSuccess("(set d (dict 1 2))", "{1 2}"));
+  ASSERT_TRUE(RunSuccess("(dict-put d 3 4)", "{1 2 3 4}"));
+  ASSERT_TRUE(RunSuccess("(dict-put d 1 4)", "{1 4}"));
+  ASSERT_TRUE(RunSuccess("d", "{1 2}"));
+  ASSERT_TRUE(RunFail("(dict-put d (1) 4)"));
+  ASSERT_TRUE(RunFail("(dict-put 1 1 4)"));
+
+  ASSERT_TRUE(RunSuccess("(dict-remove d 1)", "{}"));
+  ASSERT_TRUE(RunSuccess("(dict-remove d 3)", "{1 2}"));
+  ASSERT_TRUE(RunSuccess("d", "{1 2}"));
+}
+
+TEST_F(StdLibDictTest, TestDictPutBang) {
+  ASSERT_TRUE(RunFail("(dict-put! (dict) 1 2)"));
+  ASSERT_TRUE(RunFail("(dict-put! undefined 1 2)"));
+  ASSERT_TRUE(RunSuccess("(set a (1 2))", "(1 2)"));
+  ASSERT_TRUE(RunFail("(dict-put! a 1 2)"));
+
+  ASSERT_TRUE(RunSuccess("(set d (dict))", "{}"));
+  ASSERT_TRUE(RunSuccess("(dict-put! d 1 2)", "()"));
+  ASSERT_TRUE(RunSuccess("(dict-put! d 3 4)", "()"));
+  ASSERT_TRUE(RunSuccess("(dict-put! d 1 5)", "()"));
+  ASSERT_TRUE(RunSuccess("d", "{1 5 3 4}"));
+
+  ASSERT_TRUE(RunSuccess("(dict-remove! d 1)", "()"));
+  ASSERT_TRUE(RunSuccess("(dict-remove! d 42)", "()"));
+  ASSERT_TRUE(RunSuccess("d", "{3 4}"));
+
+  ASSERT_TRUE(RunSuccess("(foreach w (\"a\" \"b\" \"a\") (dict-put! d w (+ 1 (dict-get d w 0))))", "()"));
+  ASSERT_TRUE(RunSuccess("d", "{3 4 \"a\" 2 \"b\" 1}"));
+}
+
+TEST_F(StdLibDictTest, TestDictRemoveKeepsOtherEntries) {
+  ASSERT_TRUE(RunSuccess("(set d (dict 1 10 2 20 3 30 4 40))", "{1 10 2 20 3 30 4 40}"));
+  ASSERT_TRUE(RunSuccess("(dict-remove! d 2)", "()"));
+  ASSERT_TRUE(RunSuccess("d", "{1 10 4 40 3 30}"));
+  ASSERT_TRUE(RunSuccess("(dict-get d 4)", "40"));
+  ASSERT_TRUE(RunSuccess("(dict-remove! d 3)", "()"));
+  ASSERT_TRUE(RunSuccess("(dict-get d 4)", "40"));
+  ASSERT_TRUE(RunSuccess("(dict-contains? d 3)", "false"));
+}
+
+TEST_F(StdLibDictTest, TestDictKeysValues) {
+  ASSERT_TRUE(RunSuccess("(dict-keys (dict))", "()"));
+  ASSERT_TRUE(RunSuccess("(dict-keys (dict \"a\" 1 \"b\" (2)))", "(\"a\" \"b\")"));
+  ASSERT_TRUE(RunSuccess("(dict-values (dict \"a\" 1 \"b\" (2)))", "(1 (2))"));
+  ASSERT_TRUE(RunFail("(dict-keys (1 2))"));
+}
+
+TEST_F(StdLibDictTest, TestDictLength) {
+  ASSERT_TRUE(RunSuccess("(length (dict))", "0"));
+  ASSERT_TRUE(RunSuccess("(set d (dict \"a\" 1 \"b\" 2))", "{\"a\" 1 \"b\" 2}"));
+  ASSERT_TRUE(RunSuccess("(length d)", "2"));
+  ASSERT_TRUE(RunSuccess("(dict-remove! d \"a\")", "()"));
+  ASSERT_TRUE(RunSuccess("(length d)", "1"));
+}
+
+TEST_F(StdLibDictTest, TestDictEmpty) {
+  ASSERT_TRUE(RunSuccess("(empty? (dict))", "true"));
+  ASSERT_TRUE(RunSuccess("(empty? (dict 1 2))", "false"));
+  ASSERT_TRUE(RunSuccess("(empty? (dict-remove (dict 1 2) 1))", "true"));
+}
+
+TEST_F(StdLibDictTest, TestDictIterate) {
+  ASSERT_TRUE(RunSuccess("(set d (dict 1 10 2 20))", "{1 10 2 20}"));
+  ASSERT_TRUE(RunSuccess("(map (fn (e) (* (head e) (last e))) d)", "(10 40)"));
+  ASSERT_TRUE(RunSuccess("(filter (fn (e) (> (head e) 1)) d)", "((2 20))"));
+  ASSERT_TRUE(RunSuccess("(set total 0)", "0"));
+  ASSERT_TRUE(RunSuccess("(foreach e d (+= total (last e)))", "30"));
+  ASSERT_TRUE(RunSuccess("(at d 1)", "(2 20)"));
+}
+
+TEST_F(StdLibDictTest, TestDictChangedWhileIterating) {
+  ASSERT_TRUE(RunSuccess("(set d (dict 1 1 2 2 3 3))", "{1 1 2 2 3 3}"));
+  ASSERT_TRUE(RunSuccess("(foreach kv d (set d 5))", "5"));
+  ASSERT_TRUE(RunSuccess("d", "5"));
+  ASSERT_TRUE(RunSuccess("(set d (dict 1 1 2 2))", "{1 1 2 2}"));
+  ASSERT_TRUE(RunSuccess("(set n 0)", "0"));
+  ASSERT_TRUE(RunSuccess("(foreach kv d (dict-put! d (+ 10 (head kv)) 0) (dict-remove! d 1) (++ n))", "2"));
+  ASSERT_TRUE(RunSuccess("d", "{11 0 2 2 12 0}"));
+}
+
+TEST_F(StdLibDictTest, TestCopiesAreIndependent) {
+  ASSERT_TRUE(RunSuccess("(set a (dict 1 (1 2)))", "{1 (1 2)}"));
+  ASSERT_TRUE(RunSuccess("(set b a)", "{1 (1 2)}"));
+  ASSERT_TRUE(RunSuccess("(dict-put! b 2 3)", "()"));
+  ASSERT_TRUE(RunSuccess("a", "{1 (1 2)}"));
+  ASSERT_TRUE(RunSuccess("b", "{1 (1 2) 2 3}"));
+  ASSERT_TRUE(RunSuccess("(dict-remove! a 1)", "()"));
+  ASSERT_TRUE(RunSuccess("a", "{}"));
+  ASSERT_TRUE(RunSuccess("b", "{1 (1 2) 2 3}"));
+}
+
 class StdLibLogicalTest: public StdLibTest {
   protected:
     string Prefix;
@@ -2511,6 +2814,34 @@ TEST_F(StdLibBranchTest, TestLambda) {
   ASSERT_TRUE(RunSuccess("((fn (x y) (* x y)) 5 6)", "30"));
 }
 
+TEST_F(StdLibBranchTest, TestLambdaClosures) {
+  // nested
+  ASSERT_TRUE(RunSuccess("(def adder (x) (fn (y) (fn (z) (+ x y z))))", "Function"));
+  ASSERT_TRUE(RunSuccess("(((adder 1) 2) 3)", "6"));
+
+  // let-bound
+  ASSERT_TRUE(RunSuccess("(def stepper (n) (let ((step 2) (unused (1 2 3))) (fn (k) (+ n (* step k)))))", "Function"));
+  ASSERT_TRUE(RunSuccess("((stepper 10) 3)", "16"));
+
+  // shadowing
+  ASSERT_TRUE(RunSuccess("(def twice-next (x) (let ((f (fn (x) (* x 2)))) (f (+ x 1))))", "Function"));
+  ASSERT_TRUE(RunSuccess("(twice-next 5)", "12"));
+  ASSERT_TRUE(RunSuccess("(def inner-x (x) (let ((x 7)) (fn () x)))", "Function"));
+  ASSERT_TRUE(RunSuccess("((inner-x 1))", "7"));
+  ASSERT_TRUE(RunSuccess("(set x 100)", "100"));
+  ASSERT_TRUE(RunSuccess("(def outer-x (x) (fn () x))", "Function"));
+  ASSERT_TRUE(RunSuccess("((outer-x 3))", "3"));
+  ASSERT_TRUE(RunSuccess("x", "100"));
+
+  // locals only named by code that is evaluated as data
+  ASSERT_TRUE(RunSuccess("(def unquoted (n) (let ((code '(+ n 1))) (fn () (unquote code))))", "Function"));
+  ASSERT_TRUE(RunSuccess("((unquoted 41))", "42"));
+  ASSERT_TRUE(RunSuccess("(def evaluator (n) (fn (code) (unquote code)))", "Function"));
+  ASSERT_TRUE(RunSuccess("((evaluator 41) '(+ n 2))", "43"));
+  ASSERT_TRUE(RunSuccess("(def applied (n) (let ((args '(n 1))) (fn () (apply + args))))", "Function"));
+  ASSERT_TRUE(RunSuccess("((applied 41))", "42"));
+}
+
 TEST_F(StdLibBranchTest, TestDef) {
   ASSERT_TRUE(RunFail("(def)"));
   ASSERT_TRUE(RunFail("(def f)"));
@@ -2532,6 +2863,28 @@ TEST_F(StdLibBranchTest, TestDef) {
   ASSERT_TRUE(RunSuccess("(implicitBegin 2)", "4"));
 }
 
+TEST_F(StdLibBranchTest, TestTailCalls) {
+  ASSERT_TRUE(RunSuccess("(def count (n acc) (if (== n 0) acc (count (- n 1) (+ acc 1))))", "Function"));
+  ASSERT_TRUE(RunSuccess("(count 20000 0)", "20000"));
+
+  ASSERT_TRUE(RunSuccess("(def ev? (n) (cond ((== n 0) true) (true (od? (- n 1)))))", "Function"));
+  ASSERT_TRUE(RunSuccess("(def od? (n) (begin (set m (- n 1)) (if (== n 0) false (ev? m))))", "Function"));
+  ASSERT_TRUE(RunSuccess("(ev? 20001)", "false"));
+
+  ASSERT_TRUE(RunSuccess("(def down (n) (let ((m (- n 1))) (if (< m 0) \"done\" (down m))))", "Function"));
+  ASSERT_TRUE(RunSuccess("(down 20000)", "\"done\""));
+
+  ASSERT_TRUE(RunSuccess("(def twice (g n) (if (== n 0) (g n) (twice g (- n 1))))", "Function"));
+  ASSERT_TRUE(RunSuccess("(twice (fn (x) (+ x 42)) 20000)", "42"));
+  ASSERT_TRUE(RunSuccess("(def self (g n) (if (== n 0) 0 (g g (- n 1))))", "Function"));
+  ASSERT_TRUE(RunSuccess("(self self 20000)", "0"));
+
+  ASSERT_TRUE(RunSuccess("(def each (n) (foreach x (1 2 3) (+ x n)))", "Function"));
+  ASSERT_TRUE(RunSuccess("(each 1)", "4"));
+  ASSERT_TRUE(RunSuccess("(def notTail (n) (if (== n 0) 0 (+ 1 (notTail (- n 1)))))", "Function"));
+  ASSERT_TRUE(RunSuccess("(notTail 100)", "100"));
+}
+
 TEST_F(StdLibBranchTest, TestApply) {
   ASSERT_TRUE(RunFail("(apply)"));
   ASSERT_TRUE(RunFail("(apply +)"));
@@ -2587,6 +2940,10 @@ TEST_F(StdLibBranchTest, TestError_StackTrace) {
   ASSERT_GT(bFnPos, cFnPos);
   ASSERT_GT(aFnPos, bFnPos);
   ASSERT_GT(mainFnPos, aFnPos);
+
+  ASSERT_TRUE(RunSuccess("(try (aFn) false)", "false"));
+  ASSERT_TRUE(RunSuccess("(set handler (quote (length $error.stack)))", ""));
+  ASSERT_TRUE(RunSuccess("(try (aFn) (unquote handler))", "5"));
 }
 
 TEST_F(StdLibBranchTest, TestTry) {
@@ -2754,6 +3111,8 @@ TEST_F(StdLibOperatorsTest, TestTypeQ) {
   ASSERT_TRUE(RunSuccess("(str? (1 2))", "false"));
   ASSERT_TRUE(RunSuccess("(list? (1 2))", "true"));
   ASSERT_TRUE(RunSuccess("(list? +)", "false"));
+  ASSERT_TRUE(RunSuccess("(dict? (dict))", "true"));
+  ASSERT_TRUE(RunSuccess("(dict? (1 2))", "false"));
   ASSERT_TRUE(RunSuccess("(fn? +)", "true"));
   ASSERT_TRUE(RunSuccess("(fn? false)", "false"));
   ASSERT_TRUE(RunSuccess("(atom? 3)", "true"));
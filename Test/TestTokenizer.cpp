@@ -311,3 +311,56 @@ TEST(Tokenizer, TestSetLine) {
   ++tokenizer;
   RunNoneTest(tokenizer);
 }
+
+TEST(Tokenizer, TestLineRange) {
+  Tokenizer tokenizer;
+  string buffer = "(+ 1 2)\n(- 3 4)";
+  tokenizer.SetLine(buffer.data() + 8, 7);
+
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::PARENOPEN, "("), *tokenizer);
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::SYMBOL, "-"), *tokenizer);
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::NUMBER, "3"), *tokenizer);
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::NUMBER, "4"), *tokenizer);
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::PARENCLOSE, ")"), *tokenizer);
+  ++tokenizer;
+  RunNoneTest(tokenizer);
+
+  tokenizer.SetLine(buffer.data(), 4);
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::PARENOPEN, "("), *tokenizer);
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::SYMBOL, "+"), *tokenizer);
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::NUMBER, "1"), *tokenizer);
+  ++tokenizer;
+  RunNoneTest(tokenizer);
+}
+
+TEST(Tokenizer, TestLongLine) {
+  Tokenizer tokenizer;
+  string line = "(list";
+  for (int i = 0; i < 10000; ++i)
+    line += " " + to_string(i) + " \"s" + to_string(i) + "\"";
+  line += ")";
+  tokenizer.SetLine(line);
+
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::PARENOPEN, "("), *tokenizer);
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::SYMBOL, "list"), *tokenizer);
+  for (int i = 0; i < 10000; ++i) {
+    ++tokenizer;
+    ASSERT_EQ(Token(TokenTypes::NUMBER, to_string(i)), *tokenizer);
+    ++tokenizer;
+    ASSERT_EQ(Token(TokenTypes::STRING, "s" + to_string(i)), *tokenizer);
+  }
+  ++tokenizer;
+  ASSERT_EQ(Token(TokenTypes::PARENCLOSE, ")"), *tokenizer);
+  ++tokenizer;
+  RunNoneTest(tokenizer);
+}
@@ -28,13 +28,21 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <stdio.h>
+#include <string.h>
 
 #include "gtest/gtest.h"
 
 //#pragma comment(lib, "Slisp.lib")
 
+// --engine=... is forwarded to the slisp command lines built by the tests
+const char *TestEngineArg = nullptr;
+
 GTEST_API_ int main(int argc, char **argv) {
   printf("Running main() from gtest_main.cc\n");
   testing::InitGoogleTest(&argc, argv);
+  for (int i = 1; i < argc; ++i) {
+    if (strncmp(argv[i], "--engine=", 9) == 0)
+      TestEngineArg = argv[i];
+  }
   return RUN_ALL_TESTS();
 }